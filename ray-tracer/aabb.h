@@ -0,0 +1,76 @@
+#pragma once
+#ifndef AABB_H
+#define AABB_H
+
+#include "rtweekend.h"
+
+class aabb {
+public:
+    interval x, y, z;
+
+    aabb() {} // Empty by default since intervals are empty by default
+
+    aabb(const interval& x, const interval& y, const interval& z) : x(x), y(y), z(z) {}
+
+    aabb(const point3& a, const point3& b) {
+        // a and b are opposite corners, in any order
+        x = (a[0] <= b[0]) ? interval(a[0], b[0]) : interval(b[0], a[0]);
+        y = (a[1] <= b[1]) ? interval(a[1], b[1]) : interval(b[1], a[1]);
+        z = (a[2] <= b[2]) ? interval(a[2], b[2]) : interval(b[2], a[2]);
+    }
+
+    aabb(const aabb& box0, const aabb& box1) : x(box0.x, box1.x), y(box0.y, box1.y), z(box0.z, box1.z) {}
+
+    const interval& axis_interval(int n) const {
+        if (n == 1) { return y; }
+        if (n == 2) { return z; }
+        return x;
+    }
+
+    bool hit(const ray& r, interval ray_t) const {
+        // Slab test. The ray is inside the box where its t range overlaps all three axis slabs.
+        // min/max instead of swapping keeps it branch free, and IEEE infinities handle axis parallel rays.
+        const point3& orig = r.origin();
+        const vec3& dir = r.direction();
+
+        for (int axis = 0; axis < 3; axis++) {
+            const interval& ax = axis_interval(axis);
+            const real adinv = 1 / dir[axis];
+
+            auto t0 = (ax.min - orig[axis]) * adinv;
+            auto t1 = (ax.max - orig[axis]) * adinv;
+
+            ray_t.min = std::fmax(ray_t.min, std::fmin(t0, t1));
+            ray_t.max = std::fmin(ray_t.max, std::fmax(t0, t1));
+
+            if (ray_t.max <= ray_t.min) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    int longest_axis() const {
+        if (x.size() > y.size()) {
+            return (x.size() > z.size()) ? 0 : 2;
+        }
+        return (y.size() > z.size()) ? 1 : 2;
+    }
+
+    real surface_area() const {
+        // Probability of a random ray hitting the box is proportional to this (SAH)
+        if (x.size() < 0 || y.size() < 0 || z.size() < 0) { return 0; }
+        return 2 * (x.size() * y.size() + y.size() * z.size() + z.size() * x.size());
+    }
+
+    point3 centroid() const {
+        return point3((x.min + x.max) / 2, (y.min + y.max) / 2, (z.min + z.max) / 2);
+    }
+
+    static const aabb empty, universe;
+};
+
+const aabb aabb::empty = aabb(interval::empty, interval::empty, interval::empty);
+const aabb aabb::universe = aabb(interval::universe, interval::universe, interval::universe);
+
+#endif
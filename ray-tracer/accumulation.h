@@ -0,0 +1,191 @@
+#pragma once
+#ifndef ACCUMULATION_H
+#define ACCUMULATION_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "color.h"
+#include "framebuffer.h"
+
+// Running per pixel sums of samples and how many samples went into them.
+// Sums are doubles so a pixel can take hundreds of thousands of samples over many resumed runs without the later
+// ones being rounded away. Dividing by the count gives the image at any point.
+// The sum of the samples' squared luminances is kept too, for a running variance of every pixel.
+class accumulation_buffer {
+public:
+    accumulation_buffer() {}
+    accumulation_buffer(int width, int height)
+        : w(width), h(height), sums(size_t(width) * height * 3, 0.0), sq_sums(size_t(width) * height, 0.0),
+          counts(size_t(width) * height, 0) {}
+
+    int width() const { return w; }
+    int height() const { return h; }
+
+    void add(int i, int j, const color& sample_sum, double luminance_sq_sum, uint32_t samples) {
+        size_t p = size_t(j) * w + i;
+        sums[p * 3 + 0] += sample_sum.x();
+        sums[p * 3 + 1] += sample_sum.y();
+        sums[p * 3 + 2] += sample_sum.z();
+        sq_sums[p] += luminance_sq_sum;
+        counts[p] += samples;
+    }
+
+    uint32_t samples(int i, int j) const { return counts[size_t(j) * w + i]; }
+
+    color sum(int i, int j) const {
+        size_t p = size_t(j) * w + i;
+        return color(sums[p * 3 + 0], sums[p * 3 + 1], sums[p * 3 + 2]);
+    }
+
+    color mean(int i, int j) const {
+        uint32_t n = samples(i, j);
+        return (n == 0) ? color(0, 0, 0) : (1.0 / n) * sum(i, j);
+    }
+
+    double mean_luminance(int i, int j) const {
+        return luminance(mean(i, j));
+    }
+
+    // Standard error of the pixel's mean luminance, how far off the pixel probably still is
+    double standard_error(int i, int j) const {
+        uint32_t n = samples(i, j);
+        if (n < 2) { return infinity; }
+        double m = mean_luminance(i, j);
+        double variance = (sq_sums[size_t(j) * w + i] - n * m * m) / (n - 1); // Unbiased sample variance
+        return std::sqrt(std::fmax(0.0, variance) / n);
+    }
+
+    uint32_t min_samples() const {
+        uint32_t m = UINT32_MAX;
+        for (auto c : counts) { m = (c < m) ? c : m; }
+        return counts.empty() ? 0 : m;
+    }
+
+    uint64_t total_samples() const {
+        uint64_t total = 0;
+        for (auto c : counts) { total += c; }
+        return total;
+    }
+
+    framebuffer resolve() const {
+        framebuffer fb(w, h);
+        for (int j = 0; j < h; j++) {
+            for (int i = 0; i < w; i++) {
+                fb.set(i, j, mean(i, j));
+            }
+        }
+        return fb;
+    }
+
+    // Rows [y0, y1) as bytes (sums, squared luminance sums, then counts, host byte order), for sending part of an
+    // image to another process. add_packed_rows adds them in there, so it also merges sample ranges of the same rows.
+    size_t packed_size(int y0, int y1) const { return size_t(y1 - y0) * w * (4 * sizeof(double) + sizeof(uint32_t)); }
+
+    std::vector<char> pack_rows(int y0, int y1) const {
+        size_t first = size_t(y0) * w;
+        size_t n = size_t(y1 - y0) * w;
+        std::vector<char> out(packed_size(y0, y1));
+        char* p = out.data();
+        std::memcpy(p, &sums[first * 3], n * 3 * sizeof(double));
+        p += n * 3 * sizeof(double);
+        std::memcpy(p, &sq_sums[first], n * sizeof(double));
+        p += n * sizeof(double);
+        std::memcpy(p, &counts[first], n * sizeof(uint32_t));
+        return out;
+    }
+
+    bool add_packed_rows(int y0, int y1, const std::vector<char>& packed) {
+        if (y0 < 0 || y1 > h || y0 > y1) { return false; }
+        size_t first = size_t(y0) * w;
+        size_t n = size_t(y1 - y0) * w;
+        if (packed.size() != packed_size(y0, y1)) { return false; }
+        const char* p = packed.data();
+        for (size_t k = 0; k < n * 3; k++, p += sizeof(double)) {
+            double v;
+            std::memcpy(&v, p, sizeof v);
+            sums[first * 3 + k] += v;
+        }
+        for (size_t k = 0; k < n; k++, p += sizeof(double)) {
+            double v;
+            std::memcpy(&v, p, sizeof v);
+            sq_sums[first + k] += v;
+        }
+        for (size_t k = 0; k < n; k++, p += sizeof(uint32_t)) {
+            uint32_t c;
+            std::memcpy(&c, p, sizeof c);
+            counts[first + k] += c;
+        }
+        return true;
+    }
+
+    // Checkpoint file: "RTCK", version, width, height, frame, then every sum, squared luminance sum and count,
+    // in host byte order.
+    // The frame is stored so a checkpoint of one animation frame can't be resumed into another.
+    bool save(const std::string& path, int frame) const {
+        std::string tmp = path + ".tmp"; // Written aside and renamed so a crash mid write keeps the old checkpoint
+        FILE* f = std::fopen(tmp.c_str(), "wb");
+        if (!f) {
+            std::cerr << "Could not open " << tmp << " for writing\n";
+            return false;
+        }
+        int32_t header[4] = { checkpoint_version, w, h, frame };
+        bool ok = std::fwrite("RTCK", 1, 4, f) == 4
+               && std::fwrite(header, sizeof header, 1, f) == 1
+               && std::fwrite(sums.data(), sizeof(double), sums.size(), f) == sums.size()
+               && std::fwrite(sq_sums.data(), sizeof(double), sq_sums.size(), f) == sq_sums.size()
+               && std::fwrite(counts.data(), sizeof(uint32_t), counts.size(), f) == counts.size();
+        ok = (std::fclose(f) == 0) && ok;
+
+        std::remove(path.c_str()); // rename() won't replace an existing file on Windows
+        if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+            std::cerr << "Could not write checkpoint " << path << '\n';
+            return false;
+        }
+        return true;
+    }
+
+    // Replaces the contents with the checkpoint if it exists and was made for the same image size and frame
+    bool load(const std::string& path, int frame) {
+        FILE* f = std::fopen(path.c_str(), "rb");
+        if (!f) {
+            return false;
+        }
+        char magic[4];
+        int32_t header[4];
+        bool ok = std::fread(magic, 1, 4, f) == 4 && std::memcmp(magic, "RTCK", 4) == 0
+               && std::fread(header, sizeof header, 1, f) == 1
+               && header[0] == checkpoint_version && header[1] == w && header[2] == h && header[3] == frame;
+
+        std::vector<double> new_sums(sums.size());
+        std::vector<double> new_sq_sums(sq_sums.size());
+        std::vector<uint32_t> new_counts(counts.size());
+        ok = ok && std::fread(new_sums.data(), sizeof(double), new_sums.size(), f) == new_sums.size()
+                && std::fread(new_sq_sums.data(), sizeof(double), new_sq_sums.size(), f) == new_sq_sums.size()
+                && std::fread(new_counts.data(), sizeof(uint32_t), new_counts.size(), f) == new_counts.size();
+        std::fclose(f);
+
+        if (!ok) {
+            std::cerr << "Ignoring checkpoint " << path << ", it is unreadable or for a different image\n";
+            return false;
+        }
+        sums.swap(new_sums);
+        sq_sums.swap(new_sq_sums);
+        counts.swap(new_counts);
+        return true;
+    }
+
+private:
+    static const int32_t checkpoint_version = 2;
+
+    int w = 0;
+    int h = 0;
+    std::vector<double> sums;
+    std::vector<double> sq_sums;
+    std::vector<uint32_t> counts;
+};
+
+#endif
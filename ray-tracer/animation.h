@@ -0,0 +1,100 @@
+#pragma once
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "camera.h"
+#include "rtweekend.h"
+
+// A value keyed at some frames: linear in between, held before the first key and after the last.
+template <typename T>
+class track {
+public:
+    void add(int frame, const T& value) { // Keys can come in any order, a second key on a frame replaces the first
+        auto at = std::lower_bound(keys.begin(), keys.end(), frame,
+            [](const std::pair<int, T>& key, int f) { return key.first < f; });
+        if (at != keys.end() && at->first == frame) { at->second = value; }
+        else { keys.insert(at, { frame, value }); }
+    }
+
+    bool empty() const { return keys.empty(); }
+
+    T at(int frame, const T& unkeyed) const {
+        if (keys.empty()) { return unkeyed; }
+        if (frame <= keys.front().first) { return keys.front().second; }
+        if (frame >= keys.back().first) { return keys.back().second; }
+        auto next = std::upper_bound(keys.begin(), keys.end(), frame,
+            [](int f, const std::pair<int, T>& key) { return f < key.first; });
+        auto prev = next - 1;
+        double t = double(frame - prev->first) / (next->first - prev->first);
+        return prev->second + (next->second - prev->second) * t;
+    }
+
+private:
+    std::vector<std::pair<int, T>> keys;
+};
+
+// Keyed camera fields, the rest of the camera stays as set
+struct camera_tracks {
+    track<vec3> lookfrom, lookat, viewup;
+    track<double> vfov, focus_dist, defocus_angle;
+
+    bool empty() const {
+        return lookfrom.empty() && lookat.empty() && viewup.empty() && vfov.empty() && focus_dist.empty()
+               && defocus_angle.empty();
+    }
+
+    void apply(camera& cam, int frame) const {
+        cam.lookfrom = lookfrom.at(frame, cam.lookfrom);
+        cam.lookat = lookat.at(frame, cam.lookat);
+        cam.viewup = viewup.at(frame, cam.viewup);
+        cam.vfov = vfov.at(frame, cam.vfov);
+        cam.focus_dist = focus_dist.at(frame, cam.focus_dist);
+        cam.defocus_angle = defocus_angle.at(frame, cam.defocus_angle);
+    }
+};
+
+// Moves the objects attached to it: scaled, then turned about the y axis (degrees, counterclockwise seen from
+// above), then translated, all about the world origin
+struct object_transform {
+    track<double> scale;
+    track<double> rotate_y;
+    track<vec3> translate;
+
+    point3 apply(const point3& p, int frame) const {
+        double s = scale.at(frame, 1.0);
+        double theta = degrees_to_radians(rotate_y.at(frame, 0.0));
+        double c = std::cos(theta), sn = std::sin(theta);
+        point3 q = s * p;
+        return point3(c * q.x() + sn * q.z(), q.y(), -sn * q.x() + c * q.z()) + translate.at(frame, vec3(0, 0, 0));
+    }
+
+    double scale_at(int frame) const { return scale.at(frame, 1.0); }
+};
+
+// Output path of one frame of a sequence: a printf style %d or %04d in the pattern becomes the frame number
+// ("turntable/%04d.png"), without one the number goes in front of the extension ("out.png" -> "out_0001.png").
+inline std::string frame_path(const std::string& pattern, int frame) {
+    char number[32];
+    size_t percent = pattern.find('%');
+    size_t d = (percent == std::string::npos) ? percent : pattern.find_first_not_of("0123456789", percent + 1);
+    if (d == std::string::npos || pattern[d] != 'd') {
+        std::snprintf(number, sizeof number, "_%04d", frame);
+        size_t dot = pattern.rfind('.');
+        size_t slash = pattern.find_last_of("/\\");
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) { return pattern + number; }
+        return pattern.substr(0, dot) + number + pattern.substr(dot);
+    }
+    int width = std::atoi(pattern.c_str() + percent + 1);
+    std::snprintf(number, sizeof number, "%0*d", width, frame);
+    return pattern.substr(0, percent) + number + pattern.substr(d + 1);
+}
+
+#endif
@@ -0,0 +1,139 @@
+#pragma once
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "hittable.h"
+#include "rtweekend.h"
+
+// Bump allocator for everything a scene is made of.
+// Objects are constructed back to back in big blocks, handed out as plain pointers and all destroyed together when
+// the arena goes away (or release() is called). One allocation per block instead of one per object, no control
+// blocks, no per object malloc header, and objects built one after another sit next to each other in memory.
+class arena {
+public:
+    explicit arena(size_t block_size = 1 << 20) : block_size(block_size) {}
+    ~arena() { release(); }
+
+    arena(const arena&) = delete;
+    arena& operator=(const arena&) = delete;
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        T* obj = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value) {
+            // Objects of one type made in a row are one run, so a million spheres cost one entry here
+            auto* first = reinterpret_cast<char*>(obj);
+            if (!runs.empty() && runs.back().destroy == &destroy_run<T>
+                && runs.back().first + runs.back().count * sizeof(T) == first) {
+                runs.back().count++;
+            }
+            else {
+                runs.push_back({ &destroy_run<T>, first, 1 });
+            }
+        }
+        return obj;
+    }
+
+    void* allocate(size_t size, size_t align) {
+        uintptr_t at = (current + align - 1) & ~uintptr_t(align - 1);
+        if (blocks.empty() || at + size > end) {
+            size_t bytes = std::max(block_size, size + align); // Oversized objects get a block to themselves
+            blocks.emplace_back(new char[bytes]);
+            reserved += bytes;
+            current = reinterpret_cast<uintptr_t>(blocks.back().get());
+            end = current + bytes;
+            at = (current + align - 1) & ~uintptr_t(align - 1);
+        }
+        used += (at + size) - current;
+        current = at + size;
+        return reinterpret_cast<void*>(at);
+    }
+
+    // Destroys every object, newest first, and frees the blocks. Every pointer handed out is dangling after this.
+    void release() {
+        for (auto run = runs.rbegin(); run != runs.rend(); ++run) {
+            run->destroy(run->first, run->count);
+        }
+        runs.clear();
+        blocks.clear();
+        current = end = 0;
+        used = reserved = 0;
+    }
+
+    size_t bytes_used() const { return used; } // Including alignment padding
+    size_t bytes_reserved() const { return reserved; }
+
+private:
+    struct destructor_run {
+        void (*destroy)(char* first, size_t count);
+        char* first;
+        size_t count;
+    };
+
+    template <typename T>
+    static void destroy_run(char* first, size_t count) {
+        T* objs = reinterpret_cast<T*>(first);
+        for (size_t i = count; i > 0; i--) {
+            objs[i - 1].~T();
+        }
+    }
+
+    size_t block_size;
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::vector<destructor_run> runs;
+    uintptr_t current = 0; // Next free byte of the newest block
+    uintptr_t end = 0;
+    size_t used = 0;
+    size_t reserved = 0;
+};
+
+// hittable_list for objects that live in an arena: a vector of plain pointers, so nothing is owned or reference
+// counted and the vector itself is half the size.
+class arena_list : public hittable {
+public:
+    std::vector<const hittable*> objects;
+
+    void reserve(size_t n) { objects.reserve(n); }
+
+    void add(const hittable* object) {
+        objects.push_back(object);
+        bbox = aabb(bbox, object->bounding_box());
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        bool hit_anything = false;
+        auto closest_so_far = ray_t.max;
+
+        for (const hittable* object : objects) {
+            if (object->hit(r, interval(ray_t.min, closest_so_far), rec)) {
+                hit_anything = true;
+                closest_so_far = rec.t;
+            }
+        }
+
+        return hit_anything;
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        for (const hittable* object : objects) {
+            if (object->occluded(r, ray_t)) { return true; }
+        }
+        return false;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+private:
+    aabb bbox;
+};
+
+#endif
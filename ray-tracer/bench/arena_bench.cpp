@@ -0,0 +1,156 @@
+// Memory and build time of a million sphere scene built the old way (a make_shared per sphere in a hittable_list)
+// against the scene arena (spheres constructed back to back, arena_list of plain pointers), each wrapped in a
+// flat_bvh, plus trace throughput to show the layout doesn't cost anything at render time.
+// "kept" is the heap the finished tree and its spheres hold, "peak" the most the build had at once (list growth
+// included). Both are 0 on platforms where the bench can't ask the allocator for block sizes.
+// Usage: arena_bench [spheres]   (default 1000000)
+
+#include "../rtweekend.h"
+
+#include "../arena.h"
+#include "../flat_bvh.h"
+#include "../hittable_list.h"
+#include "../material.h"
+#include "../sphere.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <vector>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#define heap_block_size(p) (malloc_usable_size(p) + sizeof(size_t)) // Chunk plus its size header
+#elif defined(_MSC_VER)
+#include <malloc.h>
+#define heap_block_size(p) _msize(p)
+#else
+#define heap_block_size(p) size_t(0)
+#endif
+
+// Every allocation the program makes goes through here, so each build can be charged for the number of allocations
+// and for the heap memory they really take: rounded up blocks and allocator headers included.
+static size_t allocations = 0;
+static size_t heap_live = 0;
+static size_t heap_peak = 0;
+
+void* operator new(size_t size) {
+    void* p = std::malloc(size ? size : 1);
+    if (!p) { throw std::bad_alloc(); }
+    allocations++;
+    heap_live += heap_block_size(p);
+    heap_peak = std::max(heap_peak, heap_live);
+    return p;
+}
+
+static void counted_free(void* p) {
+    if (p) { heap_live -= heap_block_size(p); }
+    std::free(p);
+}
+
+void operator delete(void* p) noexcept { counted_free(p); }
+void operator delete(void* p, size_t) noexcept { counted_free(p); }
+
+using bench_clock = std::chrono::steady_clock;
+
+static double seconds_since(bench_clock::time_point start) {
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+struct build_report {
+    const char* name;
+    double objects_ms; // Creating the spheres and the list
+    double tree_ms; // flat_bvh over them
+    size_t allocations;
+    size_t kept;
+    size_t peak;
+    double rays_per_sec;
+};
+
+static double trace(const hittable& world, const std::vector<ray>& rays) {
+    auto start = bench_clock::now();
+    int hits = 0;
+    for (const auto& r : rays) {
+        hit_record rec;
+        hits += world.hit(r, interval(0.001, infinity), rec);
+    }
+    volatile int sink = hits;
+    (void)sink;
+    return rays.size() / seconds_since(start);
+}
+
+static void print(const build_report& r, int n) {
+    std::printf("%-12s %10.1fms %10.1fms %12zu %12.1f %12.1f %12.0f\n", r.name, r.objects_ms, r.tree_ms, r.allocations,
+        double(r.kept) / n, double(r.peak) / n, r.rays_per_sec);
+}
+
+int main(int argc, char** argv) {
+    int n = (argc > 1) ? std::atoi(argv[1]) : 1000000;
+
+    pcg32 rng(n, 1);
+    std::vector<point3> centers;
+    centers.reserve(n);
+    for (int i = 0; i < n; i++) { centers.push_back(vec3::random(-1, 1, rng)); }
+    double radius = 0.5 / std::cbrt(double(n));
+
+    std::vector<ray> rays;
+    for (int i = 0; i < 200000; i++) {
+        point3 origin = 3.0 * random_unit_vector(rng);
+        rays.push_back(ray(origin, vec3::random(-1, 1, rng) - origin));
+    }
+
+    std::printf("%d spheres, sizeof(sphere) = %zu\n", n, sizeof(sphere));
+    std::printf("%-12s %12s %12s %12s %12s %12s %12s\n", "layout", "objects", "tree", "allocations",
+        "kept/prim", "peak/prim", "rays/s");
+
+    {
+        heap_peak = heap_live;
+        size_t a0 = allocations, h0 = heap_live;
+        build_report r = {};
+        r.name = "make_shared";
+        auto start = bench_clock::now();
+        material_registry materials;
+        auto mat = materials.add(lambertian(color(0.5, 0.5, 0.5)));
+        hittable_list list;
+        for (const auto& c : centers) { list.add(make_shared<sphere>(c, radius, mat)); }
+        r.objects_ms = 1000 * seconds_since(start);
+
+        start = bench_clock::now();
+        flat_bvh world(std::move(list)); // The tree takes over the list's references
+        r.tree_ms = 1000 * seconds_since(start);
+
+        r.allocations = allocations - a0;
+        r.kept = heap_live - h0;
+        r.peak = heap_peak - h0;
+        r.rays_per_sec = trace(world, rays);
+        print(r, n);
+    }
+
+    {
+        heap_peak = heap_live;
+        size_t a0 = allocations, h0 = heap_live;
+        build_report r = {};
+        r.name = "arena";
+        auto start = bench_clock::now();
+        arena storage;
+        auto mat = storage.make<material>(lambertian(color(0.5, 0.5, 0.5)));
+        arena_list list;
+        list.reserve(centers.size());
+        for (const auto& c : centers) { list.add(storage.make<sphere>(c, radius, mat)); }
+        r.objects_ms = 1000 * seconds_since(start);
+
+        start = bench_clock::now();
+        flat_bvh world(list);
+        list.objects = std::vector<const hittable*>(); // Only the tree's copy is needed from here on
+        r.tree_ms = 1000 * seconds_since(start);
+
+        r.allocations = allocations - a0;
+        r.kept = heap_live - h0;
+        r.peak = heap_peak - h0;
+        r.rays_per_sec = trace(world, rays);
+        print(r, n);
+    }
+}
@@ -0,0 +1,171 @@
+#pragma once
+#ifndef BENCH_SCENES_H
+#define BENCH_SCENES_H
+
+// The fixed scenes the benchmarks render, built as scene records so they go through the same build as a loaded file.
+//   main            the scene from main.cpp
+//   random_spheres  a field of ~10k small spheres of every material, many primitives per ray
+//   deep_glass      nested glass shells in front of a mirror, long dielectric paths
+//   lit_room        a closed room of quads with the sky off, lit by a ceiling panel and a small bright sphere
+
+#include "../scene.h"
+
+inline uint32_t add_material(scene& s, material_kind kind, double a, double b = 0, double c = 0, double d = 0) {
+    scene_material m = {};
+    m.kind = uint32_t(kind);
+    m.params[0] = a; m.params[1] = b; m.params[2] = c; m.params[3] = d;
+    s.material_records.push_back(m);
+    return uint32_t(s.material_records.size() - 1);
+}
+
+inline void add_sphere(scene& s, const point3& center, double radius, uint32_t mat) {
+    scene_sphere sp = {};
+    sp.center[0] = center.x(); sp.center[1] = center.y(); sp.center[2] = center.z();
+    sp.radius = radius;
+    sp.material = mat;
+    s.sphere_records.push_back(sp);
+}
+
+inline void add_quad(scene& s, const point3& corner, const vec3& u, const vec3& v, uint32_t mat) {
+    scene_quad q = {};
+    for (int k = 0; k < 3; k++) {
+        q.corner[k] = corner[k];
+        q.u[k] = u[k];
+        q.v[k] = v[k];
+    }
+    q.material = mat;
+    s.quad_records.push_back(q);
+}
+
+inline void main_scene(scene& s) {
+    auto ground = add_material(s, material_kind::lambertian, 0.8, 0.8, 0.0);
+    auto center = add_material(s, material_kind::lambertian, 0.1, 0.2, 0.5);
+    auto left = add_material(s, material_kind::dielectric, 1.00, 1.50);
+    auto bubble = add_material(s, material_kind::dielectric, 1.50, 1.00);
+    auto right = add_material(s, material_kind::metal, 0.8, 0.6, 0.2, 1.0);
+
+    add_sphere(s, point3(0.0, -100.5, -1.0), 100.0, ground);
+    add_sphere(s, point3(0.0, 0.0, -1.2), 0.5, center);
+    add_sphere(s, point3(-1.0, 0.0, -1.0), 0.5, left);
+    add_sphere(s, point3(-1.0, 0.0, -1.0), 0.4, bubble);
+    add_sphere(s, point3(1.0, 0.0, -1.0), 0.5, right);
+
+    s.cam.aspect_ratio = 16.0 / 9.0;
+    s.cam.image_width = 400;
+    s.cam.samples_per_pix = 32;
+    s.cam.max_depth = 50;
+    s.cam.vfov = 20;
+    s.cam.lookfrom = point3(-2, 2, 1);
+    s.cam.lookat = point3(0, 0, -1);
+    s.cam.defocus_angle = 20.0;
+    s.cam.focus_dist = 3.4;
+}
+
+inline void random_spheres_scene(scene& s) {
+    pcg32 rng(42, 0); // Same spheres every run
+    add_sphere(s, point3(0, -1000, 0), 1000, add_material(s, material_kind::lambertian, 0.5, 0.5, 0.5));
+
+    for (int a = -50; a < 50; a++) {
+        for (int b = -50; b < 50; b++) {
+            double choose = random_double(rng);
+            point3 center(a + 0.9 * random_double(rng), 0.2, b + 0.9 * random_double(rng));
+            if ((center - point3(4, 0.2, 0)).length() <= 0.9) { continue; }
+
+            uint32_t mat;
+            if (choose < 0.8) {
+                color albedo = color::random(rng) * color::random(rng);
+                mat = add_material(s, material_kind::lambertian, albedo.x(), albedo.y(), albedo.z());
+            }
+            else if (choose < 0.95) {
+                color albedo = color::random(0.5, 1, rng);
+                mat = add_material(s, material_kind::metal, albedo.x(), albedo.y(), albedo.z(), random_double(0, 0.5, rng));
+            }
+            else {
+                mat = add_material(s, material_kind::dielectric, 1.0, 1.5);
+            }
+            add_sphere(s, center, 0.2, mat);
+        }
+    }
+    add_sphere(s, point3(0, 1, 0), 1.0, add_material(s, material_kind::dielectric, 1.0, 1.5));
+    add_sphere(s, point3(-4, 1, 0), 1.0, add_material(s, material_kind::lambertian, 0.4, 0.2, 0.1));
+    add_sphere(s, point3(4, 1, 0), 1.0, add_material(s, material_kind::metal, 0.7, 0.6, 0.5, 0.0));
+
+    s.cam.aspect_ratio = 16.0 / 9.0;
+    s.cam.image_width = 400;
+    s.cam.samples_per_pix = 16;
+    s.cam.max_depth = 50;
+    s.cam.vfov = 20;
+    s.cam.lookfrom = point3(13, 2, 3);
+    s.cam.lookat = point3(0, 0, 0);
+    s.cam.defocus_angle = 0.6;
+    s.cam.focus_dist = 10.0;
+}
+
+inline void deep_glass_scene(scene& s) {
+    auto glass = add_material(s, material_kind::dielectric, 1.0, 1.5);
+    auto bubble = add_material(s, material_kind::dielectric, 1.5, 1.0);
+    auto mirror = add_material(s, material_kind::metal, 0.9, 0.9, 0.9, 0.0);
+    auto ground = add_material(s, material_kind::lambertian, 0.5, 0.5, 0.5);
+
+    add_sphere(s, point3(0, -1000.5, 0), 1000, ground);
+    add_sphere(s, point3(0, 2, -8), 5, mirror);
+    for (int row = 0; row < 4; row++) {
+        for (int col = 0; col < 4; col++) {
+            point3 center(-1.5 + col, 0, -row);
+            for (int shell = 0; shell < 4; shell++) { // Glass, air, glass, air...
+                add_sphere(s, center, 0.48 - 0.1 * shell, (shell % 2 == 0) ? glass : bubble);
+            }
+        }
+    }
+
+    s.cam.aspect_ratio = 16.0 / 9.0;
+    s.cam.image_width = 400;
+    s.cam.samples_per_pix = 32;
+    s.cam.max_depth = 64;
+    s.cam.vfov = 40;
+    s.cam.lookfrom = point3(0, 1.5, 4);
+    s.cam.lookat = point3(0, 0, -1.5);
+}
+
+inline void lit_room_scene(scene& s) {
+    auto white = add_material(s, material_kind::lambertian, 0.73, 0.73, 0.73);
+    auto red = add_material(s, material_kind::lambertian, 0.65, 0.05, 0.05);
+    auto green = add_material(s, material_kind::lambertian, 0.12, 0.45, 0.15);
+    auto blue = add_material(s, material_kind::lambertian, 0.1, 0.2, 0.5);
+    auto glass = add_material(s, material_kind::dielectric, 1.0, 1.5);
+    auto panel = add_material(s, material_kind::diffuse_light, 6, 6, 5);
+    auto bulb = add_material(s, material_kind::diffuse_light, 40, 30, 20);
+
+    add_quad(s, point3(-2, 0, -2), vec3(0, 0, 8), vec3(4, 0, 0), white); // Floor
+    add_quad(s, point3(-2, 2.5, -2), vec3(4, 0, 0), vec3(0, 0, 8), white); // Ceiling
+    add_quad(s, point3(-2, 0, -2), vec3(0, 2.5, 0), vec3(0, 0, 8), red);
+    add_quad(s, point3(2, 0, -2), vec3(0, 0, 8), vec3(0, 2.5, 0), green);
+    add_quad(s, point3(-2, 0, -2), vec3(4, 0, 0), vec3(0, 2.5, 0), white); // Back
+    add_quad(s, point3(-0.5, 2.49, -0.5), vec3(1, 0, 0), vec3(0, 0, 1), panel); // Facing down
+    add_sphere(s, point3(-0.8, 0.5, -0.5), 0.5, blue);
+    add_sphere(s, point3(0.7, 0.4, 0.3), 0.4, glass);
+    add_sphere(s, point3(1.2, 1.6, -1.0), 0.08, bulb);
+
+    s.cam.aspect_ratio = 16.0 / 9.0;
+    s.cam.image_width = 400;
+    s.cam.samples_per_pix = 16;
+    s.cam.max_depth = 10;
+    s.cam.sky_brightness = 0;
+    s.cam.vfov = 40;
+    s.cam.lookfrom = point3(0, 1, 5);
+    s.cam.lookat = point3(0, 0.6, 0);
+}
+
+struct bench_scene {
+    const char* name;
+    void (*make)(scene&);
+};
+
+const bench_scene bench_scenes[] = {
+    { "main", main_scene },
+    { "random_spheres", random_spheres_scene },
+    { "deep_glass", deep_glass_scene },
+    { "lit_room", lit_room_scene },
+};
+
+#endif
@@ -0,0 +1,111 @@
+// Closest hit throughput of the linear hittable_list, the recursive bvh_node and the flattened flat_bvh
+// on clouds of random spheres. Exits 1 if they disagree on any ray's closest hit.
+// Usage: bvh_bench [max_spheres]   (default 1000000)
+
+#include "../rtweekend.h"
+
+#include "../bvh.h"
+#include "../flat_bvh.h"
+#include "../hittable_list.h"
+#include "../material.h"
+#include "../sphere.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using bench_clock = std::chrono::steady_clock;
+
+static double seconds_since(bench_clock::time_point start) {
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+static hittable_list sphere_cloud(int n, pcg32& rng) {
+    // Spheres in the [-1,1] cube, shrinking with n so the cloud stays about equally dense
+    hittable_list world;
+    static material_registry materials;
+    auto mat = materials.add(lambertian(color(0.5, 0.5, 0.5)));
+    double radius = 0.5 / std::cbrt(double(n));
+    for (int i = 0; i < n; i++) {
+        world.add(make_shared<sphere>(vec3::random(-1, 1, rng), radius, mat));
+    }
+    return world;
+}
+
+static std::vector<ray> ray_set(int n, pcg32& rng) {
+    // Rays from a shell around the cloud aimed at random points inside it
+    std::vector<ray> rays;
+    for (int i = 0; i < n; i++) {
+        point3 origin = 3.0 * random_unit_vector(rng);
+        point3 target = vec3::random(-1, 1, rng);
+        rays.push_back(ray(origin, target - origin));
+    }
+    return rays;
+}
+
+struct trace_result {
+    double rays_per_sec;
+    int traced;
+    int hits;
+};
+
+static trace_result trace(const hittable& world, const std::vector<ray>& rays, std::vector<double>& t_out) {
+    // Traces until every ray is done or a second has passed, so the linear list at 1M spheres stays bearable
+    auto start = bench_clock::now();
+    trace_result res = { 0, 0, 0 };
+    for (const auto& r : rays) {
+        hit_record rec;
+        bool hit = world.hit(r, interval(0.001, infinity), rec);
+        t_out.push_back(hit ? rec.t : -1);
+        res.hits += hit;
+        res.traced++;
+        if ((res.traced & 63) == 0 && seconds_since(start) > 1.0) {
+            break;
+        }
+    }
+    res.rays_per_sec = res.traced / seconds_since(start);
+    return res;
+}
+
+int main(int argc, char** argv) {
+    int max_spheres = (argc > 1) ? std::atoi(argv[1]) : 1000000;
+    const int counts[] = { 10, 1000, 100000, 1000000 };
+
+    std::printf("%10s %12s %12s %14s %14s %14s %9s %9s %8s\n", "spheres", "bvh build", "flat build",
+        "list rays/s", "bvh rays/s", "flat rays/s", "bvh/list", "flat/bvh", "agree");
+    bool all_agree = true;
+
+    for (int n : counts) {
+        if (n > max_spheres) { break; }
+
+        pcg32 rng(n, 1);
+        hittable_list world = sphere_cloud(n, rng);
+        std::vector<ray> rays = ray_set(200000, rng);
+
+        auto build_start = bench_clock::now();
+        bvh_node bvh(world);
+        double bvh_build_ms = 1000 * seconds_since(build_start);
+
+        build_start = bench_clock::now();
+        flat_bvh flat(world);
+        double flat_build_ms = 1000 * seconds_since(build_start);
+
+        std::vector<double> list_t, bvh_t, flat_t;
+        trace_result list_res = trace(world, rays, list_t);
+        trace_result bvh_res = trace(bvh, rays, bvh_t);
+        trace_result flat_res = trace(flat, rays, flat_t);
+
+        // All three must find the same closest hit for every ray they all got through
+        bool agree = true;
+        for (int i = 0; i < list_res.traced && i < bvh_res.traced && i < flat_res.traced; i++) {
+            agree = agree && (list_t[i] == bvh_t[i]) && (list_t[i] == flat_t[i]);
+        }
+        all_agree = all_agree && agree;
+
+        std::printf("%10d %10.1fms %10.1fms %14.0f %14.0f %14.0f %8.1fx %8.2fx %8s\n", n, bvh_build_ms, flat_build_ms,
+            list_res.rays_per_sec, bvh_res.rays_per_sec, flat_res.rays_per_sec,
+            bvh_res.rays_per_sec / list_res.rays_per_sec, flat_res.rays_per_sec / bvh_res.rays_per_sec, agree ? "yes" : "NO");
+    }
+    return all_agree ? 0 : 1;
+}
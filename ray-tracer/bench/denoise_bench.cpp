@@ -0,0 +1,132 @@
+// Denoising (denoise.h): error and time of denoised low sample renders against plain renders with many more samples.
+// For every scene of bench_scenes.h a reference is rendered with --reference-spp samples per pixel (on another frame,
+// so its noise is its own), then the scene at 1, 2, 4 .. --max-spp samples with the denoiser on, and once more at
+// --compare-spp without. The table has the RMSE against the reference of each image before and after denoising and
+// the seconds spent rendering, tracing AOVs and denoising. The RMSE is of colors clamped to 1, as an image shows
+// them: otherwise the few pixels on the edge of a small light, many times brighter than white, decide it alone.
+// Last, the denoiser alone on the --max-spp render of the last scene with 1, 2, 4 .. --threads threads.
+// Usage: denoise_bench [--scene name] [--width n] [--max-spp n] [--compare-spp n] [--reference-spp n] [--threads n]
+//        (defaults: every scene, 200 pixels wide, 16, 256, 2048, all cores)
+
+#include "../rtweekend.h"
+
+#include "../camera.h"
+#include "../denoise.h"
+#include "../scene.h"
+#include "bench_scenes.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+using bench_clock = std::chrono::steady_clock;
+
+static double seconds_since(bench_clock::time_point start) {
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+struct bench_render {
+    framebuffer noisy, denoised;
+    accumulation_buffer samples;
+    aov_buffers aovs;
+    render_stats stats;
+};
+
+static bench_render render(const bench_scene& bs, int spp, int frame, bool denoise, int width, int threads) {
+    scene s;
+    bs.make(s);
+    s.cam.samples_per_pix = spp;
+    s.cam.frame = frame;
+    s.cam.image_width = width;
+    s.cam.thread_count = threads;
+    s.cam.integrator = integrator_type::iterative;
+    s.cam.denoise = denoise;
+    s.cam.output_path.clear();
+    const hittable& world = s.build();
+    std::clog.setstate(std::ios::failbit); // The renders' progress lines would drown the table
+    s.cam.render(world);
+    std::clog.clear();
+
+    bench_render result;
+    result.samples = s.cam.samples();
+    result.noisy = result.samples.resolve();
+    result.denoised = s.cam.image();
+    result.aovs = s.cam.outputs();
+    result.stats = s.cam.statistics();
+    return result;
+}
+
+static double rmse(const framebuffer& a, const framebuffer& b) {
+    double sum = 0;
+    for (int j = 0; j < a.height(); j++) {
+        for (int i = 0; i < a.width(); i++) {
+            color ca = a.get(i, j), cb = b.get(i, j);
+            for (int c = 0; c < 3; c++) {
+                double d = std::fmin(ca[c], 1.0) - std::fmin(cb[c], 1.0);
+                sum += d * d;
+            }
+        }
+    }
+    return std::sqrt(sum / (3.0 * a.width() * a.height()));
+}
+
+int main(int argc, char** argv) {
+    std::string only;
+    int width = 200;
+    int max_spp = 16;
+    int compare_spp = 256;
+    int reference_spp = 2048;
+    int threads = 0;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        bool has_value = a + 1 < argc;
+        if (arg == "--scene" && has_value) { only = argv[++a]; }
+        else if (arg == "--width" && has_value) { width = std::atoi(argv[++a]); }
+        else if (arg == "--max-spp" && has_value) { max_spp = std::atoi(argv[++a]); }
+        else if (arg == "--compare-spp" && has_value) { compare_spp = std::atoi(argv[++a]); }
+        else if (arg == "--reference-spp" && has_value) { reference_spp = std::atoi(argv[++a]); }
+        else if (arg == "--threads" && has_value) { threads = std::atoi(argv[++a]); }
+        else {
+            std::fprintf(stderr, "Usage: denoise_bench [--scene name] [--width n] [--max-spp n] [--compare-spp n] "
+                                 "[--reference-spp n] [--threads n]\n");
+            return 2;
+        }
+    }
+    threads = work_stealing_pool::resolve_thread_count(threads);
+
+    bench_render last;
+    for (const auto& bs : bench_scenes) {
+        if (!only.empty() && only != bs.name) { continue; }
+        bench_render reference = render(bs, reference_spp, 1, false, width, threads);
+        std::printf("%s, RMSE against %d samples per pixel (%.1f s)\n", bs.name, reference_spp,
+            reference.stats.render_seconds);
+        std::printf("%6s %10s %10s %10s %10s %10s\n", "spp", "noisy", "denoised", "render s", "aov s", "denoise s");
+        for (int spp = 1; spp <= max_spp; spp *= 2) {
+            last = render(bs, spp, 0, true, width, threads);
+            std::printf("%6d %10.4f %10.4f %10.3f %10.3f %10.3f\n", spp, rmse(last.noisy, reference.noisy),
+                rmse(last.denoised, reference.noisy), last.stats.render_seconds, last.stats.aov_seconds,
+                last.stats.denoise_seconds);
+        }
+        bench_render plain = render(bs, compare_spp, 0, false, width, threads);
+        std::printf("%6d %10.4f %10s %10.3f\n\n", compare_spp, rmse(plain.noisy, reference.noisy), "-",
+            plain.stats.render_seconds);
+    }
+    if (last.aovs.empty()) { return 0; }
+
+    std::printf("Denoiser alone, %dx%d pixels\n%8s %10s %10s\n", last.noisy.width(), last.noisy.height(), "threads",
+                "seconds", "speedup");
+    double one_thread = 0;
+    for (int t = 1; t <= threads; t *= 2) {
+        denoise_settings settings;
+        settings.thread_count = t;
+        atrous_denoiser denoiser(settings);
+        auto start = bench_clock::now();
+        const int repeats = 5;
+        for (int r = 0; r < repeats; r++) { denoiser.denoise(last.samples, last.aovs); }
+        double seconds = seconds_since(start) / repeats;
+        if (t == 1) { one_thread = seconds; }
+        std::printf("%8d %10.4f %9.2fx\n", t, seconds, one_thread / seconds);
+    }
+}
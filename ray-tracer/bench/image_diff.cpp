@@ -0,0 +1,47 @@
+// Compares two PFM renders of the same scene, e.g. the precision_bench variants.
+// Prints the root mean square and largest per channel difference of the linear values and the PSNR against a peak
+// of 1 (white), and exits 1 when the RMSE is above the threshold (default 0: the images have to match exactly).
+// Usage: image_diff a.pfm b.pfm [--max-rmse x]
+
+#include "../rtweekend.h"
+
+#include "../image_io.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+int main(int argc, char** argv) {
+    if (argc != 3 && !(argc == 5 && std::string(argv[3]) == "--max-rmse")) {
+        std::fprintf(stderr, "Usage: image_diff a.pfm b.pfm [--max-rmse x]\n");
+        return 2;
+    }
+    double max_rmse = (argc == 5) ? std::atof(argv[4]) : 0;
+
+    framebuffer a, b;
+    if (!read_pfm(argv[1], a) || !read_pfm(argv[2], b)) {
+        return 2;
+    }
+    if (a.width() != b.width() || a.height() != b.height()) {
+        std::fprintf(stderr, "Sizes differ: %dx%d and %dx%d\n", a.width(), a.height(), b.width(), b.height());
+        return 2;
+    }
+
+    size_t n = size_t(a.width()) * a.height() * 3;
+    double sum_sq = 0;
+    double max_diff = 0;
+    size_t differing = 0;
+    for (size_t k = 0; k < n; k++) {
+        double d = std::fabs(double(a.data()[k]) - double(b.data()[k]));
+        sum_sq += d * d;
+        max_diff = std::fmax(max_diff, d);
+        differing += (d != 0);
+    }
+    double rmse = std::sqrt(sum_sq / n);
+    double psnr = (rmse > 0) ? 20 * std::log10(1 / rmse) : infinity;
+
+    std::printf("%s vs %s: rmse %.6f, max %.6f, psnr %.2f dB, %zu of %zu values differ\n", argv[1], argv[2], rmse,
+        max_diff, psnr, differing, n);
+    return (rmse > max_rmse) ? 1 : 0;
+}
@@ -0,0 +1,169 @@
+// Memory, build time and ray throughput of instancing against copying. A grid of n tori, each turned and scaled at
+// random, is built twice: as n copies of the mesh with their vertices moved into place, and as n instances of one
+// mesh. Both get a flat_bvh on top and are traced with the same rays; the hits should agree up to the float
+// rounding of the copied vertices.
+// Usage: instance_bench [--segments n] [--rays n] [--max n] [--max-copies n]
+//        (defaults: 64, 4096 triangles a torus; 200000; 100000; 1000)
+
+#include "../rtweekend.h"
+
+#include "../flat_bvh.h"
+#include "../instance.h"
+#include "../material.h"
+#include "../triangle_mesh.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+using bench_clock = std::chrono::steady_clock;
+
+static double seconds_since(bench_clock::time_point start) {
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+// Torus around the y axis, radius 0.35 to the middle of its tube of radius 0.12, moved by to_world
+static void add_torus(triangle_mesh& mesh, int segments, const affine& to_world) {
+    int sides = segments / 2;
+    for (int i = 0; i < segments; i++) {
+        double s, c;
+        sin_cos(2 * pi * i / segments, s, c);
+        for (int j = 0; j < sides; j++) {
+            double sj, cj;
+            sin_cos(2 * pi * j / sides, sj, cj);
+            double r = 0.35 + 0.12 * cj;
+            mesh.add_vertex(to_world.point(point3(r * c, 0.12 * sj, r * s)));
+        }
+    }
+    auto v = [&](int i, int j) { return uint32_t((i % segments) * sides + (j % sides)); };
+    for (int i = 0; i < segments; i++) {
+        for (int j = 0; j < sides; j++) {
+            mesh.add_triangle(v(i, j), v(i + 1, j), v(i + 1, j + 1));
+            mesh.add_triangle(v(i, j), v(i + 1, j + 1), v(i, j + 1));
+        }
+    }
+    mesh.build();
+}
+
+struct placement_grid {
+    std::vector<affine> to_world;
+    double extent; // Of the grid in x and z, from the origin
+};
+
+static placement_grid place(int n, pcg32& rng) {
+    placement_grid grid;
+    int side = int(std::ceil(std::sqrt(double(n))));
+    double spacing = 1.5;
+    grid.extent = side * spacing / 2;
+    for (int k = 0; k < n; k++) {
+        vec3 at((k % side + 0.5) * spacing - grid.extent, 0, (k / side + 0.5) * spacing - grid.extent);
+        grid.to_world.push_back(affine::scale_rotate_translate(random_double(0.6, 1.2, rng), random_double(0, 360, rng), at));
+    }
+    return grid;
+}
+
+struct trace_result {
+    std::vector<double> t; // Of the closest hit, infinity for a miss
+    double seconds;
+};
+
+static trace_result trace(const hittable& world, const std::vector<ray>& rays) {
+    trace_result result;
+    result.t.reserve(rays.size());
+    auto start = bench_clock::now();
+    for (const auto& r : rays) {
+        hit_record rec;
+        result.t.push_back(world.hit(r, interval(0.001, infinity), rec) ? double(rec.t) : infinity);
+    }
+    result.seconds = seconds_since(start);
+    return result;
+}
+
+static void report(const char* name, size_t bytes, double build_seconds, const trace_result& traced) {
+    size_t hits = 0;
+    for (double t : traced.t) { hits += t < infinity; }
+    std::printf("  %-10s %9.2f MB %8.3f s build %6.2f M rays/s  %zu hits\n", name, bytes / 1e6, build_seconds,
+        traced.t.size() / traced.seconds / 1e6, hits);
+}
+
+int main(int argc, char** argv) {
+    int segments = 64;
+    int ray_count = 200000;
+    int max_count = 100000;
+    int max_copies = 1000;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        bool has_value = a + 1 < argc;
+        if (arg == "--segments" && has_value) { segments = std::max(4, std::atoi(argv[++a])); }
+        else if (arg == "--rays" && has_value) { ray_count = std::atoi(argv[++a]); }
+        else if (arg == "--max" && has_value) { max_count = std::atoi(argv[++a]); }
+        else if (arg == "--max-copies" && has_value) { max_copies = std::atoi(argv[++a]); }
+        else {
+            std::fprintf(stderr, "Usage: instance_bench [--segments n] [--rays n] [--max n] [--max-copies n]\n");
+            return 2;
+        }
+    }
+
+    static material_registry materials;
+    const material* mat = materials.add(lambertian(color(0.5, 0.5, 0.5)));
+    triangle_mesh shared(mat);
+    add_torus(shared, segments, affine::identity());
+    std::printf("torus of %zu triangles, %.2f MB\n", shared.triangle_count(), shared.bytes() / 1e6);
+
+    for (int n = 10; n <= max_count; n *= 10) {
+        pcg32 rng(23, uint64_t(n));
+        placement_grid grid = place(n, rng);
+
+        // From above and to the side of the grid, down at random points of it
+        std::vector<ray> rays;
+        for (int k = 0; k < ray_count; k++) {
+            point3 origin(random_double(-1, 1, rng) * grid.extent, grid.extent + 2, grid.extent + 2);
+            point3 target(random_double(-1, 1, rng) * grid.extent, 0, random_double(-1, 1, rng) * grid.extent);
+            rays.push_back(ray(origin, target - origin));
+        }
+        std::printf("%d tori, %.1f M triangles in the world\n", n, double(n) * shared.triangle_count() / 1e6);
+
+        auto start = bench_clock::now();
+        std::vector<instance> instances;
+        instances.reserve(size_t(n));
+        arena_list list;
+        list.reserve(size_t(n));
+        for (const auto& to_world : grid.to_world) {
+            instances.emplace_back(&shared, to_world);
+            list.add(&instances.back());
+        }
+        flat_bvh top(list);
+        double build_seconds = seconds_since(start);
+        size_t top_bytes = top.node_count() * sizeof(flat_bvh_node) + size_t(n) * sizeof(const hittable*);
+        trace_result instanced = trace(top, rays);
+        report("instances", shared.bytes() + size_t(n) * sizeof(instance) + top_bytes, build_seconds, instanced);
+
+        if (n > max_copies) { continue; }
+        start = bench_clock::now();
+        std::vector<std::unique_ptr<triangle_mesh>> copies;
+        arena_list copy_list;
+        for (const auto& to_world : grid.to_world) {
+            copies.emplace_back(new triangle_mesh(mat));
+            add_torus(*copies.back(), segments, to_world);
+            copy_list.add(copies.back().get());
+        }
+        flat_bvh copy_top(copy_list);
+        build_seconds = seconds_since(start);
+        size_t copy_bytes = top_bytes;
+        for (const auto& m : copies) { copy_bytes += sizeof(triangle_mesh) + m->bytes(); }
+        trace_result copied = trace(copy_top, rays);
+        report("copies", copy_bytes, build_seconds, copied);
+
+        size_t differ = 0;
+        double worst = 0;
+        for (size_t k = 0; k < rays.size(); k++) {
+            bool a = instanced.t[k] < infinity, b = copied.t[k] < infinity;
+            if (a != b) { differ++; }
+            else if (a) { worst = std::max(worst, std::fabs(instanced.t[k] - copied.t[k]) / copied.t[k]); }
+        }
+        std::printf("  %zu rays hit one and not the other, hit distances differ by up to %.1e relative\n", differ, worst);
+    }
+}
@@ -0,0 +1,168 @@
+// Loading, memory and ray throughput of triangle_mesh, and a check that its intersection test is watertight.
+// Writes a UV sphere of quads (pole caps as triangle fans) as an OBJ file, loads it back and traces rays from
+// inside it: through random directions, exactly through its vertices and exactly through the middle of its edges.
+// A closed mesh seen from inside can't be missed, so every miss is a ray that slipped between two triangles.
+// --obj loads a file of your own instead and traces rays at it from outside (there are no misses to count then).
+// Exits 1 if a ray from inside missed or hit a face from outside.
+// Usage: mesh_bench [--segments n] [--rays n] [--obj path]   (defaults: 1024, about a million triangles, 1000000)
+
+#include "../rtweekend.h"
+
+#include "../material.h"
+#include "../triangle_mesh.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using bench_clock = std::chrono::steady_clock;
+
+static double seconds_since(bench_clock::time_point start) {
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+// Unit sphere around the origin, segments around and segments / 2 from pole to pole. Vertices are rounded to float
+// before they are written, so the file holds exactly the positions the mesh will have; they also go to positions.
+static bool write_uv_sphere(const char* path, int segments, std::vector<point3>& positions) {
+    FILE* f = std::fopen(path, "w");
+    if (!f) { return false; }
+    int rings = segments / 2;
+    auto put = [&](double px, double py, double pz) {
+        point3 p(static_cast<float>(px), static_cast<float>(py), static_cast<float>(pz));
+        positions.push_back(p);
+        std::fprintf(f, "v %.9g %.9g %.9g\n", double(p.x()), double(p.y()), double(p.z()));
+    };
+    put(0, 1, 0);
+    for (int i = 1; i < rings; i++) {
+        double s, c;
+        sin_cos(pi * i / rings, s, c);
+        for (int j = 0; j < segments; j++) {
+            double sp, cp;
+            sin_cos(2 * pi * j / segments, sp, cp);
+            put(s * cp, c, s * sp);
+        }
+    }
+    put(0, -1, 0);
+
+    // 1 based, counterclockwise seen from outside
+    auto v = [&](int i, int j) { return 2 + (i - 1) * segments + (j % segments); };
+    int south = 2 + (rings - 1) * segments;
+    for (int j = 0; j < segments; j++) { std::fprintf(f, "f 1 %d %d\n", v(1, j + 1), v(1, j)); }
+    for (int i = 1; i < rings - 1; i++) {
+        for (int j = 0; j < segments; j++) {
+            std::fprintf(f, "f %d %d %d %d\n", v(i, j), v(i, j + 1), v(i + 1, j + 1), v(i + 1, j));
+        }
+    }
+    for (int j = 0; j < segments; j++) { std::fprintf(f, "f %d %d %d\n", south, v(rings - 1, j), v(rings - 1, j + 1)); }
+    return std::fclose(f) == 0;
+}
+
+// Traces every ray, counts misses and, for rays from inside, hits on the outer side of a face (wrong winding).
+// False if rays from inside had either.
+static bool trace(const char* name, const triangle_mesh& mesh, const std::vector<ray>& rays, bool inside) {
+    int misses = 0, outer_sides = 0;
+    auto start = bench_clock::now();
+    for (const auto& r : rays) {
+        hit_record rec;
+        if (!mesh.hit(r, interval(0, infinity), rec)) { misses++; }
+        else if (rec.front_face) { outer_sides++; }
+    }
+    double seconds = seconds_since(start);
+    std::printf("%-26s %8zu rays %6.2f M rays/s  %d misses", name, rays.size(), rays.size() / seconds / 1e6, misses);
+    if (inside) { std::printf(", %d outer sides hit", outer_sides); }
+    std::printf("\n");
+    return !inside || (misses == 0 && outer_sides == 0);
+}
+
+int main(int argc, char** argv) {
+    int segments = 1024;
+    int ray_count = 1000000;
+    std::string obj;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        bool has_value = a + 1 < argc;
+        if (arg == "--segments" && has_value) { segments = std::max(4, std::atoi(argv[++a])); }
+        else if (arg == "--rays" && has_value) { ray_count = std::atoi(argv[++a]); }
+        else if (arg == "--obj" && has_value) { obj = argv[++a]; }
+        else {
+            std::fprintf(stderr, "Usage: mesh_bench [--segments n] [--rays n] [--obj path]\n");
+            return 2;
+        }
+    }
+
+    std::vector<point3> positions;
+    std::string path = obj;
+    if (obj.empty()) {
+        path = "mesh_bench.obj";
+        auto start = bench_clock::now();
+        if (!write_uv_sphere(path.c_str(), segments, positions)) {
+            std::fprintf(stderr, "Could not write %s\n", path.c_str());
+            return 1;
+        }
+        std::printf("uv sphere of %d segments written to %s in %.2f s\n", segments, path.c_str(), seconds_since(start));
+    }
+
+    static material_registry materials;
+    triangle_mesh mesh(materials.add(lambertian(color(0.5, 0.5, 0.5))));
+    if (!mesh.load_obj(path)) { return 1; }
+
+    mapped_file file;
+    file.open(path);
+    double megabytes = file.size() / 1e6;
+    double triangles = double(mesh.triangle_count());
+    std::printf("%zu vertices, %zu triangles, %.1f MB of OBJ\n", mesh.vertex_count(), mesh.triangle_count(),
+        megabytes);
+    std::printf("parsed in %.3f s (%.0f MB/s, %.2f M triangles/s), tree built in %.3f s, %zu nodes\n",
+        mesh.parse_seconds, megabytes / mesh.parse_seconds, triangles / mesh.parse_seconds / 1e6,
+        mesh.build_seconds, mesh.node_count());
+    std::printf("%.1f bytes per triangle: vertices %.1f, indices %.1f, tree %.1f\n", mesh.bytes() / triangles,
+        mesh.vertex_count() * 3 * sizeof(float) / triangles, 3 * sizeof(uint32_t) * 1.0,
+        mesh.node_count() * sizeof(flat_bvh_node) / triangles);
+
+    pcg32 rng(11, 5);
+    std::vector<ray> rays;
+    if (!obj.empty()) {
+        // Rays from a shell around the mesh at random points of its box
+        aabb box = mesh.bounding_box();
+        point3 center = box.centroid();
+        vec3 half(box.x.size() / 2, box.y.size() / 2, box.z.size() / 2);
+        for (int k = 0; k < ray_count; k++) {
+            point3 origin = center + 2 * half.length() * random_unit_vector(rng);
+            point3 target = center + vec3(half.x() * random_double(-1, 1, rng), half.y() * random_double(-1, 1, rng),
+                                          half.z() * random_double(-1, 1, rng));
+            rays.push_back(ray(origin, target - origin));
+        }
+        trace("rays from outside", mesh, rays, false);
+        return 0;
+    }
+
+    for (int k = 0; k < ray_count; k++) {
+        rays.push_back(ray(0.5 * random_in_unit_disk(rng) + vec3(0, 0, 0.5 * random_double(-1, 1, rng)),
+                           random_unit_vector(rng)));
+    }
+    bool watertight = trace("random rays from inside", mesh, rays, true);
+
+    // From the center the direction is the vertex itself, exactly
+    rays.clear();
+    for (int k = 0; k < ray_count; k++) {
+        rays.push_back(ray(point3(0, 0, 0), positions[rng.next_uint() % positions.size()]));
+    }
+    watertight &= trace("rays through vertices", mesh, rays, true);
+
+    // The middle of two floats is exact in double: along a ring, down a meridian or across a quad
+    rays.clear();
+    int rings = segments / 2;
+    for (int k = 0; k < ray_count; k++) {
+        int i = 1 + int(rng.next_uint() % uint32_t(rings - 2));
+        int j = int(rng.next_uint() % uint32_t(segments));
+        int di = int(rng.next_uint() % 3);
+        auto at = [&](int ii, int jj) { return positions[1 + (ii - 1) * segments + (jj % segments)]; };
+        point3 a = at(i, j);
+        point3 b = (di == 0) ? at(i, j + 1) : (di == 1) ? at(i + 1, j) : at(i + 1, j + 1);
+        rays.push_back(ray(point3(0, 0, 0), (a + b) / 2));
+    }
+    watertight &= trace("rays through edges", mesh, rays, true);
+    return watertight ? 0 : 1;
+}
@@ -0,0 +1,63 @@
+// Render throughput and memory footprint of one precision variant of the renderer. The same source is built four
+// ways (see CMakeLists.txt): double or float (RT_FLOAT), each with plain or 4 wide SIMD vectors (RT_VEC3_SIMD).
+// Every scene from bench_scenes.h is rendered and saved as <prefix>_<scene>.pfm, so image_diff can tell how far the
+// variants' pictures are apart; the sampling is seeded per pixel and sample, so any difference is the arithmetic's.
+// Usage: precision_bench [--threads n] [--spp n] [--out prefix]   (defaults: all cores, 8 spp, the variant's name)
+
+#include "../rtweekend.h"
+
+#include "../camera.h"
+#include "../scene.h"
+#include "bench_scenes.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#ifdef RT_FLOAT
+#define VARIANT_PRECISION "float"
+#else
+#define VARIANT_PRECISION "double"
+#endif
+
+#ifdef RT_VEC3_SIMD_KERNELS
+#define VARIANT_NAME VARIANT_PRECISION "_simd"
+#else
+#define VARIANT_NAME VARIANT_PRECISION
+#endif
+
+int main(int argc, char** argv) {
+    int threads = 0;
+    int spp = 8;
+    std::string prefix = VARIANT_NAME;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        bool has_value = a + 1 < argc;
+        if (arg == "--threads" && has_value) { threads = std::atoi(argv[++a]); }
+        else if (arg == "--spp" && has_value) { spp = std::atoi(argv[++a]); }
+        else if (arg == "--out" && has_value) { prefix = argv[++a]; }
+        else {
+            std::fprintf(stderr, "Usage: precision_bench [--threads n] [--spp n] [--out prefix]\n");
+            return 2;
+        }
+    }
+
+    std::printf("variant %s: sizeof vec3 %zu, ray %zu, hit_record %zu, sphere %zu\n", VARIANT_NAME, sizeof(vec3),
+        sizeof(ray), sizeof(hit_record), sizeof(sphere));
+    std::printf("%-16s %14s %14s  %s\n", "scene", "rays/s", "render s", "image");
+
+    for (const auto& bs : bench_scenes) {
+        scene s;
+        bs.make(s);
+        s.cam.thread_count = threads;
+        s.cam.samples_per_pix = spp;
+        s.cam.output_path = prefix + "_" + bs.name + ".pfm";
+        s.cam.output_format = image_format::pfm;
+
+        const hittable& world = s.build();
+        s.cam.render(world);
+        const render_stats& st = s.cam.statistics();
+        std::printf("%-16s %14.0f %14.3f  %s\n", bs.name, st.rays_per_second(), st.render_seconds,
+            s.cam.output_path.c_str());
+    }
+}
@@ -0,0 +1,124 @@
+// Latency of the interactive preview (preview.h). A preview_server runs in process on a scene of bench_scenes.h and
+// gets a script of edits --interval ms apart: the camera orbiting, zooming and refocusing, and a material changing.
+// For each edit the table has the time from the edit arriving to its first frame, to its first frame at full size
+// and to its last, and how many frames it sent. Then the same view from scratch the way it was done before: build
+// the scene and render it at full size, once with one sample per pixel and once with all of them.
+// Usage: preview_bench [--scene name] [--width n] [--spp n] [--interval ms] [--threads n]
+//        (defaults: random_spheres, 400 pixels wide, 16, 1500, all cores)
+
+#include "../rtweekend.h"
+
+#include "../camera.h"
+#include "../preview.h"
+#include "../scene.h"
+#include "bench_scenes.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using bench_clock = std::chrono::steady_clock;
+
+static double seconds_since(bench_clock::time_point start) {
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+static void setup(scene& s, const bench_scene& bs, int width, int spp, int threads) {
+    bs.make(s);
+    s.cam.image_width = width;
+    s.cam.samples_per_pix = spp;
+    s.cam.thread_count = threads;
+    s.cam.output_path.clear();
+}
+
+int main(int argc, char** argv) {
+    std::string name = "random_spheres";
+    int width = 400;
+    int spp = 16;
+    int interval = 1500;
+    int threads = 0;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        bool has_value = a + 1 < argc;
+        if (arg == "--scene" && has_value) { name = argv[++a]; }
+        else if (arg == "--width" && has_value) { width = std::atoi(argv[++a]); }
+        else if (arg == "--spp" && has_value) { spp = std::atoi(argv[++a]); }
+        else if (arg == "--interval" && has_value) { interval = std::atoi(argv[++a]); }
+        else if (arg == "--threads" && has_value) { threads = std::atoi(argv[++a]); }
+        else {
+            std::fprintf(stderr, "Usage: preview_bench [--scene name] [--width n] [--spp n] [--interval ms] "
+                                 "[--threads n]\n");
+            return 2;
+        }
+    }
+    const bench_scene* chosen = nullptr;
+    for (const auto& bs : bench_scenes) {
+        if (name == bs.name) { chosen = &bs; }
+    }
+    if (!chosen) {
+        std::fprintf(stderr, "No scene %s\n", name.c_str());
+        return 2;
+    }
+
+    scene s;
+    setup(s, *chosen, width, spp, threads);
+    const hittable& world = s.build();
+    s.material_names["first"] = 0; // Built from records, the scene has no names, the edit needs one
+
+    // Around what the camera looks at, at the distance it starts from
+    vec3 offset = s.cam.lookfrom - s.cam.lookat;
+    double radius = std::sqrt(offset.x() * offset.x() + offset.z() * offset.z());
+    double angle = std::atan2(offset.z(), offset.x());
+    std::vector<std::string> script;
+    for (int k = 1; k <= 4; k++) {
+        double a = angle + 0.15 * k;
+        script.push_back("camera lookfrom " + std::to_string(s.cam.lookat.x() + radius * std::cos(a)) + ' '
+                         + std::to_string(s.cam.lookfrom.y()) + ' ' + std::to_string(s.cam.lookat.z() + radius * std::sin(a)));
+    }
+    script.push_back("camera vfov " + std::to_string(s.cam.vfov * 0.8));
+    script.push_back("camera defocus_angle 1");
+    script.push_back("camera focus_dist " + std::to_string(offset.length()));
+    script.push_back("material first lambertian 0.9 0.2 0.2");
+
+    preview_server server(s, world);
+    size_t next = 0;
+    uint64_t bytes = 0;
+    std::clog.setstate(std::ios::failbit); // The server's own lines, the table below has the same
+    server.run(
+        [&](std::string& line) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+            line = next < script.size() ? script[next++] : "quit";
+            return true;
+        },
+        [&](const void*, size_t size) {
+            bytes += size;
+            return true;
+        });
+    std::clog.clear();
+
+    std::printf("%s, %d pixels wide, %d samples per pixel, edits %d ms apart, %.1f MB of frames\n", chosen->name,
+                width, spp, interval, bytes / 1e6);
+    std::printf("%-44s %12s %12s %10s %7s\n", "edit", "first ms", "full size ms", "last s", "frames");
+    for (const auto& e : server.edits()) {
+        std::printf("%-44s %12.2f %12.2f", e.statement.c_str(), 1000 * e.first_frame, 1000 * e.full_size);
+        if (e.finished >= 0) { std::printf(" %10.3f", e.finished); }
+        else { std::printf(" %10s", "-"); }
+        std::printf(" %7d\n", e.frames);
+    }
+
+    // From scratch, scene setup included, as a new run would
+    for (int samples : { 1, spp }) {
+        auto start = bench_clock::now();
+        scene fresh;
+        setup(fresh, *chosen, width, samples, threads);
+        const hittable& w = fresh.build();
+        fresh.cam.verbose = false;
+        fresh.cam.render(w);
+        std::printf("From scratch at %d samples per pixel: %.2f ms (%.2f ms of it building)\n", samples,
+                    1000 * seconds_since(start), 1000 * fresh.build_seconds);
+    }
+}
@@ -0,0 +1,240 @@
+// End to end render benchmark over the fixed scenes in bench_scenes.h, with every integrator, reported as JSON.
+// Usage:
+//   render_bench [--threads n] [--spp n] [--json out.json]         run and print (or save) the results
+//   render_bench [...] --compare baseline.json [--tolerance 0.1]   also compare against an earlier run, exits 1 if
+//                                                                  any rays/s dropped (or peak memory grew) by more
+//                                                                  than the tolerance
+// The scenes are always the same, so results are comparable between runs on the same machine and thread count.
+// Stage seconds come from the wavefront integrator and are summed over threads. Peak memory is the process's peak
+// so far, so it only ever grows from one run to the next in the list.
+
+#include "../rtweekend.h"
+
+#include "../camera.h"
+#include "../scene.h"
+#include "bench_scenes.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+static size_t peak_memory_bytes() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof counters);
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return size_t(usage.ru_maxrss); // Bytes on macOS
+#else
+    return size_t(usage.ru_maxrss) * 1024; // Kilobytes on Linux
+#endif
+#endif
+}
+
+struct bench_result {
+    size_t spheres;
+    double build_seconds;
+    render_stats stats;
+    size_t peak_memory;
+};
+
+static bench_result run(void (*make)(scene&), integrator_type integrator, int threads, int spp) {
+    scene s;
+    make(s);
+    s.cam.thread_count = threads;
+    s.cam.integrator = integrator;
+    s.cam.output_path = "render_bench.ppm"; // Written so output time is measured, overwritten by every run
+    if (spp > 0) { s.cam.samples_per_pix = spp; }
+
+    const hittable& world = s.build();
+    s.cam.render(world);
+    return { s.sphere_records.size(), s.build_seconds, s.cam.statistics(), peak_memory_bytes() };
+}
+
+static void write_result(std::ostringstream& out, const bench_result& r, bool stages) {
+    const render_stats& st = r.stats;
+    out << "{\n"
+        << "        \"spheres\": " << r.spheres << ",\n"
+        << "        \"primary_rays\": " << st.primary_rays << ",\n"
+        << "        \"secondary_rays\": " << st.secondary_rays << ",\n"
+        << "        \"rays_per_sec\": " << st.rays_per_second() << ",\n"
+        << "        \"primary_rays_per_sec\": " << st.primary_rays / st.render_seconds << ",\n"
+        << "        \"secondary_rays_per_sec\": " << st.secondary_rays / st.render_seconds << ",\n"
+        << "        \"mean_path_length\": " << st.mean_path_length() << ",\n"
+        << "        \"seconds\": { \"build\": " << r.build_seconds << ", \"render\": " << st.render_seconds
+        << ", \"output\": " << st.output_seconds << " },\n";
+    if (stages) {
+        out << "        \"stage_cpu_seconds\": { ";
+        for (int stage = 0; stage < wavefront_stats::stage_count; stage++) {
+            out << (stage ? ", " : "") << '"' << wavefront_stats::stage_name(stage) << "\": " << st.stages.seconds[stage];
+        }
+        out << " },\n";
+    }
+    out << "        \"peak_memory_bytes\": " << r.peak_memory << "\n"
+        << "      }";
+}
+
+// Just enough JSON to read our own output back: every number ends up in the map under its dotted path
+// ("scenes.main.recursive.rays_per_sec"), strings and arrays are skipped.
+static void read_json_value(const char*& p, const std::string& path, std::map<std::string, double>& out);
+
+static void skip_space(const char*& p) {
+    while (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t') { p++; }
+}
+
+static std::string read_json_string(const char*& p) {
+    std::string s;
+    p++; // Opening quote
+    while (*p && *p != '"') {
+        if (*p == '\\' && p[1]) { p++; }
+        s += *p++;
+    }
+    if (*p) { p++; }
+    return s;
+}
+
+static void read_json_value(const char*& p, const std::string& path, std::map<std::string, double>& out) {
+    skip_space(p);
+    if (*p == '{' || *p == '[') {
+        bool object = (*p == '{');
+        char close = object ? '}' : ']';
+        p++;
+        for (int index = 0; ; index++) {
+            skip_space(p);
+            if (*p == close || *p == '\0') { break; }
+            std::string key = std::to_string(index);
+            if (object) {
+                key = read_json_string(p);
+                skip_space(p);
+                if (*p == ':') { p++; }
+            }
+            read_json_value(p, path.empty() ? key : path + '.' + key, out);
+            skip_space(p);
+            if (*p == ',') { p++; }
+        }
+        if (*p) { p++; }
+    }
+    else if (*p == '"') {
+        read_json_string(p);
+    }
+    else {
+        char* end;
+        double v = std::strtod(p, &end);
+        if (end != p) {
+            out[path] = v;
+            p = end;
+        }
+        else { // true, false, null
+            while (std::isalpha(static_cast<unsigned char>(*p))) { p++; }
+        }
+    }
+}
+
+static bool read_json_numbers(const std::string& text, std::map<std::string, double>& out) {
+    const char* p = text.c_str();
+    read_json_value(p, "", out);
+    return !out.empty();
+}
+
+static bool ends_with(const std::string& s, const char* suffix) {
+    size_t n = std::strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static int compare(const std::map<std::string, double>& base, const std::map<std::string, double>& now, double tolerance) {
+    // Throughput has to stay within tolerance of the baseline, peak memory mustn't grow by more than it
+    int regressions = 0;
+    std::printf("%-52s %14s %14s %8s\n", "metric", "baseline", "now", "change");
+    for (const auto& entry : now) {
+        const std::string& key = entry.first;
+        bool throughput = ends_with(key, "rays_per_sec");
+        bool memory = ends_with(key, "peak_memory_bytes");
+        auto old = base.find(key);
+        if ((!throughput && !memory) || old == base.end() || old->second <= 0) { continue; }
+
+        double change = entry.second / old->second - 1;
+        bool regressed = throughput ? (change < -tolerance) : (change > tolerance);
+        regressions += regressed;
+        std::printf("%-52s %14.0f %14.0f %+7.1f%% %s\n", key.c_str(), old->second, entry.second, 100 * change,
+            regressed ? "REGRESSED" : "");
+    }
+    std::printf("%d regression%s beyond %.1f%%\n", regressions, regressions == 1 ? "" : "s", 100 * tolerance);
+    return regressions;
+}
+
+int main(int argc, char** argv) {
+    int threads = 0;
+    int spp = 0;
+    double tolerance = 0.10;
+    std::string json_path, baseline_path;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        bool has_value = a + 1 < argc;
+        if (arg == "--threads" && has_value) { threads = std::atoi(argv[++a]); }
+        else if (arg == "--spp" && has_value) { spp = std::atoi(argv[++a]); }
+        else if (arg == "--json" && has_value) { json_path = argv[++a]; }
+        else if (arg == "--compare" && has_value) { baseline_path = argv[++a]; }
+        else if (arg == "--tolerance" && has_value) { tolerance = std::atof(argv[++a]); }
+        else {
+            std::fprintf(stderr, "Usage: render_bench [--threads n] [--spp n] [--json out.json] "
+                                 "[--compare baseline.json] [--tolerance 0.1]\n");
+            return 2;
+        }
+    }
+
+    std::ostringstream out;
+    out << "{\n  \"threads\": " << work_stealing_pool::resolve_thread_count(threads) << ",\n  \"scenes\": {\n";
+    for (size_t k = 0; k < sizeof bench_scenes / sizeof bench_scenes[0]; k++) {
+        std::clog << "== " << bench_scenes[k].name << '\n';
+        bench_result recursive = run(bench_scenes[k].make, integrator_type::recursive, threads, spp);
+        bench_result iterative = run(bench_scenes[k].make, integrator_type::iterative, threads, spp);
+        bench_result wavefront = run(bench_scenes[k].make, integrator_type::wavefront, threads, spp);
+
+        out << "    \"" << bench_scenes[k].name << "\": {\n      \"recursive\": ";
+        write_result(out, recursive, false);
+        out << ",\n      \"iterative\": ";
+        write_result(out, iterative, false);
+        out << ",\n      \"wavefront\": ";
+        write_result(out, wavefront, true);
+        out << "\n    }" << (k + 1 < sizeof bench_scenes / sizeof bench_scenes[0] ? "," : "") << '\n';
+    }
+    out << "  }\n}\n";
+
+    std::string json = out.str();
+    if (json_path.empty()) {
+        std::fputs(json.c_str(), stdout);
+    }
+    else {
+        std::ofstream(json_path) << json;
+    }
+
+    if (!baseline_path.empty()) {
+        std::ifstream in(baseline_path);
+        std::stringstream text;
+        text << in.rdbuf();
+        std::map<std::string, double> base, now;
+        if (!in || !read_json_numbers(text.str(), base)) {
+            std::fprintf(stderr, "Could not read baseline %s\n", baseline_path.c_str());
+            return 2;
+        }
+        read_json_numbers(json, now);
+        return compare(base, now, tolerance) > 0 ? 1 : 0;
+    }
+    return 0;
+}
@@ -0,0 +1,175 @@
+// Equal error comparison of the samplers in sampler.h over the scenes in bench_scenes.h.
+// Each scene is rendered once with many samples as the reference (sobol, on another frame so none of its samples
+// are reused), then with every sampler at 1, 2, 4 .. --max-spp samples per pixel. The table is the RMSE against the
+// reference, and below it how many samples each sampler needs to get down to random's error at --max-spp (read off
+// the log-log error curve, extrapolated past the last point if it never got there), with the time that takes.
+// --check-strata renders nothing, it checks that the stratified sampler puts no two samples of a pixel in the same
+// stratum for any samples per pixel up to 100, and exits 1 if it does.
+// Usage: sampler_bench [--threads n] [--width n] [--max-spp n] [--reference-spp n] [--scene name] [--check-strata]
+//        (defaults: all cores, 96 pixels wide, 64, 1024, every scene)
+
+#include "../rtweekend.h"
+
+#include "../camera.h"
+#include "../scene.h"
+#include "bench_scenes.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+struct sampler_entry {
+    const char* name;
+    sampler_type type;
+};
+
+static const sampler_entry samplers[] = {
+    { "random", sampler_type::random },
+    { "stratified", sampler_type::stratified },
+    { "sobol", sampler_type::sobol },
+    { "blue_noise", sampler_type::blue_noise },
+};
+
+static framebuffer render(void (*make)(scene&), sampler_type type, int spp, int frame, int width, int threads,
+                          double& seconds) {
+    scene s;
+    make(s);
+    s.cam.sampler = type;
+    s.cam.samples_per_pix = spp;
+    s.cam.frame = frame;
+    s.cam.image_width = width;
+    s.cam.thread_count = threads;
+    s.cam.output_path.clear();
+    const hittable& world = s.build();
+    std::clog.setstate(std::ios::failbit); // The renders' progress lines would drown the table
+    s.cam.render(world);
+    std::clog.clear();
+    seconds = s.cam.statistics().render_seconds;
+    return s.cam.image();
+}
+
+static double rmse(const framebuffer& a, const framebuffer& b) {
+    double sum = 0;
+    for (int j = 0; j < a.height(); j++) {
+        for (int i = 0; i < a.width(); i++) {
+            vec3 d = a.get(i, j) - b.get(i, j);
+            sum += d.length_squared();
+        }
+    }
+    return std::sqrt(sum / (3.0 * a.width() * a.height()));
+}
+
+// Samples per pixel where the curve through (spp[k], error[k]) reaches target, straight lines in log-log
+static double samples_for(const std::vector<int>& spp, const std::vector<double>& error, double target) {
+    size_t n = spp.size();
+    for (size_t k = 0; k < n; k++) {
+        if (error[k] <= target) {
+            if (k == 0) { return spp[0]; }
+            double slope = std::log(error[k] / error[k - 1]) / std::log(double(spp[k]) / spp[k - 1]);
+            return spp[k - 1] * std::pow(target / error[k - 1], 1 / slope);
+        }
+    }
+    double slope = (n > 1) ? std::log(error[n - 1] / error[n - 2]) / std::log(double(spp[n - 1]) / spp[n - 2]) : -0.5;
+    slope = std::fmin(slope, -0.1); // A flat last step would extrapolate to nonsense
+    return spp[n - 1] * std::pow(target / error[n - 1], 1 / slope);
+}
+
+// Cells of the 1d strata and the 2d grid every sample of a pixel lands in, for a few dimensions of each
+static bool check_strata() {
+    const int pixels = 64;
+    for (int spp = 1; spp <= 100; spp++) {
+        sampler_settings settings;
+        settings.type = sampler_type::stratified;
+        settings.samples_per_pixel = spp;
+        uint32_t grid_x, grid_y;
+        stratified_grid(uint32_t(spp), grid_x, grid_y);
+        for (int pixel = 0; pixel < pixels; pixel++) {
+            std::vector<std::vector<int>> used(5, std::vector<int>(grid_x * grid_y, 0));
+            for (int sample = 0; sample < spp; sample++) {
+                path_sampler sampler(settings, pixel, 0, uint32_t(pixel), uint32_t(sample));
+                for (int d = 0; d < 5; d++) {
+                    size_t cell;
+                    if (d % 2 == 0) {
+                        double u, v;
+                        sampler.next_2d(u, v);
+                        cell = size_t(v * grid_y) * grid_x + size_t(u * grid_x);
+                    }
+                    else {
+                        cell = size_t(sampler.next_1d() * spp);
+                    }
+                    if (++used[d][cell] > 1) {
+                        std::printf("%d spp, pixel %d: call %d of sample %d is in a used stratum\n", spp, pixel, d,
+                                    sample);
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    std::printf("Every sample in a stratum of its own, 1 to 100 spp\n");
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int threads = 0;
+    int width = 96;
+    int max_spp = 64;
+    int reference_spp = 1024;
+    std::string only;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        bool has_value = a + 1 < argc;
+        if (arg == "--threads" && has_value) { threads = std::atoi(argv[++a]); }
+        else if (arg == "--width" && has_value) { width = std::atoi(argv[++a]); }
+        else if (arg == "--max-spp" && has_value) { max_spp = std::atoi(argv[++a]); }
+        else if (arg == "--reference-spp" && has_value) { reference_spp = std::atoi(argv[++a]); }
+        else if (arg == "--scene" && has_value) { only = argv[++a]; }
+        else if (arg == "--check-strata") { return check_strata() ? 0 : 1; }
+        else {
+            std::fprintf(stderr, "Usage: sampler_bench [--threads n] [--width n] [--max-spp n] [--reference-spp n] "
+                                 "[--scene name] [--check-strata]\n");
+            return 2;
+        }
+    }
+
+    std::vector<int> spp;
+    for (int n = 1; n <= max_spp; n *= 2) { spp.push_back(n); }
+
+    for (const auto& bs : bench_scenes) {
+        if (!only.empty() && only != bs.name) { continue; }
+        double seconds;
+        framebuffer reference = render(bs.make, sampler_type::sobol, reference_spp, 1, width, threads, seconds);
+        std::printf("%s, %d wide, reference %d spp in %.2f s\n", bs.name, width, reference_spp, seconds);
+
+        std::printf("%-12s", "rmse");
+        for (int n : spp) { std::printf(" %9d", n); }
+        std::printf("\n");
+
+        const size_t count = sizeof samplers / sizeof samplers[0];
+        std::vector<std::vector<double>> errors(count);
+        std::vector<double> seconds_at_max(count);
+        for (size_t s = 0; s < count; s++) {
+            std::printf("%-12s", samplers[s].name);
+            for (int n : spp) {
+                framebuffer image = render(bs.make, samplers[s].type, n, 0, width, threads, seconds);
+                errors[s].push_back(rmse(image, reference));
+                seconds_at_max[s] = seconds;
+                std::printf(" %9.5f", errors[s].back());
+                std::fflush(stdout);
+            }
+            std::printf("\n");
+        }
+
+        double target = errors[0].back();
+        std::printf("to random's error at %d spp (%.5f):\n", max_spp, target);
+        for (size_t s = 0; s < count; s++) {
+            double needed = samples_for(spp, errors[s], target);
+            double seconds_needed = seconds_at_max[s] * needed / max_spp; // Render time is linear in samples
+            std::printf("  %-12s %8.1f spp  %5.2fx fewer samples  %7.3f s  %5.2fx faster\n", samplers[s].name,
+                needed, max_spp / needed, seconds_needed, seconds_at_max[0] / seconds_needed);
+        }
+        std::printf("\n");
+    }
+}
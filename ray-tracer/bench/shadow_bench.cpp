@@ -0,0 +1,145 @@
+// Shadow rays and next event estimation (lights.h).
+// First the any hit query against the closest hit one: from the points camera rays hit in every scene of
+// bench_scenes.h, rays toward points above the scene, each traced both with hit() over the segment and with
+// occluded(). The answers have to agree, occluded() only gets to stop early: the bench exits 1 if any doesn't.
+// Then lit_room with and without next event estimation at 1, 2, 4 .. --max-spp samples per pixel: the RMSE
+// against a reference (with, on another frame) and the time each took.
+// Usage: shadow_bench [--rays n] [--threads n] [--width n] [--max-spp n] [--reference-spp n]
+//        (defaults: 500000, all cores, 96 pixels wide, 64, 1024)
+
+#include "../rtweekend.h"
+
+#include "../camera.h"
+#include "../scene.h"
+#include "bench_scenes.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using bench_clock = std::chrono::steady_clock;
+
+static double seconds_since(bench_clock::time_point start) {
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+struct segment {
+    ray r;
+    real t_max;
+};
+
+// Shadow rays from where rays out of the camera land, toward a square 10 above what the camera looks at
+static std::vector<segment> shadow_segments(const scene& s, const hittable& world, int count, pcg32& rng) {
+    std::vector<segment> segments;
+    vec3 forward = s.cam.lookat - s.cam.lookfrom;
+    real spread = forward.length() / 2;
+    for (int tries = 0; int(segments.size()) < count && tries < 4 * count; tries++) {
+        ray view(s.cam.lookfrom, forward + spread * vec3(real(random_double(-1, 1, rng)),
+                                                         real(random_double(-1, 1, rng)), 0));
+        hit_record rec;
+        if (!world.hit(view, interval(0.001, infinity), rec)) { continue; }
+        point3 light = s.cam.lookat + vec3(real(random_double(-2, 2, rng)), 10, real(random_double(-2, 2, rng)));
+        segments.push_back({ ray(rec.p, light - rec.p), real(0.999) }); // t of 1 is the light
+    }
+    return segments;
+}
+
+static framebuffer render(bool next_event, int spp, int frame, int width, int threads, double& seconds) {
+    scene s;
+    lit_room_scene(s);
+    s.cam.next_event = next_event;
+    s.cam.samples_per_pix = spp;
+    s.cam.frame = frame;
+    s.cam.image_width = width;
+    s.cam.thread_count = threads;
+    s.cam.integrator = integrator_type::iterative;
+    s.cam.output_path.clear();
+    const hittable& world = s.build();
+    std::clog.setstate(std::ios::failbit); // The renders' progress lines would drown the table
+    s.cam.render(world);
+    std::clog.clear();
+    seconds = s.cam.statistics().render_seconds;
+    return s.cam.image();
+}
+
+static double rmse(const framebuffer& a, const framebuffer& b) {
+    double sum = 0;
+    for (int j = 0; j < a.height(); j++) {
+        for (int i = 0; i < a.width(); i++) {
+            vec3 d = a.get(i, j) - b.get(i, j);
+            sum += d.length_squared();
+        }
+    }
+    return std::sqrt(sum / (3.0 * a.width() * a.height()));
+}
+
+int main(int argc, char** argv) {
+    int ray_count = 500000;
+    int threads = 0;
+    int width = 96;
+    int max_spp = 64;
+    int reference_spp = 1024;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        bool has_value = a + 1 < argc;
+        if (arg == "--rays" && has_value) { ray_count = std::atoi(argv[++a]); }
+        else if (arg == "--threads" && has_value) { threads = std::atoi(argv[++a]); }
+        else if (arg == "--width" && has_value) { width = std::atoi(argv[++a]); }
+        else if (arg == "--max-spp" && has_value) { max_spp = std::atoi(argv[++a]); }
+        else if (arg == "--reference-spp" && has_value) { reference_spp = std::atoi(argv[++a]); }
+        else {
+            std::fprintf(stderr, "Usage: shadow_bench [--rays n] [--threads n] [--width n] [--max-spp n] "
+                                 "[--reference-spp n]\n");
+            return 2;
+        }
+    }
+
+    std::printf("%-16s %9s %14s %14s %8s %10s\n", "scene", "blocked", "hit M rays/s", "any M rays/s", "speedup",
+                "disagree");
+    size_t total_disagree = 0;
+    for (const auto& bs : bench_scenes) {
+        scene s;
+        bs.make(s);
+        const hittable& world = s.build();
+        pcg32 rng(7, 3);
+        std::vector<segment> segments = shadow_segments(s, world, ray_count, rng);
+
+        std::vector<char> closest(segments.size()), any(segments.size());
+        auto start = bench_clock::now();
+        for (size_t k = 0; k < segments.size(); k++) {
+            hit_record rec;
+            closest[k] = world.hit(segments[k].r, interval(0.001, segments[k].t_max), rec);
+        }
+        double hit_seconds = seconds_since(start);
+        start = bench_clock::now();
+        for (size_t k = 0; k < segments.size(); k++) {
+            any[k] = world.occluded(segments[k].r, interval(0.001, segments[k].t_max));
+        }
+        double any_seconds = seconds_since(start);
+
+        size_t blocked = 0, disagree = 0;
+        for (size_t k = 0; k < segments.size(); k++) {
+            blocked += closest[k] != 0;
+            disagree += closest[k] != any[k];
+        }
+        std::printf("%-16s %8.1f%% %14.2f %14.2f %7.2fx %10zu\n", bs.name, 100.0 * blocked / segments.size(),
+            segments.size() / hit_seconds / 1e6, segments.size() / any_seconds / 1e6, hit_seconds / any_seconds,
+            disagree);
+        total_disagree += disagree;
+    }
+
+    double seconds;
+    framebuffer reference = render(true, reference_spp, 1, width, threads, seconds);
+    std::printf("\nlit_room, RMSE against %d samples per pixel (%.1f s)\n", reference_spp, seconds);
+    std::printf("%6s %14s %10s %14s %10s\n", "spp", "next event", "seconds", "hits only", "seconds");
+    for (int spp = 1; spp <= max_spp; spp *= 2) {
+        double with_seconds, without_seconds;
+        double with = rmse(render(true, spp, 0, width, threads, with_seconds), reference);
+        double without = rmse(render(false, spp, 0, width, threads, without_seconds), reference);
+        std::printf("%6d %14.4f %10.3f %14.4f %10.3f\n", spp, with, with_seconds, without, without_seconds);
+    }
+    return total_disagree == 0 ? 0 : 1;
+}
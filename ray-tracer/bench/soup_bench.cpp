@@ -0,0 +1,125 @@
+// Closest hit throughput of sphere_soup's scalar, SSE2, AVX2 and AVX-512 kernels against the same spheres as separate
+// sphere objects in a hittable_list, plus a flat_bvh with soups of 8 in its leaves. Levels the CPU lacks run the
+// widest kernel it has. Exits 1 if any of them disagrees with the list on a ray's closest hit.
+// Usage: soup_bench
+
+#include "../rtweekend.h"
+
+#include "../flat_bvh.h"
+#include "../hittable_list.h"
+#include "../material.h"
+#include "../sphere.h"
+#include "../sphere_soup.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+using bench_clock = std::chrono::steady_clock;
+
+struct sphere_desc {
+    point3 center;
+    double radius;
+};
+
+static uint32_t morton_code(const point3& p) {
+    // 10 bits per axis of a point in the [-1,1] cube, interleaved so nearby points sort next to each other
+    auto spread = [](uint32_t v) {
+        v = (v | (v << 16)) & 0x030000ff;
+        v = (v | (v << 8)) & 0x0300f00f;
+        v = (v | (v << 4)) & 0x030c30c3;
+        v = (v | (v << 2)) & 0x09249249;
+        return v;
+    };
+    auto quantize = [](double x) { return uint32_t(std::min(1023.0, std::max(0.0, (x + 1) * 512))); };
+    return (spread(quantize(p.x())) << 2) | (spread(quantize(p.y())) << 1) | spread(quantize(p.z()));
+}
+
+static double rays_per_sec(const hittable& world, const std::vector<ray>& rays, std::vector<double>& t_out) {
+    auto start = bench_clock::now();
+    for (const auto& r : rays) {
+        hit_record rec;
+        t_out.push_back(world.hit(r, interval(0.001, infinity), rec) ? rec.t : -1);
+    }
+    return rays.size() / std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+int main() {
+    const int counts[] = { 16, 256, 4096, 65536 };
+    static material_registry materials;
+    auto mat = materials.add(lambertian(color(0.5, 0.5, 0.5)));
+
+    std::printf("best kernel on this cpu: %s\n", simd_level_name(best_simd_level()));
+    std::printf("%8s %12s %12s %12s %12s %12s %14s %14s %8s\n", "spheres", "list", "soup scalar", "soup sse2", "soup avx2",
+        "soup avx512", "bvh(spheres)", "bvh(soups/8)", "agree");
+    bool all_agree = true;
+
+    for (int n : counts) {
+        pcg32 rng(n, 5);
+        std::vector<sphere_desc> spheres;
+        double radius = 0.5 / std::cbrt(double(n));
+        for (int i = 0; i < n; i++) {
+            spheres.push_back({ vec3::random(-1, 1, rng), radius });
+        }
+
+        std::vector<ray> rays;
+        int ray_count = std::max(2000, 8000000 / n);
+        for (int i = 0; i < ray_count; i++) {
+            point3 origin = 3.0 * random_unit_vector(rng);
+            rays.push_back(ray(origin, vec3::random(-1, 1, rng) - origin));
+        }
+
+        hittable_list list;
+        sphere_soup soup;
+        for (const auto& s : spheres) {
+            list.add(make_shared<sphere>(s.center, s.radius, mat));
+            soup.add(s.center, s.radius, mat);
+        }
+
+        // Spatially coherent soups of 8 for BVH leaves: sort along a Morton curve then cut into runs. Indices are
+        // sorted, std::sort would pass the spheres' 32 byte SIMD vectors by value
+        std::vector<size_t> order(spheres.size());
+        for (size_t k = 0; k < order.size(); k++) { order[k] = k; }
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return morton_code(spheres[a].center) < morton_code(spheres[b].center);
+        });
+        std::vector<sphere_desc> sorted;
+        for (size_t k : order) { sorted.push_back(spheres[k]); }
+        hittable_list leaves;
+        for (size_t i = 0; i < sorted.size(); i += 8) {
+            auto leaf = make_shared<sphere_soup>();
+            for (size_t k = i; k < std::min(sorted.size(), i + 8); k++) {
+                leaf->add(sorted[k].center, sorted[k].radius, mat);
+            }
+            leaves.add(leaf);
+        }
+        flat_bvh bvh_spheres(list);
+        flat_bvh bvh_soups(leaves);
+
+        std::vector<double> t_list, t_scalar, t_sse2, t_avx2, t_avx512, t_bvh, t_bvh_soup;
+        double list_rate = rays_per_sec(list, rays, t_list);
+
+        soup.set_simd_level(simd_level::scalar);
+        double scalar_rate = rays_per_sec(soup, rays, t_scalar);
+        soup.set_simd_level(simd_level::sse2);
+        double sse2_rate = rays_per_sec(soup, rays, t_sse2);
+        soup.set_simd_level(simd_level::avx2);
+        double avx2_rate = rays_per_sec(soup, rays, t_avx2);
+        soup.set_simd_level(simd_level::avx512);
+        double avx512_rate = rays_per_sec(soup, rays, t_avx512);
+
+        double bvh_rate = rays_per_sec(bvh_spheres, rays, t_bvh);
+        double bvh_soup_rate = rays_per_sec(bvh_soups, rays, t_bvh_soup);
+
+        bool agree = (t_list == t_scalar) && (t_list == t_sse2) && (t_list == t_avx2) && (t_list == t_avx512)
+                  && (t_list == t_bvh)
+                  && (t_list == t_bvh_soup);
+        all_agree = all_agree && agree;
+
+        std::printf("%8d %12.0f %12.0f %12.0f %12.0f %12.0f %14.0f %14.0f %8s\n", n, list_rate, scalar_rate, sse2_rate,
+            avx2_rate, avx512_rate, bvh_rate, bvh_soup_rate, agree ? "yes" : "NO");
+    }
+    return all_agree ? 0 : 1;
+}
@@ -0,0 +1,38 @@
+#!/bin/sh
+# A worker that stops answering mid render (SIGSTOP) has to lose its band to another worker, and the image has to
+# come out the same as a single process render. Run by ctest (CMakeLists.txt) from the build directory.
+# Usage: stalled_worker_check.sh ray-tracer image_diff scene.txt
+rt=$1
+diff=$2
+scene=$3
+set -- --set samples_per_pix 40 --set image_width 200
+
+"$rt" "$scene" "$@" --set output_path stalled_single.pfm 2>/dev/null || exit 1
+
+"$rt" "$scene" "$@" --set output_path stalled_merged.pfm --coordinate --spawn 3 --band-timeout 2 \
+    2>stalled_coordinator.log &
+coordinator=$!
+
+# Stop the first worker once it has connected and has had time to take a band
+worker=
+for attempt in $(seq 100); do
+    worker=$(pgrep -P "$coordinator" | head -n 1)
+    [ -n "$worker" ] && grep -q "bands of" stalled_coordinator.log && break
+    sleep 0.05
+done
+if [ -z "$worker" ]; then
+    echo "No worker to stop"
+    kill "$coordinator"
+    exit 1
+fi
+sleep 0.3
+kill -STOP "$worker"
+echo "Stopped worker $worker"
+
+wait "$coordinator"
+status=$?
+kill -KILL "$worker" 2>/dev/null
+cat stalled_coordinator.log
+[ "$status" -eq 0 ] || exit 1
+grep -q "no answer in" stalled_coordinator.log || { echo "The stopped worker's band was never handed on"; exit 1; }
+"$diff" stalled_single.pfm stalled_merged.pfm
@@ -0,0 +1,122 @@
+// Microbenchmarks of the square to shape mappings in vec3.h against the rejection loops they replaced.
+//   draw    ns per sample including its pcg32 numbers, one after another like a path tracer's bounces
+//   batch   the closed forms over precomputed numbers in structure of arrays buffers, the way a wavefront stage
+//           would run them (no rejection loop can, its trip count differs per lane)
+// The check column is there to show both versions sample the same distribution: mean z of sphere directions (0),
+// mean r^2 on the disk (1/2), mean cosine to the normal of diffuse bounces (2/3).
+// Usage: warp_bench [--n samples]   (default 1 << 24)
+
+#include "../rtweekend.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using bench_clock = std::chrono::steady_clock;
+
+static double seconds_since(bench_clock::time_point start) {
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+static double sink = 0; // Every component of every sample goes in, so none of the work can be dropped
+
+// Runs sample(k) for k < n and returns ns per call, check gets the mean of measure() of the samples
+template <typename F, typename M>
+static double time_draws(int n, double& check, F sample, M measure) {
+    double sum = 0;
+    vec3 all(0, 0, 0);
+    auto start = bench_clock::now();
+    for (int k = 0; k < n; k++) {
+        vec3 p = sample(k);
+        sum += measure(p, k);
+        all += p;
+    }
+    double seconds = seconds_since(start);
+    sink += all.x() + all.y() + all.z();
+    check = sum / n;
+    return seconds / n * 1e9;
+}
+
+static void row(const char* name, double draw_ns, double batch_ns, double check) {
+    if (batch_ns > 0) { std::printf("%-28s %8.2f %8.2f %10.5f\n", name, draw_ns, batch_ns, check); }
+    else { std::printf("%-28s %8.2f %8s %10.5f\n", name, draw_ns, "-", check); }
+}
+
+int main(int argc, char** argv) {
+    int n = 1 << 24;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "--n" && a + 1 < argc) { n = std::atoi(argv[++a]); }
+        else {
+            std::fprintf(stderr, "Usage: warp_bench [--n samples]\n");
+            return 2;
+        }
+    }
+
+    // Normals of random orientation, cycled through so no branch can learn them
+    const int normal_count = 1024;
+    std::vector<vec3> normals;
+    pcg32 setup(7, 1);
+    for (int k = 0; k < normal_count; k++) { normals.push_back(random_unit_vector(setup)); }
+
+    // Batch inputs and outputs
+    const int batch = 4096;
+    std::vector<double> u(batch), v(batch);
+    std::vector<real> x(batch), y(batch), z(batch);
+    for (int k = 0; k < batch; k++) {
+        u[k] = random_double(setup);
+        v[k] = random_double(setup);
+    }
+    auto time_batch = [&](auto map) { // ns per element, over enough rounds to cover n elements
+        int rounds = std::max(1, n / batch);
+        auto start = bench_clock::now();
+        for (int r = 0; r < rounds; r++) {
+            for (int k = 0; k < batch; k++) {
+                vec3 p = map(k);
+                x[k] = p.x(); y[k] = p.y(); z[k] = p.z();
+            }
+            u[r % batch] += 1e-9; // Keeps the rounds from being folded into one
+        }
+        return seconds_since(start) / (double(rounds) * batch) * 1e9;
+    };
+
+    std::printf("%d samples, sizeof(real) %zu\n", n, sizeof(real));
+    std::printf("%-28s %8s %8s %10s\n", "", "draw ns", "batch ns", "check");
+    double check;
+
+    pcg32 rng(1, 2);
+    auto z_of = [](const vec3& p, int) { return double(p.z()); };
+    double old_ns = time_draws(n, check, [&](int) { return random_unit_vector_rejection(rng); }, z_of);
+    row("unit vector, rejection", old_ns, 0, check);
+    double new_ns = time_draws(n, check, [&](int) { return random_unit_vector(rng); }, z_of);
+    double batch_ns = time_batch([&](int k) { return sphere_from_square(u[k], v[k]); });
+    row("unit vector, spherical", new_ns, batch_ns, check);
+    std::printf("  %.2fx faster per draw\n", old_ns / new_ns);
+
+    auto r2_of = [](const vec3& p, int) { return double(p.length_squared()); };
+    old_ns = time_draws(n, check, [&](int) { return random_in_unit_disk_rejection(rng); }, r2_of);
+    row("disk, rejection", old_ns, 0, check);
+    new_ns = time_draws(n, check, [&](int) { return random_in_unit_disk(rng); }, r2_of);
+    batch_ns = time_batch([&](int k) { return disk_from_square(u[k], v[k]); });
+    row("disk, concentric", new_ns, batch_ns, check);
+    std::printf("  %.2fx faster per draw\n", old_ns / new_ns);
+
+    auto cosine_of = [&](const vec3& p, int k) { return double(dot(p, normals[k % normal_count])); };
+    old_ns = time_draws(n, check, [&](int k) { // What lambertian did
+        return unit_vector(normals[k % normal_count] + random_unit_vector_rejection(rng));
+    }, cosine_of);
+    row("diffuse, normal + rejection", old_ns, 0, check);
+    new_ns = time_draws(n, check, [&](int k) {
+        double a = random_double(rng);
+        double b = random_double(rng);
+        return cosine_direction(normals[k % normal_count], a, b);
+    }, cosine_of);
+    batch_ns = time_batch([&](int k) { return cosine_direction(normals[k % normal_count], u[k], v[k]); });
+    row("diffuse, cosine hemisphere", new_ns, batch_ns, check);
+    std::printf("  %.2fx faster per draw\n", old_ns / new_ns);
+
+    for (int k = 0; k < batch; k++) { sink += x[k] + y[k] + z[k]; }
+    std::printf("(sum of everything drawn %.3f)\n", sink);
+}
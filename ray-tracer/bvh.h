@@ -0,0 +1,165 @@
+#pragma once
+#ifndef BVH_H
+#define BVH_H
+
+#include <algorithm>
+#include <vector>
+
+#include "aabb.h"
+#include "hittable.h"
+#include "hittable_list.h"
+
+// Both partitions work on owning (shared_ptr) and arena (plain pointer) object lists
+template <typename object_ptr>
+size_t median_partition(std::vector<object_ptr>& objects, size_t start, size_t end) {
+    // Halves [start, end) by count along the longest axis of the centroids. Always balanced, never one sided.
+    aabb centroid_bounds;
+    for (size_t i = start; i < end; i++) {
+        auto c = objects[i]->bounding_box().centroid();
+        centroid_bounds = aabb(centroid_bounds, aabb(c, c));
+    }
+
+    int axis = centroid_bounds.longest_axis();
+    size_t mid = start + (end - start) / 2;
+    std::nth_element(objects.begin() + start, objects.begin() + mid, objects.begin() + end,
+        [axis](const object_ptr& a, const object_ptr& b) {
+            return a->bounding_box().centroid()[axis] < b->bounding_box().centroid()[axis];
+        });
+    return mid;
+}
+
+// Surface area heuristic split with binning.
+// Object centroids are dropped into sah_bins buckets along each axis and every plane between two buckets is
+// scored with cost = area(left) * count(left) + area(right) * count(right), i.e. the expected number of
+// primitive tests for a ray that hits the parent. Objects in [start, end) are reordered around the cheapest
+// plane and the index of the first object on the right side is returned.
+const int sah_bins = 12;
+
+template <typename object_ptr>
+size_t sah_partition(std::vector<object_ptr>& objects, size_t start, size_t end) {
+    aabb centroid_bounds;
+    for (size_t i = start; i < end; i++) {
+        auto c = objects[i]->bounding_box().centroid();
+        centroid_bounds = aabb(centroid_bounds, aabb(c, c));
+    }
+
+    int best_axis = -1;
+    int best_split = 0;
+    double best_cost = infinity;
+
+    for (int axis = 0; axis < 3; axis++) {
+        const interval& extent = centroid_bounds.axis_interval(axis);
+        if (extent.size() <= 0) { continue; } // Every centroid on one plane, nothing to split along here
+
+        aabb bin_bounds[sah_bins];
+        size_t bin_count[sah_bins] = {};
+        double scale = sah_bins / extent.size();
+
+        for (size_t i = start; i < end; i++) {
+            auto box = objects[i]->bounding_box();
+            int b = std::min(sah_bins - 1, int((box.centroid()[axis] - extent.min) * scale));
+            bin_bounds[b] = aabb(bin_bounds[b], box);
+            bin_count[b]++;
+        }
+
+        // Sweep from the right to get the right side of every plane, then from the left to score them
+        double right_area[sah_bins];
+        size_t right_count[sah_bins];
+        aabb acc;
+        size_t n = 0;
+        for (int b = sah_bins - 1; b > 0; b--) {
+            acc = aabb(acc, bin_bounds[b]);
+            n += bin_count[b];
+            right_area[b] = acc.surface_area();
+            right_count[b] = n;
+        }
+
+        acc = aabb();
+        n = 0;
+        for (int b = 0; b < sah_bins - 1; b++) { // Plane between bin b and b+1
+            acc = aabb(acc, bin_bounds[b]);
+            n += bin_count[b];
+            double cost = acc.surface_area() * n + right_area[b + 1] * right_count[b + 1];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = b;
+            }
+        }
+    }
+
+    if (best_axis >= 0) {
+        const interval& extent = centroid_bounds.axis_interval(best_axis);
+        double scale = sah_bins / extent.size();
+        auto first_right = std::partition(objects.begin() + start, objects.begin() + end,
+            [&](const object_ptr& obj) {
+                int b = std::min(sah_bins - 1, int((obj->bounding_box().centroid()[best_axis] - extent.min) * scale));
+                return b <= best_split;
+            });
+        size_t split = size_t(first_right - objects.begin());
+        if (split != start && split != end) {
+            return split;
+        }
+    }
+
+    // Identical centroids or a one sided split: fall back to halving by count
+    return median_partition(objects, start, end);
+}
+
+class bvh_node : public hittable {
+public:
+    bvh_node(hittable_list list) : bvh_node(list.objects, 0, list.objects.size()) {}
+
+    bvh_node(std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end) {
+        for (size_t i = start; i < end; i++) {
+            bbox = aabb(bbox, objects[i]->bounding_box());
+        }
+
+        size_t span = end - start;
+        if (span == 0) {
+            return; // Empty scene, hit() always misses
+        }
+        else if (span == 1) {
+            left = right = objects[start];
+        }
+        else if (span == 2) {
+            left = objects[start];
+            right = objects[start + 1];
+        }
+        else {
+            size_t mid = sah_partition(objects, start, end);
+            left = make_shared<bvh_node>(objects, start, mid);
+            right = make_shared<bvh_node>(objects, mid, end);
+        }
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (!left || !bbox.hit(r, ray_t)) {
+            return false;
+        }
+
+        bool hit_left = left->hit(r, ray_t, rec);
+        if (right == left) {
+            return hit_left;
+        }
+        bool hit_right = right->hit(r, interval(ray_t.min, hit_left ? rec.t : ray_t.max), rec); // Only closer hits on the right
+
+        return hit_left || hit_right;
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        if (!left || !bbox.hit(r, ray_t)) {
+            return false;
+        }
+        return left->occluded(r, ray_t) || (right != left && right->occluded(r, ray_t));
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+private:
+    shared_ptr<hittable> left;
+    shared_ptr<hittable> right;
+    aabb bbox;
+};
+
+#endif
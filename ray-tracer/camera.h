@@ -2,11 +2,48 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
-#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "accumulation.h"
+#include "denoise.h"
+#include "framebuffer.h"
 #include "hittable.h"
+#include "image_io.h"
+#include "lights.h"
 #include "material.h"
+#include "roulette.h"
+#include "sampler.h"
+#include "thread_pool.h"
+#include "wavefront.h"
+
+enum class integrator_type {
+    recursive, // ray_color, one sample at a time
+    iterative, // path_color, one sample at a time with the throughput carried forward and Russian roulette
+    wavefront // wavefront_integrator, all samples of a tile bounce by bounce, with Russian roulette
+};
 
-std::ofstream fout("img2.ppm");
+// What the last render() did
+struct render_stats {
+    uint64_t primary_rays = 0; // One per sample
+    uint64_t secondary_rays = 0; // Every bounce after the first
+    uint64_t shadow_rays = 0; // Toward lights, any hit only (lights.h)
+    double render_seconds = 0; // Tracing, all passes
+    double output_seconds = 0; // Resolving the accumulation buffer and writing the image
+    double aov_seconds = 0; // Tracing the denoiser's albedo, normal and depth buffers
+    double denoise_seconds = 0;
+    wavefront_stats stages; // Summed over threads, only filled in by the wavefront integrator
+
+    uint64_t rays() const { return primary_rays + secondary_rays + shadow_rays; }
+    double rays_per_second() const { return render_seconds > 0 ? rays() / render_seconds : 0; }
+    double mean_path_length() const { // Rays per sample, shadow rays aside
+        return primary_rays ? double(primary_rays + secondary_rays) / primary_rays : 0;
+    }
+};
 
 class camera {
 public:
@@ -14,12 +51,71 @@ public:
     int image_width = 100; // in pixel cnt
     int samples_per_pix = 100; // Self explanatory
     int max_depth = 10; // Number of recursive ray bounces  for each ray sent out
+    int thread_count = 1; // Render threads, 0 uses every hardware thread
+    int tile_size = 16; // Side of the square blocks of pixels handed out to the threads
+    int frame = 0; // Frame number, mixed into every sample's seed so consecutive frames don't share noise
+    integrator_type integrator = integrator_type::recursive;
+
+    // Russian roulette for the iterative and wavefront integrators (see roulette.h), recursive always runs every
+    // path to max_depth
+    bool russian_roulette = true;
+    int roulette_depth = 3; // Rays every path traces before roulette can end it
+    double roulette_max_survival = 0.95;
+
+    // Where samples get their random numbers (sampler.h). random is plain pcg32 numbers; stratified, sobol and
+    // blue_noise spread each pixel's samples evenly and reach the same noise with fewer of them.
+    sampler_type sampler = sampler_type::random;
+
+    // Lights to aim shadow rays at from diffuse hits (next event estimation, lights.h), set by scene::build. Null or
+    // empty for a scene lit only by the sky; with next_event off lights are only found by paths that hit them.
+    const light_list* lights = nullptr;
+    bool next_event = true;
+    double sky_brightness = 1; // Scales the sky, 0 leaves only the scene's own lights
+
+    std::string output_path = "img2.ppm"; // Where render() writes the image, empty to only keep it in memory
+    image_format output_format = image_format::from_extension;
 
     double vfov = 90; // Vertical view angle
     point3 lookfrom = point3(0, 0, 0);
     point3 lookat = point3(0, 0, -1);
     vec3 viewup = vec3(0, 1, 0);
 
+    // Progressive mode renders in passes of samples_per_pass until every pixel has samples_per_pix samples or
+    // time_budget runs out. Progress is saved to checkpoint_path, and a later run with the same settings picks up
+    // from there.
+    bool progressive = false;
+    int samples_per_pass = 4;
+    double time_budget = 0; // Seconds, 0 for no limit
+    std::string checkpoint_path; // Empty for no checkpoints
+    double checkpoint_interval = 30; // Seconds between checkpoint saves
+
+    // Adaptive sampling gives every pixel adaptive_min_samples, then keeps adding samples_per_pass at a time only to
+    // pixels whose mean is still uncertain: ones where the standard error of the mean luminance is above
+    // adaptive_threshold times the luminance (flat sky converges in a few samples, glass and shadows don't).
+    // samples_per_pix is the most a pixel gets.
+    bool adaptive = false;
+    double adaptive_threshold = 0.05;
+    int adaptive_min_samples = 16;
+    std::string heatmap_path; // Samples per pixel as a grayscale image, white is samples_per_pix. Empty for none.
+
+    // Denoising (denoise.h) runs once the samples are in: the camera rays are traced again for the albedo, normal and
+    // depth of what they hit first (AOVs, arbitrary output values), and an À-trous filter guided by those smooths
+    // the image before it is written. The samples themselves are kept as they were. Not done on the bands of a
+    // distributed render, the coordinator has no world to trace the AOVs in.
+    bool denoise = false;
+    int denoise_iterations = 5;
+    double denoise_sigma_luminance = 4;
+    double denoise_sigma_normal = 128;
+    double denoise_sigma_depth = 1;
+    std::string aov_path; // Writes the AOVs next to it, "aov.pfm" as aov_albedo.pfm, aov_normal.pfm and so on
+
+    // For a caller that shows the image as it forms (preview.h): on_pass gets the image so far and the samples every
+    // pixel has after each pass, cancel is looked at before every tile and ends the render early once it's set (the
+    // rest of render() still runs, over what was done). verbose off keeps progress and statistics off std::clog.
+    std::function<void(const framebuffer&, int)> on_pass;
+    const std::atomic<bool>* cancel = nullptr;
+    bool verbose = true;
+
     double defocus_angle = 0; // Variation of angle of rays through each pixel
     double focus_dist = 10; // Distance to perfect focus plane (NOT THE image plane)
     // Here we will assume that the focus dist is the focal length (distance to image plane)
@@ -28,46 +124,152 @@ public:
 	void render(const hittable& world) {
         initialize();
 
-        fout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
-
-        for (int j = 0; j < image_height; j++) {
-            std::clog << "\rScanlines remaining: " << (image_height - j) << ' ' << std::flush;
-            for (int i = 0; i < image_width; i++) {
-                auto pixel_center = pixel00_loc + (i * pixel_delta_u) + (j * pixel_delta_v);
-                auto ray_direction = pixel_center - center;
-                ray r(center, ray_direction);
-
-                color pixel_color = color(0, 0, 0);
-                for (int k = 0; k < samples_per_pix; k++) {
-                    ray r = get_ray(i, j);
-                    pixel_color += ray_color(r, max_depth, world);
-                }
+        // Tiles are rendered in any order on any thread into the accumulation buffer, which becomes the image at the end.
+        // Each sample seeds its own generator from (pixel, sample, frame) so the image doesn't depend on the thread count,
+        // nor on how the samples were split into passes or runs.
+        accum = accumulation_buffer(image_width, image_height);
+        if (progressive && !checkpoint_path.empty() && accum.load(checkpoint_path, frame) && verbose) {
+            std::clog << "Resuming from " << checkpoint_path << " at " << accum.min_samples() << " samples per pixel\n";
+        }
 
-                write_color(fout, pixel_sample_scale*pixel_color);
+        work_stealing_pool pool(thread_count);
+        std::vector<wavefront_integrator> wavefronts(integrator == integrator_type::wavefront ? pool.size() : 0);
+        stats = render_stats();
+        rays_traced = 0;
+        shadow_traced = 0;
+        uint64_t samples_before = accum.total_samples();
+
+        auto start = std::chrono::steady_clock::now();
+        auto last_checkpoint = start;
+        auto seconds_since = [](std::chrono::steady_clock::time_point t) {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+        };
+
+        // Without progressive or adaptive mode this is a single pass of every sample
+        pass_samples = (progressive || adaptive) ? std::max(1, samples_per_pass) : samples_per_pix;
+        for (int pass = 1; pixels_wanting_samples() > 0; pass++) {
+            if (progressive && time_budget > 0 && seconds_since(start) >= time_budget) { break; }
+
+            render_pass(world, pool, wavefronts);
+            if (cancelled()) { break; }
+            if (on_pass) { on_pass(accum.resolve(), int(accum.min_samples())); }
+
+            if ((progressive || adaptive) && verbose) {
+                std::clog << "\rPass " << pass << ": " << accum.min_samples() << '/' << samples_per_pix
+                          << " samples per pixel, " << pixels_wanting_samples() << " pixels unconverged, "
+                          << seconds_since(start) << " s " << std::flush;
+            }
+            if (progressive && !checkpoint_path.empty() && seconds_since(last_checkpoint) >= checkpoint_interval) {
+                accum.save(checkpoint_path, frame);
+                last_checkpoint = std::chrono::steady_clock::now();
             }
         }
+        if (progressive && !checkpoint_path.empty()) {
+            accum.save(checkpoint_path, frame);
+        }
+        stats.render_seconds = seconds_since(start);
+        aovs = aov_buffers();
+        if ((denoise || !aov_path.empty()) && band_end < 0 && !cancelled()) {
+            stats.aov_seconds = trace_aovs(world, pool);
+        }
+        stats.output_seconds = write_output();
+
+        for (const auto& w : wavefronts) {
+            stats.stages.add(w.stats);
+        }
+        if (!wavefronts.empty()) {
+            rays_traced = stats.stages.items[wavefront_stats::intersect]; // One intersect item is one ray
+            shadow_traced = stats.stages.items[wavefront_stats::shadow];
+        }
+        stats.primary_rays = accum.total_samples() - samples_before;
+        stats.secondary_rays = rays_traced - stats.primary_rays;
+        stats.shadow_rays = shadow_traced;
+        if (adaptive && !heatmap_path.empty()) {
+            write_image(sample_heatmap(), heatmap_path, image_format::from_extension);
+        }
+        if (!verbose) { return; }
 
         std::clog << "\rDone.                 \n";
+        std::clog << stats.primary_rays << " primary and " << stats.secondary_rays << " secondary rays";
+        if (stats.shadow_rays > 0) { std::clog << " and " << stats.shadow_rays << " shadow rays"; }
+        std::clog << " in " << stats.render_seconds << " s, " << stats.rays_per_second() / 1e6 << " M rays/s, "
+                  << stats.mean_path_length() << " rays per path\n";
+        if (denoise && !aovs.empty()) {
+            std::clog << "Denoised in " << stats.denoise_seconds << " s after " << stats.aov_seconds
+                      << " s tracing AOVs\n";
+        }
+
+        if (adaptive) {
+            uint64_t uniform = uint64_t(image_width) * image_height * samples_per_pix;
+            std::clog << "Adaptive: " << accum.total_samples() << " samples, " << 100.0 * accum.total_samples() / uniform
+                      << "% of " << samples_per_pix << " per pixel everywhere\n";
+        }
+
+        if (!wavefronts.empty()) {
+            const wavefront_stats& total = stats.stages;
+            for (int stage = 0; stage < wavefront_stats::stage_count; stage++) { // Summed over threads
+                std::clog << wavefront_stats::stage_name(stage) << ": " << total.items[stage] << " paths in "
+                          << total.seconds[stage] << " s, " << total.items[stage] / total.seconds[stage] / 1e6
+                          << " M paths/s\n";
+            }
+        }
 	}
 
+    int height() const { return std::max(1, int(image_width / aspect_ratio)); } // In pixels
+
+    // For distributed rendering (distributed.h): a worker renders bands of rows, which only fills in those rows of
+    // samples(), and the coordinator adds the bands up and hands them to present(), which writes the image the same
+    // as render() would have.
+    void render_rows(const hittable& world, int y0, int y1) {
+        band_begin = y0;
+        band_end = y1;
+        render(world);
+        band_begin = 0;
+        band_end = -1;
+    }
+
+    void present(const accumulation_buffer& merged) {
+        accum = merged;
+        stats.output_seconds = write_output();
+    }
+
+    const framebuffer& image() const { return film; } // Linear colors of the last render, denoised if asked to
+    const aov_buffers& outputs() const { return aovs; } // Empty unless denoise or aov_path was set
+    const accumulation_buffer& samples() const { return accum; } // Sums and sample counts behind it
+    const render_stats& statistics() const { return stats; }
+
 private:
     int image_height; // in px
+    int band_begin = 0; // Rows render_rows asked for, band_end -1 for the whole image
+    int band_end = -1;
+    int row_begin, row_end; // The rows render() covers, from the band
     point3 center; // coordinates of camera center
     point3 pixel00_loc; // pixel 0,0 in image .... top left
     vec3 pixel_delta_u; // right offset
     vec3 pixel_delta_v; // down offset
-    double pixel_sample_scale; // scaling factor for pixel color otherwise color wouldn't make sense
 
     vec3 u, v, w; // u is right, v up, w into
 
     vec3 defocus_disk_u; // horz. disk rad
     vec3 defocus_disk_v; // vert. disk rad
 
+    accumulation_buffer accum;
+    framebuffer film;
+    aov_buffers aovs;
+    int pass_samples; // Samples per pixel per pass
+    render_stats stats;
+    uint64_t rays_traced; // By the recursive integrator, tiles add theirs in when they finish
+    uint64_t shadow_traced;
+    const light_list* sampled_lights; // lights when next event estimation is on and there are any, else null
+
+    static constexpr int aov_max_samples = 16; // Plenty to antialias the AOVs' edges, however many the image took
+
 
 	void initialize() {
-        image_height = int(image_width / aspect_ratio);
-        image_height = (image_height < 1) ? 1 : image_height;
-        pixel_sample_scale = 1.0 / samples_per_pix;
+        image_height = height();
+        row_begin = std::max(0, band_begin);
+        row_end = (band_end < 0 || band_end > image_height) ? image_height : band_end;
+        sampled_lights = (next_event && lights && !lights->empty()) ? lights : nullptr;
 
         center = lookfrom;
 
@@ -103,51 +305,338 @@ private:
         defocus_disk_v = defocus_radius * v;
 	}
 
-    ray get_ray(int i, int j) const {
+    int samples_wanted(int i, int j) const {
+        // How many samples the pixel gets in the next pass
+        if (j < row_begin || j >= row_end) { return 0; }
+        int n = int(accum.samples(i, j));
+        if (n >= samples_per_pix) { return 0; }
+        if (!adaptive) { return std::min(pass_samples, samples_per_pix - n); }
+
+        int min_samples = std::min(std::max(2, adaptive_min_samples), samples_per_pix);
+        if (n < min_samples) { return min_samples - n; }
+
+        double error = accum.standard_error(i, j);
+        double tolerance = adaptive_threshold * std::fmax(accum.mean_luminance(i, j), 1e-3); // Floor so black converges
+        if (error <= tolerance) { return 0; }
+        return std::min(pass_samples, samples_per_pix - n);
+    }
+
+    int pixels_wanting_samples() const {
+        int wanting = 0;
+        for (int j = row_begin; j < row_end; j++) {
+            for (int i = 0; i < image_width; i++) {
+                wanting += (samples_wanted(i, j) > 0);
+            }
+        }
+        return wanting;
+    }
+
+    framebuffer sample_heatmap() const {
+        // Stored squared so the gamma in the 8 bit writers turns it back into a straight samples / max ramp
+        framebuffer heat(image_width, image_height);
+        for (int j = 0; j < image_height; j++) {
+            for (int i = 0; i < image_width; i++) {
+                double fraction = double(accum.samples(i, j)) / samples_per_pix;
+                heat.set(i, j, color(1, 1, 1) * (fraction * fraction));
+            }
+        }
+        return heat;
+    }
+
+    void render_pass(const hittable& world, work_stealing_pool& pool, std::vector<wavefront_integrator>& wavefronts) {
+        // Adds the next samples_wanted() samples to every pixel
+        // Tiles stay on the whole image's grid when only some rows are rendered, so every pixel is in the same tile
+        // as in a full render and gets the same samples summed in the same order
+        int tiles_x = (image_width + tile_size - 1) / tile_size;
+        int first_tile_row = row_begin / tile_size;
+        int tiles_y = (row_end + tile_size - 1) / tile_size - first_tile_row;
+        int tile_count = tiles_x * tiles_y;
+        std::atomic<int> tiles_done(0);
+        std::atomic<uint64_t> rays(0), shadow_rays(0);
+
+        pool.run(tile_count, [&](int tile, int worker) {
+            if (cancelled()) { return; }
+            int x0 = (tile % tiles_x) * tile_size;
+            int y0 = (first_tile_row + tile / tiles_x) * tile_size;
+            if (integrator == integrator_type::wavefront) {
+                render_tile_wavefront(x0, y0, world, wavefronts[worker]);
+            }
+            else {
+                uint64_t shadow = 0;
+                rays += render_tile(x0, y0, world, shadow);
+                shadow_rays += shadow;
+            }
+
+            int done = ++tiles_done;
+            if (!progressive && !adaptive && worker == 0 && verbose) { // Only one thread writes progress so the lines don't interleave
+                std::clog << "\rTiles remaining: " << (tile_count - done) << ' ' << std::flush;
+            }
+        });
+        rays_traced += rays;
+        shadow_traced += shadow_rays;
+    }
+
+    uint64_t render_tile(int x0, int y0, const hittable& world, uint64_t& shadow_rays) {
+        // Returns the number of rays traced, shadow rays go in shadow_rays
+        int x1 = std::min(x0 + tile_size, image_width);
+        int y1 = std::min(y0 + tile_size, image_height);
+        uint64_t rays = 0;
+        sampler_settings sampling = samples_from();
+
+        for (int j = y0; j < y1; j++) {
+            for (int i = x0; i < x1; i++) {
+                int samples = samples_wanted(i, j);
+                if (samples == 0) { continue; }
+
+                color pixel_color = color(0, 0, 0);
+                double luminance_sq = 0;
+                uint32_t pixel = uint32_t(j) * image_width + i;
+                int first = int(accum.samples(i, j));
+                for (int k = first; k < first + samples; k++) {
+                    path_sampler sampler(sampling, i, j, pixel, uint32_t(k));
+                    ray r = get_ray(i, j, sampler);
+                    color sample = (integrator == integrator_type::iterative)
+                                       ? path_color(r, world, sampler, rays, shadow_rays)
+                                       : ray_color(r, max_depth, world, sampler, rays, shadow_rays);
+                    pixel_color += sample;
+                    luminance_sq += luminance(sample) * luminance(sample);
+                }
+
+                accum.add(i, j, pixel_color, luminance_sq, samples);
+            }
+        }
+        return rays;
+    }
+
+    void render_tile_wavefront(int x0, int y0, const hittable& world, wavefront_integrator& wavefront) {
+        int x1 = std::min(x0 + tile_size, image_width);
+        int y1 = std::min(y0 + tile_size, image_height);
+        int tile_w = x1 - x0;
+
+        std::vector<int> first, count;
+        for (int j = y0; j < y1; j++) {
+            for (int i = x0; i < x1; i++) {
+                first.push_back(int(accum.samples(i, j)));
+                count.push_back(samples_wanted(i, j));
+            }
+        }
+
+        std::vector<color> sums;
+        std::vector<double> sq_sums;
+        wavefront.render_tile(x0, y0, x1, y1, image_width, first, count, max_depth, roulette(), samples_from(),
+            world, sampled_lights, [this](int i, int j, path_sampler& sampler) { return get_ray(i, j, sampler); },
+            [this](const ray& r) { return background(r); },
+            sums, sq_sums);
+
+        for (int j = y0; j < y1; j++) {
+            for (int i = x0; i < x1; i++) {
+                size_t local = size_t(j - y0) * tile_w + (i - x0);
+                if (count[local] > 0) {
+                    accum.add(i, j, sums[local], sq_sums[local], count[local]);
+                }
+            }
+        }
+    }
+
+    ray get_ray(int i, int j, path_sampler& sampler) const {
         // Get a ray that points to a random sample point around pixel (i,j)
         // Ray is also a sample of points from the defocus disk.
         
-        auto offset = sample_square();
+        auto offset = sample_square(sampler);
         auto pixel_sample = pixel00_loc +
             pixel_delta_u * (i + offset.x()) +
             pixel_delta_v * (j + offset.y());
 
-        point3 ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample(); 
+        point3 ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample(sampler);
         vec3 ray_direction = pixel_sample - ray_origin;
         return ray(ray_origin, ray_direction);
     }
 
-    vec3 defocus_disk_sample() const {
+    vec3 defocus_disk_sample(path_sampler& sampler) const {
         // Return a ray from the defocus disk of the camera
-        vec3 r = random_in_unit_disk_rejection();
+        double a, b;
+        sampler.next_2d(a, b);
+        vec3 r = disk_from_square(a, b); // Keeps the square's stratification, rejection wouldn't
         return center + (r[0] * defocus_disk_u) + (r[1] * defocus_disk_v); // Change unit disk to unit disk in proper basis.
     }
 
-    vec3 sample_square() const { // Note: look into other sampling methods
+    vec3 sample_square(path_sampler& sampler) const {
         // Vector to random point in a square region centered at the pixel that extends halfway to the 4 neighbor pixels
         // [-.5 to .5, -.5 to .5] unit square
-        return vec3(random_double() - 0.5, random_double() - 0.5, 0);
+        double x, y;
+        sampler.next_2d(x, y);
+        return vec3(x - 0.5, y - 0.5, 0);
     }
 
-    color ray_color(const ray& r, int depth, const hittable& world) {
+    color ray_color(const ray& r, int depth, const hittable& world, path_sampler& sampler, uint64_t& rays,
+                    uint64_t& shadow_rays, real scatter_pdf = 0) const {
+        // scatter_pdf is the density the bounce before picked r with, for weighting a light r hits (lights.h)
         if (depth <= 0) {
             return color(0, 0, 0);
         }
 
+        rays++;
         hit_record rec;
         if (world.hit(r, interval(0.001, infinity), rec)) { // 0.001 to remove shadow acne where ray origin isn't flush with surface due to rounding errors
+            color light = emitted_light(sampled_lights, r, rec, scatter_pdf);
+            if (sampled_lights && rec.mat->samples_lights()) {
+                light += sampled_lights->direct(rec, world, sampler, shadow_rays);
+            }
             ray scattered;
             color attenuation;
-            if (rec.mat->scatter(r, rec, attenuation, scattered)) {
-                return attenuation * ray_color(scattered, depth-1, world); // Each bounce means a loss of x% of color
+            if (rec.mat->scatter(r, rec, attenuation, scattered, sampler)) {
+                real pdf = sampled_lights ? rec.mat->scatter_pdf(rec, unit_vector(scattered.direction())) : 0;
+                return light + attenuation * ray_color(scattered, depth-1, world, sampler, rays, shadow_rays, pdf); // Each bounce means a loss of x% of color
             }
-            return color(0, 0, 0); // No scatter = absorbed and black 
+            return light; // No scatter = absorbed, black unless it glows
+        }
+
+        return background(r);
+    }
+
+    double write_output() {
+        // Resolves the samples into the image, denoised if there are AOVs to guide it, and writes it if there is a
+        // path. Returns the seconds it took, those of the denoiser aside.
+        auto start = std::chrono::steady_clock::now();
+        double denoise_seconds = 0;
+        if (denoise && !aovs.empty()) {
+            film = atrous_denoiser(denoising()).denoise(accum, aovs);
+            denoise_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            stats.denoise_seconds = denoise_seconds;
+        }
+        else {
+            film = accum.resolve();
+        }
+        if (!output_path.empty()) {
+            write_image(film, output_path, output_format);
         }
+        if (!aov_path.empty() && !aovs.empty()) {
+            write_image(aovs.albedo, aov_output_path(aov_path, "albedo"), image_format::from_extension);
+            write_image(aovs.emission, aov_output_path(aov_path, "emission"), image_format::from_extension);
+            write_image(aovs.normal, aov_output_path(aov_path, "normal"), image_format::from_extension);
+            write_image(aovs.depth, aov_output_path(aov_path, "depth"), image_format::from_extension);
+        }
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() - denoise_seconds;
+    }
+
+    double trace_aovs(const hittable& world, work_stealing_pool& pool) {
+        // What the first aov_max_samples camera rays of every pixel hit, the same rays its first samples started
+        // with. Returns the seconds it took.
+        auto start = std::chrono::steady_clock::now();
+        aovs.albedo = framebuffer(image_width, image_height);
+        aovs.emission = framebuffer(image_width, image_height);
+        aovs.normal = framebuffer(image_width, image_height);
+        aovs.depth = framebuffer(image_width, image_height);
+        sampler_settings sampling = samples_from();
+
+        pool.run(image_height, [&](int j, int) {
+            for (int i = 0; i < image_width; i++) {
+                int samples = std::min(std::max(1, int(accum.samples(i, j))), aov_max_samples);
+                uint32_t pixel = uint32_t(j) * image_width + i;
+                color albedo(0, 0, 0), emission(0, 0, 0);
+                vec3 normal(0, 0, 0);
+                double depth = 0;
+                int hits = 0;
+                for (int k = 0; k < samples; k++) {
+                    path_sampler sampler(sampling, i, j, pixel, uint32_t(k));
+                    ray r = get_ray(i, j, sampler);
+                    hit_record rec;
+                    if (world.hit(r, interval(0.001, infinity), rec)) {
+                        albedo += rec.mat->albedo();
+                        emission += rec.mat->emitted(rec); // In full, as camera rays always see lights
+                        normal += rec.normal;
+                        depth += rec.t * r.direction().length();
+                        hits++;
+                    }
+                    else {
+                        albedo += color(1, 1, 1);
+                        emission += background(r);
+                    }
+                }
+                aovs.albedo.set(i, j, albedo / real(samples));
+                aovs.emission.set(i, j, emission / real(samples));
+                aovs.normal.set(i, j, normal.near_zero() ? normal : unit_vector(normal));
+                aovs.depth.set(i, j, color(1, 1, 1) * (hits ? depth / hits : 0));
+            }
+        });
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    denoise_settings denoising() const {
+        denoise_settings settings;
+        settings.iterations = denoise_iterations;
+        settings.sigma_luminance = denoise_sigma_luminance;
+        settings.sigma_normal = denoise_sigma_normal;
+        settings.sigma_depth = denoise_sigma_depth;
+        settings.thread_count = thread_count;
+        return settings;
+    }
+
+    color path_color(const ray& camera_ray, const hittable& world, path_sampler& sampler, uint64_t& rays,
+                     uint64_t& shadow_rays) const {
+        // ray_color as a loop: the attenuations so far are multiplied into the throughput on the way out instead of
+        // on the way back, which is what lets roulette end a path (and rescale it) in the middle. What the path
+        // gathers on the way, from lights it hits and the shadow rays it sends, adds up in radiance.
+        // Uses the sampler in the same order as the wavefront integrator, so the two give the same samples.
+        ray r = camera_ray;
+        roulette_settings rr = roulette();
+        color throughput(1, 1, 1);
+        color radiance(0, 0, 0);
+        real scatter_pdf = 0;
+        for (int traced = 1; traced <= max_depth; traced++) {
+            rays++;
+            hit_record rec;
+            if (!world.hit(r, interval(0.001, infinity), rec)) {
+                return radiance + throughput * background(r);
+            }
+            if (rec.mat->emits()) {
+                radiance += throughput * emitted_light(sampled_lights, r, rec, scatter_pdf);
+            }
+            if (sampled_lights && rec.mat->samples_lights()) {
+                shadow_ray s;
+                if (sampled_lights->sample(rec, sampler, s)) {
+                    shadow_rays++;
+                    if (!world.occluded(s.r, interval(0.001, s.t_max))) { radiance += throughput * s.radiance; }
+                }
+            }
+            ray scattered;
+            color attenuation;
+            if (!rec.mat->scatter(r, rec, attenuation, scattered, sampler)) {
+                return radiance;
+            }
+            scatter_pdf = sampled_lights ? rec.mat->scatter_pdf(rec, unit_vector(scattered.direction())) : 0;
+            throughput = throughput * attenuation;
+            if (!rr.survives(traced, throughput, sampler)) {
+                return radiance;
+            }
+            r = scattered;
+        }
+        return radiance; // Out of bounces
+    }
+
+    bool cancelled() const { return cancel && cancel->load(std::memory_order_relaxed); }
+
+    roulette_settings roulette() const {
+        roulette_settings rr;
+        rr.enabled = russian_roulette;
+        rr.depth = roulette_depth;
+        rr.max_survival = roulette_max_survival;
+        return rr;
+    }
+
+    sampler_settings samples_from() const {
+        sampler_settings settings;
+        settings.type = sampler;
+        settings.samples_per_pixel = samples_per_pix;
+        settings.frame = uint32_t(frame);
+        return settings;
+    }
 
+    color background(const ray& r) const {
         // Sky
         vec3 unit_direction = unit_vector(r.direction());
         auto a = 0.5 * (unit_direction.y() + 1.0);
-        return (1.0 - a) * color(1.0, 1.0, 1.0) + a * color(0.5, 0.7, 1.0);
+        return ((1.0 - a) * color(1.0, 1.0, 1.0) + a * color(0.5, 0.7, 1.0)) * sky_brightness;
     }
 };
 
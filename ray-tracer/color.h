@@ -13,22 +13,23 @@ inline double linear_to_gamma(double linear_comp) {
     return 0.0;
 }
 
+inline double luminance(const color& c) {
+    // Rec. 709 weights, how bright a linear color looks
+    return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+}
+
+inline int linear_to_byte(double linear_comp) {
+    // turn a [0,1] component to byte range [0,255]
+    static const interval intensity(0.000, 0.999);
+    return int(256 * intensity.clamp(linear_to_gamma(linear_comp)));
+}
+
 void write_color(std::ostream& out, const color& pixel_color) {
     auto r = pixel_color.x();
     auto g = pixel_color.y(); // each one of these are based on a norm vector with components in [0,1]
     auto b = pixel_color.z();
-    
-    r = linear_to_gamma(r);
-    g = linear_to_gamma(g);
-    b = linear_to_gamma(b);
-
-    // turn [0,1] components to byte range [0,255]
-    static const interval intensity(0.000, 0.999);
-    int rbyte = int(256 * intensity.clamp(r));
-    int gbyte = int(256 * intensity.clamp(g));
-    int bbyte = int(256 * intensity.clamp(b));
 
-    out << rbyte << ' ' << gbyte << ' ' << bbyte << '\n';
+    out << linear_to_byte(r) << ' ' << linear_to_byte(g) << ' ' << linear_to_byte(b) << '\n';
 }
 
 #endif
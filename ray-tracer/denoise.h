@@ -0,0 +1,238 @@
+#pragma once
+#ifndef DENOISE_H
+#define DENOISE_H
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "accumulation.h"
+#include "framebuffer.h"
+#include "thread_pool.h"
+
+// What the camera rays of every pixel hit first, averaged over them (camera::trace_aovs). Guides the denoiser and
+// can be written out next to the image.
+struct aov_buffers {
+    framebuffer albedo; // Of the first hit's material (material::albedo), white where the rays missed
+    framebuffer emission; // What the rays see without a bounce: the lights they hit and the sky
+    framebuffer normal; // Mean hit_record::normal made unit length, 0 where every ray missed
+    framebuffer depth; // Mean hit_record::t times the ray's length, in all three channels, 0 where every ray missed
+
+    bool empty() const { return albedo.width() == 0; }
+};
+
+// "out.ppm" and "albedo" make "out_albedo.ppm"
+inline std::string aov_output_path(const std::string& path, const char* name) {
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) { return path + '_' + name; }
+    return path.substr(0, dot) + '_' + name + path.substr(dot);
+}
+
+struct denoise_settings {
+    int iterations = 5; // The k-th spaces its taps 2^k pixels apart, five reach 62 pixels out
+    double sigma_luminance = 4; // Luminance edges, in standard deviations of the pixel's noise
+    double sigma_normal = 128; // Exponent on the cosine between two normals
+    double sigma_depth = 1; // Depth edges, in multiples of the change the pixel's depth gradient explains
+    int thread_count = 1; // 0 uses every hardware thread
+};
+
+// Edge avoiding À-trous wavelet filter (Dammertz et al., "Edge-Avoiding À-Trous Wavelet Transform for fast Global
+// Illumination Filtering", 2010), with the variance guided luminance edges of SVGF (Schied et al., 2017).
+// Every iteration is a 5x5 B3 spline kernel with its taps 1, 2, 4 .. pixels apart, each tap weighted down by how
+// much its normal, depth and luminance differ from the pixel's, so the blur follows surfaces and stops at their
+// edges. What the camera sees directly (lights, sky) is taken out of the color first and the rest divided by the
+// albedo, so what gets blurred is the light arriving at the surfaces: their own colors stay sharp, and a small
+// bright light doesn't smear over what's around it. Both are put back after. The luminance tolerance is the noise
+// the accumulation buffer measured in each pixel: noisy pixels are smoothed hard, converged ones barely.
+// Rows of every iteration are spread over a work_stealing_pool.
+class atrous_denoiser {
+public:
+    explicit atrous_denoiser(const denoise_settings& settings) : settings(settings) {}
+
+    framebuffer denoise(const accumulation_buffer& accum, const aov_buffers& aovs) {
+        w = accum.width();
+        h = accum.height();
+        work_stealing_pool pool(settings.thread_count);
+        size_t n = size_t(w) * h;
+        guides.assign(n, guide());
+        albedo.assign(n * 3, 0.0f);
+        light.assign(n * 3, 0.0f);
+        filtered.assign(n * 3, 0.0f);
+        variance.assign(n, 0.0f);
+        filtered_variance.assign(n, 0.0f);
+        blurred_variance.assign(n, 0.0f);
+
+        pool.run(h, [&](int j, int) { demodulate_row(accum, aovs, j); });
+        pool.run(h, [&](int j, int) { fill_in_row(j); }); // Needs every pixel's depth and light
+        for (int k = 0; k < settings.iterations; k++) {
+            pool.run(h, [&](int j, int) { blur_variance_row(j); });
+            pool.run(h, [&](int j, int) { filter_row(j, 1 << k); });
+            light.swap(filtered);
+            variance.swap(filtered_variance);
+        }
+
+        framebuffer out(w, h);
+        pool.run(h, [&](int j, int) {
+            for (int i = 0; i < w; i++) {
+                size_t p = size_t(j) * w + i;
+                out.set(i, j, color(light[p * 3 + 0] * albedo[p * 3 + 0], light[p * 3 + 1] * albedo[p * 3 + 1],
+                                    light[p * 3 + 2] * albedo[p * 3 + 2]) + aovs.emission.get(i, j));
+            }
+        });
+        return out;
+    }
+
+private:
+    struct guide {
+        float nx = 0, ny = 0, nz = 0;
+        float depth = 0; // 0 for the sky
+        float dzdx = 0, dzdy = 0; // Depth change to the next pixel, the smaller of the two sides
+    };
+
+    denoise_settings settings;
+    int w = 0, h = 0;
+    std::vector<guide> guides;
+    std::vector<float> albedo; // RGB, floored so dividing by it is safe
+    std::vector<float> light, filtered; // RGB, color over albedo, before and after an iteration
+    std::vector<float> variance, filtered_variance; // Of the luminance of light
+    std::vector<float> blurred_variance; // 3x3 Gaussian of variance, what the luminance edges go by
+
+    static constexpr float min_albedo = 0.01f;
+    static constexpr float kernel[5] = { 1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16 };
+
+    static float luminance_of(const float* rgb) { return 0.2126f * rgb[0] + 0.7152f * rgb[1] + 0.0722f * rgb[2]; }
+
+    void demodulate_row(const accumulation_buffer& accum, const aov_buffers& aovs, int j) {
+        for (int i = 0; i < w; i++) {
+            size_t p = size_t(j) * w + i;
+            color a = aovs.albedo.get(i, j);
+            color c = accum.mean(i, j) - aovs.emission.get(i, j);
+            for (int ch = 0; ch < 3; ch++) {
+                albedo[p * 3 + ch] = std::max(float(a[ch]), min_albedo);
+                light[p * 3 + ch] = float(c[ch]) / albedo[p * 3 + ch];
+            }
+            color nrm = aovs.normal.get(i, j);
+            guides[p].nx = float(nrm.x());
+            guides[p].ny = float(nrm.y());
+            guides[p].nz = float(nrm.z());
+            guides[p].depth = float(aovs.depth.get(i, j).x());
+
+            // The buffer measures the noise of the color's luminance, the light's is that much larger again
+            double se = accum.standard_error(i, j);
+            float scale = luminance_of(&albedo[p * 3]);
+            variance[p] = std::isfinite(se) ? float(se * se) / (scale * scale) : -1.0f; // -1 until fill_in_row
+        }
+    }
+
+    void fill_in_row(int j) {
+        // Depth gradients, and a variance for pixels with fewer than two samples: the spread of their 3x3
+        // neighbourhood's luminance, the best there is at one sample per pixel
+        for (int i = 0; i < w; i++) {
+            size_t p = size_t(j) * w + i;
+            guide& g = guides[p];
+            g.dzdx = depth_step(p, i > 0 ? p - 1 : p, i + 1 < w ? p + 1 : p);
+            g.dzdy = depth_step(p, j > 0 ? p - w : p, j + 1 < h ? p + w : p);
+            if (variance[p] >= 0) { continue; }
+            float sum = 0, sum_sq = 0;
+            int count = 0;
+            for (int y = std::max(0, j - 1); y <= std::min(h - 1, j + 1); y++) {
+                for (int x = std::max(0, i - 1); x <= std::min(w - 1, i + 1); x++) {
+                    float l = luminance_of(&light[(size_t(y) * w + x) * 3]);
+                    sum += l;
+                    sum_sq += l * l;
+                    count++;
+                }
+            }
+            float mean = sum / count;
+            variance[p] = std::max(0.0f, sum_sq / count - mean * mean);
+        }
+    }
+
+    float depth_step(size_t p, size_t before, size_t after) const {
+        // The smaller step over a hit neighbour, so a pixel at a silhouette keeps the gradient of its own surface
+        float z = guides[p].depth;
+        if (z <= 0) { return 0; }
+        float step = -1;
+        for (size_t q : { before, after }) {
+            if (q == p || guides[q].depth <= 0) { continue; }
+            float d = std::fabs(guides[q].depth - z);
+            step = (step < 0) ? d : std::min(step, d);
+        }
+        return std::max(step, 0.0f);
+    }
+
+    void blur_variance_row(int j) {
+        static constexpr float gauss[3] = { 0.25f, 0.5f, 0.25f };
+        for (int i = 0; i < w; i++) {
+            float sum = 0, weights = 0;
+            for (int dy = -1; dy <= 1; dy++) {
+                int y = j + dy;
+                if (y < 0 || y >= h) { continue; }
+                for (int dx = -1; dx <= 1; dx++) {
+                    int x = i + dx;
+                    if (x < 0 || x >= w) { continue; }
+                    float k = gauss[dx + 1] * gauss[dy + 1];
+                    sum += k * variance[size_t(y) * w + x];
+                    weights += k;
+                }
+            }
+            blurred_variance[size_t(j) * w + i] = sum / weights;
+        }
+    }
+
+    void filter_row(int j, int step) {
+        const float sigma_l = float(settings.sigma_luminance);
+        const float sigma_n = float(settings.sigma_normal);
+        const float sigma_z = float(settings.sigma_depth);
+        for (int i = 0; i < w; i++) {
+            size_t p = size_t(j) * w + i;
+            const guide& gp = guides[p];
+            const float* lp = &light[p * 3];
+            float luminance_p = luminance_of(lp);
+            float luminance_tolerance = sigma_l * std::sqrt(blurred_variance[p]) + 1e-6f;
+            bool sky_p = gp.depth <= 0;
+
+            float sum[3] = { 0, 0, 0 };
+            float sum_variance = 0, weights = 0;
+            for (int dy = -2; dy <= 2; dy++) {
+                int y = j + dy * step;
+                if (y < 0 || y >= h) { continue; }
+                for (int dx = -2; dx <= 2; dx++) {
+                    int x = i + dx * step;
+                    if (x < 0 || x >= w) { continue; }
+                    size_t q = size_t(y) * w + x;
+                    const guide& gq = guides[q];
+                    if (sky_p != (gq.depth <= 0)) { continue; } // Never blend sky into a surface
+                    const float* lq = &light[q * 3];
+
+                    float exponent = std::fabs(luminance_p - luminance_of(lq)) / luminance_tolerance;
+                    float weight = kernel[dx + 2] * kernel[dy + 2];
+                    if (!sky_p && q != p) {
+                        float expected = sigma_z * (gp.dzdx * std::abs(dx * step) + gp.dzdy * std::abs(dy * step))
+                                       + 1e-3f * gp.depth;
+                        exponent += std::fabs(gp.depth - gq.depth) / expected;
+                        float cosine = gp.nx * gq.nx + gp.ny * gq.ny + gp.nz * gq.nz;
+                        weight *= std::pow(std::max(cosine, 0.0f), sigma_n);
+                    }
+                    weight *= std::exp(-exponent);
+
+                    sum[0] += weight * lq[0];
+                    sum[1] += weight * lq[1];
+                    sum[2] += weight * lq[2];
+                    sum_variance += weight * weight * variance[q];
+                    weights += weight;
+                }
+            }
+            // weights > 0, the pixel's own tap is never turned down
+            float* out = &filtered[p * 3];
+            out[0] = sum[0] / weights;
+            out[1] = sum[1] / weights;
+            out[2] = sum[2] / weights;
+            filtered_variance[p] = sum_variance / (weights * weights);
+        }
+    }
+};
+
+#endif
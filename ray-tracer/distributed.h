@@ -0,0 +1,309 @@
+#pragma once
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "net.h"
+#include "scene.h"
+#include "thread_pool.h"
+
+#if !defined(_WIN32)
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Rendering one frame with several processes, on one machine or many.
+// The coordinator has the scene and cuts the image into bands of whole tile rows. Workers (ray-tracer --worker
+// host:port) connect over TCP, get the scene, and render one band at a time, sending back the band's rows of the
+// accumulation buffer, which the coordinator adds into the full image. Every sample is seeded from its pixel and
+// index alone and bands keep the tile grid, so the merged image is bit for bit what one process renders, no matter
+// which worker did which band. A band whose worker goes away, or doesn't answer within band_timeout (stopped,
+// or on a host that hangs), is handed to another one.
+//
+// Protocol, in host byte order:
+//   worker -> coordinator   "RTWK", u32 version
+//   coordinator -> worker   u64 size, the scene in the binary scene format
+//   then per band:
+//   coordinator -> worker   i32 y0, y1 (y0 < 0: nothing left, disconnect)
+//   worker -> coordinator   i32 y0, y1, u64 primary rays, u64 secondary rays, u64 size, the rows (pack_rows)
+
+const uint32_t distributed_version = 1;
+
+// The binary scene format goes through a temporary file, load and write_binary only speak FILE*
+inline bool scene_to_bytes(const scene& s, std::vector<char>& bytes) {
+    FILE* f = std::tmpfile();
+    if (!f) { return false; }
+    bool ok = s.write_binary(f) && std::fflush(f) == 0;
+    long size = ok ? std::ftell(f) : -1;
+    ok = ok && size >= 0;
+    if (ok) {
+        bytes.resize(size_t(size));
+        std::rewind(f);
+        ok = std::fread(bytes.data(), 1, bytes.size(), f) == bytes.size();
+    }
+    std::fclose(f);
+    return ok;
+}
+
+inline bool scene_from_bytes(scene& s, const std::vector<char>& bytes) {
+    FILE* f = std::tmpfile();
+    if (!f) { return false; }
+    bool ok = std::fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+    std::rewind(f);
+    ok = ok && s.load(f, "scene from the coordinator");
+    std::fclose(f);
+    return ok;
+}
+
+struct coordinator_settings {
+    uint16_t port = 0; // 0 for any free port, printed once listening
+    int band_tiles = 2; // Tile rows per band
+    int spawn = 0; // Workers to start on this machine (POSIX only), more can connect from anywhere
+    double band_timeout = 120; // Seconds a worker gets to send a band back before it is dropped
+    std::string worker_program; // What to start them as, usually argv[0]
+};
+
+class render_coordinator {
+public:
+    explicit render_coordinator(const coordinator_settings& settings) : settings(settings) {}
+
+    // Renders the scene's camera view with whatever workers connect and writes the image like camera::render.
+    // Waits for workers for as long as bands are left.
+    bool render(scene& s) {
+        listener server;
+        if (!net_startup() || !server.listen_on(settings.port)) {
+            std::cerr << "Could not listen on port " << settings.port << '\n';
+            return false;
+        }
+        std::vector<char> scene_bytes;
+        if (!scene_to_bytes(s, scene_bytes)) {
+            std::cerr << "Could not serialize the scene\n";
+            return false;
+        }
+
+        int height = s.cam.height();
+        int rows = std::max(1, settings.band_tiles) * std::max(1, s.cam.tile_size);
+        merged = accumulation_buffer(s.cam.image_width, height);
+        for (int y0 = 0; y0 < height; y0 += rows) {
+            pending.push_back({ y0, std::min(y0 + rows, height) });
+        }
+        size_t band_count = pending.size();
+        std::clog << "Coordinator on port " << server.port() << ", " << band_count << " bands of " << rows
+                  << " rows\n";
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<long> children = spawn_workers(server.port());
+
+        std::vector<std::thread> workers;
+        while (!done()) {
+            connection peer = server.accept_within(100);
+            if (peer.is_open()) {
+                int id = int(workers.size()) + 1;
+                workers.emplace_back([this, id, &scene_bytes](connection c) { serve(std::move(c), scene_bytes, id); },
+                    std::move(peer));
+            }
+        }
+        for (auto& t : workers) { t.join(); }
+        wait_for(children);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        s.cam.present(merged);
+        std::clog << "Rendered " << band_count << " bands on " << workers.size() << " workers in " << seconds
+                  << " s, " << primary << " primary and " << secondary << " secondary rays, "
+                  << (primary + secondary) / seconds / 1e6 << " M rays/s\n";
+        return true;
+    }
+
+private:
+    struct band {
+        int y0, y1;
+    };
+
+    coordinator_settings settings;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<band> pending;
+    int in_flight = 0;
+    accumulation_buffer merged;
+    uint64_t primary = 0;
+    uint64_t secondary = 0;
+
+    bool done() {
+        std::lock_guard<std::mutex> guard(lock);
+        return pending.empty() && in_flight == 0;
+    }
+
+    // Blocks until there is a band or all of them are finished, false for the latter
+    bool take(band& b) {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [this] { return !pending.empty() || in_flight == 0; });
+        if (pending.empty()) { return false; }
+        b = pending.front();
+        pending.pop_front();
+        in_flight++;
+        return true;
+    }
+
+    // Adds a finished band in, or puts it back for someone else when rows is null
+    bool finish(const band& b, const std::vector<char>* rows, uint64_t band_primary, uint64_t band_secondary) {
+        std::lock_guard<std::mutex> guard(lock);
+        bool ok = rows && merged.add_packed_rows(b.y0, b.y1, *rows);
+        if (ok) {
+            primary += band_primary;
+            secondary += band_secondary;
+        }
+        else {
+            pending.push_front(b);
+        }
+        in_flight--;
+        changed.notify_all();
+        return ok;
+    }
+
+    void serve(connection c, const std::vector<char>& scene_bytes, int id) {
+        c.set_receive_timeout(int(std::min(settings.band_timeout, 2e6) * 1000));
+        char magic[4];
+        uint32_t version = 0;
+        if (!c.recv_all(magic, 4) || std::memcmp(magic, "RTWK", 4) != 0 || !c.recv_value(version)
+            || version != distributed_version) {
+            std::cerr << "Worker " << id << " isn't a ray-tracer worker of this version, dropped\n";
+            return;
+        }
+        uint64_t size = scene_bytes.size();
+        if (!c.send_value(size) || !c.send_all(scene_bytes.data(), scene_bytes.size())) { return; }
+
+        band b;
+        while (take(b)) {
+            int32_t job[2] = { b.y0, b.y1 };
+            int32_t answer[2];
+            uint64_t band_primary = 0, band_secondary = 0, bytes = 0;
+            std::vector<char> rows;
+            bool ok = c.send_value(job) && c.recv_value(answer) && answer[0] == b.y0 && answer[1] == b.y1
+                      && c.recv_value(band_primary) && c.recv_value(band_secondary) && c.recv_value(bytes)
+                      && bytes == merged.packed_size(b.y0, b.y1);
+            if (ok) {
+                rows.resize(size_t(bytes));
+                ok = c.recv_all(rows.data(), rows.size());
+            }
+            if (!finish(b, ok ? &rows : nullptr, band_primary, band_secondary)) {
+                std::cerr << "Lost worker " << id << " (closed, or no answer in " << settings.band_timeout
+                          << " s), rows " << b.y0 << '-' << b.y1 << " go to another one\n";
+                return;
+            }
+        }
+        int32_t stop[2] = { -1, -1 };
+        c.send_value(stop);
+    }
+
+    std::vector<long> spawn_workers(uint16_t port) {
+        std::vector<long> children;
+        if (settings.spawn <= 0) { return children; }
+#if defined(_WIN32)
+        std::cerr << "Spawning workers isn't supported on Windows, start them with --worker\n";
+#else
+        // Local workers share this machine's cores
+        int threads = std::max(1, work_stealing_pool::resolve_thread_count(0) / settings.spawn);
+        std::string address = "localhost:" + std::to_string(port);
+        std::string thread_arg = std::to_string(threads);
+        for (int k = 0; k < settings.spawn; k++) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                const char* args[] = { settings.worker_program.c_str(), "--worker", address.c_str(), "--threads",
+                                       thread_arg.c_str(), nullptr };
+                execv(args[0], const_cast<char* const*>(args));
+                std::perror("execv");
+                _exit(127);
+            }
+            if (pid > 0) { children.push_back(long(pid)); }
+        }
+#endif
+        return children;
+    }
+
+    // Workers that got their stop exit at once, one that was dropped may be stuck: after a few seconds it's killed
+    static void wait_for(const std::vector<long>& children) {
+#if !defined(_WIN32)
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        for (long pid : children) {
+            int status;
+            while (waitpid(pid_t(pid), &status, WNOHANG) == 0) {
+                if (std::chrono::steady_clock::now() > deadline) {
+                    kill(pid_t(pid), SIGKILL);
+                    waitpid(pid_t(pid), &status, 0);
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+        }
+#endif
+    }
+};
+
+// ray-tracer --worker host:port: renders bands for a coordinator until it has none left. Returns the exit code.
+inline int run_render_worker(const std::string& host, uint16_t port, int threads) {
+    if (!net_startup()) { return 1; }
+    connection c;
+    for (int attempt = 0; attempt < 50 && !c.is_open(); attempt++) { // The coordinator may still be starting
+        c = connection::connect_to(host, port);
+        if (!c.is_open()) { std::this_thread::sleep_for(std::chrono::milliseconds(200)); }
+    }
+    if (!c.is_open()) {
+        std::cerr << "Could not connect to " << host << ':' << port << '\n';
+        return 1;
+    }
+
+    uint64_t size = 0;
+    std::vector<char> scene_bytes;
+    bool ok = c.send_all("RTWK", 4) && c.send_value(distributed_version) && c.recv_value(size);
+    if (ok) {
+        scene_bytes.resize(size_t(size));
+        ok = c.recv_all(scene_bytes.data(), scene_bytes.size());
+    }
+    scene s;
+    if (!ok || !scene_from_bytes(s, scene_bytes)) {
+        std::cerr << "Did not get a scene from the coordinator\n";
+        return 1;
+    }
+    const hittable& world = s.build();
+    s.set_frame(s.cam.frame); // Animated scenes render the frame the coordinator's camera is set to
+    s.cam.thread_count = threads;
+    s.cam.output_path.clear(); // The coordinator writes the image, and checkpoints are for single process renders
+    s.cam.checkpoint_path.clear();
+    s.cam.heatmap_path.clear();
+
+    while (true) {
+        int32_t job[2];
+        if (!c.recv_value(job)) {
+            std::cerr << "Lost the coordinator\n";
+            return 1;
+        }
+        if (job[0] < 0) { return 0; }
+        if (job[0] >= job[1] || job[1] > s.cam.height()) {
+            std::cerr << "Coordinator asked for rows " << job[0] << '-' << job[1] << " of a different image\n";
+            return 1;
+        }
+
+        s.cam.render_rows(world, job[0], job[1]);
+        const render_stats& st = s.cam.statistics();
+        std::vector<char> rows = s.cam.samples().pack_rows(job[0], job[1]);
+        uint64_t bytes = rows.size();
+        if (!c.send_value(job) || !c.send_value(st.primary_rays) || !c.send_value(st.secondary_rays)
+            || !c.send_value(bytes) || !c.send_all(rows.data(), rows.size())) {
+            std::cerr << "Lost the coordinator\n";
+            return 1;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,262 @@
+#pragma once
+#ifndef FLAT_BVH_H
+#define FLAT_BVH_H
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "arena.h"
+#include "bvh.h"
+#include "hittable.h"
+#include "hittable_list.h"
+
+// One BVH node in 32 bytes, two to a cache line.
+// Nodes are stored depth first, so an interior node's first child is always the next node in the array
+// and only the second child needs an offset.
+struct flat_bvh_node {
+    float bounds_min[3]; // Rounded outwards from the double precision box so nothing slips through the cracks
+    float bounds_max[3];
+    uint32_t offset; // Leaf: index of first primitive. Interior: index of the second child.
+    uint16_t count; // Primitives in the leaf, 0 for interior nodes
+    uint8_t axis; // Axis the children are split along, used to visit the near one first
+    uint8_t pad;
+};
+
+static_assert(sizeof(flat_bvh_node) == 32, "flat_bvh_node should fill exactly half a cache line");
+
+// Node helpers shared by flat_bvh and the trees inside meshes (triangle_mesh.h)
+
+inline void set_node_bounds(flat_bvh_node& node, const aabb& box) {
+    for (int a = 0; a < 3; a++) {
+        const interval& ax = box.axis_interval(a);
+        node.bounds_min[a] = std::nextafter(float(ax.min), -std::numeric_limits<float>::infinity());
+        node.bounds_max[a] = std::nextafter(float(ax.max), std::numeric_limits<float>::infinity());
+    }
+}
+
+// Rounding in t0 and t1 can lose a box the ray only touches, at a corner or along a face it shares with a flat
+// primitive, which lets rays slip through meshes in float builds. Widening every far distance by 2 gamma(3) (Ize,
+// "Robust BVH Ray Traversal", 2013) covers the error of the subtraction and multiplication.
+const real node_hit_widening = 1 + 2 * (3 * std::numeric_limits<real>::epsilon() / 2)
+                                     / (1 - 3 * std::numeric_limits<real>::epsilon() / 2);
+
+inline bool node_hit(const flat_bvh_node& node, const point3& orig, const vec3& inv_dir, interval ray_t) {
+    for (int axis = 0; axis < 3; axis++) {
+        real t0 = (node.bounds_min[axis] - orig[axis]) * inv_dir[axis];
+        real t1 = (node.bounds_max[axis] - orig[axis]) * inv_dir[axis];
+        ray_t.min = std::fmax(ray_t.min, std::fmin(t0, t1));
+        ray_t.max = std::fmin(ray_t.max, std::fmax(t0, t1) * node_hit_widening);
+        if (ray_t.max <= ray_t.min) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Same tree as bvh_node (SAH binned splits) flattened into one array and walked with a loop and a small
+// stack instead of virtual hit() calls on shared_ptr children.
+class flat_bvh : public hittable {
+public:
+    static const int max_leaf_size = 4;
+    static const int max_depth = 64; // Size of the traversal stack
+
+    // Keeps the list's objects alive
+    flat_bvh(hittable_list list) : owned(std::move(list.objects)) {
+        primitives.reserve(owned.size());
+        for (const auto& object : owned) { primitives.push_back(object.get()); }
+        build_tree();
+    }
+
+    // Over objects in an arena, which has to outlive the tree
+    flat_bvh(const arena_list& list) : primitives(list.objects) {
+        build_tree();
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (nodes.empty()) {
+            return false;
+        }
+
+        const point3& orig = r.origin();
+        const vec3& dir = r.direction();
+        const vec3 inv_dir(1.0 / dir.x(), 1.0 / dir.y(), 1.0 / dir.z());
+        const bool dir_neg[3] = { inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0 };
+
+        uint32_t stack[max_depth];
+        int stack_size = 0;
+        uint32_t current = 0;
+        bool hit_anything = false;
+
+        while (true) {
+            const flat_bvh_node& node = nodes[current];
+
+            if (node_hit(node, orig, inv_dir, ray_t)) {
+                if (node.count > 0) {
+                    for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                        if (primitives[i]->hit(r, ray_t, rec)) {
+                            hit_anything = true;
+                            ray_t.max = rec.t; // Closest so far, later boxes must beat it
+                        }
+                    }
+                }
+                else if (dir_neg[node.axis]) { // Second child is on the near side
+                    stack[stack_size++] = current + 1;
+                    current = node.offset;
+                    continue;
+                }
+                else {
+                    stack[stack_size++] = node.offset;
+                    current = current + 1;
+                    continue;
+                }
+            }
+
+            if (stack_size == 0) { break; }
+            current = stack[--stack_size];
+        }
+
+        return hit_anything;
+    }
+
+    // The same walk, but done at the first primitive in range: no closest hit to narrow ray_t down to
+    bool occluded(const ray& r, interval ray_t) const override {
+        if (nodes.empty()) {
+            return false;
+        }
+
+        const point3& orig = r.origin();
+        const vec3& dir = r.direction();
+        const vec3 inv_dir(1.0 / dir.x(), 1.0 / dir.y(), 1.0 / dir.z());
+        const bool dir_neg[3] = { inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0 };
+
+        uint32_t stack[max_depth];
+        int stack_size = 0;
+        uint32_t current = 0;
+
+        while (true) {
+            const flat_bvh_node& node = nodes[current];
+
+            if (node_hit(node, orig, inv_dir, ray_t)) {
+                if (node.count > 0) {
+                    for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                        if (primitives[i]->occluded(r, ray_t)) { return true; }
+                    }
+                }
+                else if (dir_neg[node.axis]) { // Near side first still finds a blocker sooner on average
+                    stack[stack_size++] = current + 1;
+                    current = node.offset;
+                    continue;
+                }
+                else {
+                    stack[stack_size++] = node.offset;
+                    current = current + 1;
+                    continue;
+                }
+            }
+
+            if (stack_size == 0) { break; }
+            current = stack[--stack_size];
+        }
+
+        return false;
+    }
+
+    aabb bounding_box() const override {
+        if (nodes.empty()) { return aabb(); }
+        const auto& root = nodes[0];
+        return aabb(point3(root.bounds_min[0], root.bounds_min[1], root.bounds_min[2]),
+                    point3(root.bounds_max[0], root.bounds_max[1], root.bounds_max[2]));
+    }
+
+    size_t node_count() const { return nodes.size(); }
+
+    // Recomputes every node's box from the primitives' current ones and keeps the tree as it is, for primitives
+    // that moved. Far cheaper than a build; the tree just gets looser the further things move from where it was
+    // built. Children come after their parent in the array, so one backwards pass sees them first.
+    void refit() {
+        for (size_t k = nodes.size(); k-- > 0;) {
+            flat_bvh_node& node = nodes[k];
+            if (node.count > 0) {
+                aabb bbox;
+                for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                    bbox = aabb(bbox, primitives[i]->bounding_box());
+                }
+                set_node_bounds(node, bbox);
+                continue;
+            }
+            const flat_bvh_node& first = nodes[k + 1];
+            const flat_bvh_node& second = nodes[node.offset];
+            for (int a = 0; a < 3; a++) {
+                node.bounds_min[a] = std::fmin(first.bounds_min[a], second.bounds_min[a]);
+                node.bounds_max[a] = std::fmax(first.bounds_max[a], second.bounds_max[a]);
+            }
+        }
+    }
+
+private:
+    std::vector<flat_bvh_node> nodes;
+    std::vector<const hittable*> primitives; // Reordered so every leaf owns a contiguous run
+    std::vector<shared_ptr<hittable>> owned; // Empty for arena objects
+
+    void build_tree() {
+        nodes.reserve(primitives.size() * 2);
+        if (!primitives.empty()) {
+            build(0, primitives.size(), 0);
+        }
+    }
+
+    uint32_t build(size_t start, size_t end, int depth) {
+        uint32_t index = uint32_t(nodes.size());
+        nodes.emplace_back();
+
+        aabb bbox;
+        for (size_t i = start; i < end; i++) {
+            bbox = aabb(bbox, primitives[i]->bounding_box());
+        }
+
+        size_t span = end - start;
+        if (span <= max_leaf_size) {
+            set_node_bounds(nodes[index], bbox);
+            nodes[index].offset = uint32_t(start);
+            nodes[index].count = uint16_t(span);
+            return index;
+        }
+
+        // Past half the stack depth switch to median splits. Those add at most log2(n) more levels, which keeps
+        // any tree inside the fixed traversal stack even if SAH produced a long lopsided chain above it.
+        size_t mid = (depth < max_depth / 2) ? sah_partition(primitives, start, end)
+                                               : median_partition(primitives, start, end);
+
+        // The axis along which the halves' centers differ most tells which one a ray meets first.
+        // The half further along +axis is always built second, so a ray going the -axis way visits it first.
+        aabb lower, upper;
+        for (size_t i = start; i < mid; i++) { lower = aabb(lower, primitives[i]->bounding_box()); }
+        for (size_t i = mid; i < end; i++) { upper = aabb(upper, primitives[i]->bounding_box()); }
+
+        auto d = upper.centroid() - lower.centroid();
+        int axis = 0;
+        if (std::fabs(d.y()) > std::fabs(d[axis])) { axis = 1; }
+        if (std::fabs(d.z()) > std::fabs(d[axis])) { axis = 2; }
+
+        uint32_t second;
+        if (d[axis] >= 0) {
+            build(start, mid, depth + 1);
+            second = build(mid, end, depth + 1);
+        }
+        else {
+            build(mid, end, depth + 1);
+            second = build(start, mid, depth + 1);
+        }
+
+        set_node_bounds(nodes[index], bbox); // nodes may have reallocated, so no references held across the builds
+        nodes[index].offset = second;
+        nodes[index].count = 0;
+        nodes[index].axis = uint8_t(axis);
+        return index;
+    }
+};
+
+#endif
@@ -0,0 +1,40 @@
+#pragma once
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <vector>
+
+#include "color.h"
+
+// Linear (not gamma corrected) float RGB image, row major from the top left like the camera's pixels.
+// Floats are plenty for a finished pixel and halve the memory of storing colors.
+class framebuffer {
+public:
+    framebuffer() {}
+    framebuffer(int width, int height) : w(width), h(height), rgb(size_t(width) * height * 3, 0.0f) {}
+
+    int width() const { return w; }
+    int height() const { return h; }
+
+    void set(int i, int j, const color& c) {
+        float* px = &rgb[(size_t(j) * w + i) * 3];
+        px[0] = float(c.x());
+        px[1] = float(c.y());
+        px[2] = float(c.z());
+    }
+
+    color get(int i, int j) const {
+        const float* px = &rgb[(size_t(j) * w + i) * 3];
+        return color(px[0], px[1], px[2]);
+    }
+
+    float* data() { return rgb.data(); }
+    const float* data() const { return rgb.data(); }
+
+private:
+    int w = 0;
+    int h = 0;
+    std::vector<float> rgb;
+};
+
+#endif
@@ -2,30 +2,52 @@
 #define HITTABLE_H
 
 #include "rtweekend.h"
+#include "aabb.h"
 
 
 class material;
 
-class hit_record {
+template <typename T>
+class basic_hit_record {
 public:
-    point3 p;
-    vec3 normal;
-    shared_ptr <material> mat;
-    double t;
+    basic_vec3<T> p;
+    basic_vec3<T> normal;
+    const material* mat; // Owned by the scene's material_registry
+    T t;
     bool front_face;
 
-    void set_face_normal(const ray& r, const vec3& outward_normal) {
+    void set_face_normal(const basic_ray<T>& r, const basic_vec3<T>& outward_normal) {
         front_face = dot(r.direction(), outward_normal) < 0;
         normal = front_face ? outward_normal : -outward_normal;
     }
 
 };
 
+using hit_record = basic_hit_record<real>;
+
+// A direction toward a point on a light, from a point being shaded (lights.h)
+struct light_sample {
+    vec3 direction; // Unit
+    real distance; // To the light along direction
+    real pdf; // Of picking direction, per unit solid angle
+};
+
 class hittable {
 public:
     virtual ~hittable() = default;
 
+    // Only writes rec when it returns true, so callers can pass the record of an earlier, farther hit
     virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const = 0;
+
+    // Whether anything at all is in ray_t, for shadow rays. Can stop at the first hit it finds instead of looking
+    // for the closest, and fills in no record; the ones that matter (spheres, quads, the trees and lists) override
+    // this default.
+    virtual bool occluded(const ray& r, interval ray_t) const {
+        hit_record rec;
+        return hit(r, ray_t, rec);
+    }
+
+    virtual aabb bounding_box() const = 0;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,149 @@
+#pragma once
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "color.h"
+#include "framebuffer.h"
+#include "png.h"
+
+enum class image_format {
+    from_extension, // .pfm or .png, anything else is P6
+    ppm_ascii, // P3, the original text output. Huge and slow, kept for diffing against old renders.
+    ppm_binary, // P6, 8 bit gamma corrected
+    pfm, // Linear 32 bit float, for HDR tools and anything that post processes
+    png // 8 bit gamma corrected, filtered rows and fixed Huffman deflate (see png.h)
+};
+
+inline image_format image_format_from_path(const std::string& path) {
+    auto ends_with = [&](const char* ext) {
+        size_t n = std::strlen(ext);
+        return path.size() >= n && path.compare(path.size() - n, n, ext) == 0;
+    };
+    if (ends_with(".pfm")) { return image_format::pfm; }
+    if (ends_with(".png")) { return image_format::png; }
+    return image_format::ppm_binary;
+}
+
+inline std::vector<uint8_t> to_rgb8(const framebuffer& fb) {
+    std::vector<uint8_t> rgb(size_t(fb.width()) * fb.height() * 3);
+    const float* src = fb.data();
+    for (size_t k = 0; k < rgb.size(); k++) {
+        rgb[k] = uint8_t(linear_to_byte(src[k]));
+    }
+    return rgb;
+}
+
+// Whole file in memory, so writing it is one call no matter the format
+inline std::vector<uint8_t> encode_image(const framebuffer& fb, image_format format) {
+    int w = fb.width();
+    int h = fb.height();
+    std::vector<uint8_t> out;
+    char header[64];
+
+    switch (format) {
+    case image_format::ppm_ascii: {
+        int n = std::snprintf(header, sizeof header, "P3\n%d %d\n255\n", w, h);
+        out.assign(header, header + n);
+        out.reserve(out.size() + size_t(w) * h * 12);
+        auto rgb = to_rgb8(fb);
+        for (size_t k = 0; k < rgb.size(); k++) { // Hand rolled itoa, ostream << was most of the old output time
+            int v = rgb[k];
+            if (v >= 100) { out.push_back(uint8_t('0' + v / 100)); }
+            if (v >= 10) { out.push_back(uint8_t('0' + v / 10 % 10)); }
+            out.push_back(uint8_t('0' + v % 10));
+            out.push_back((k % 3 == 2) ? '\n' : ' ');
+        }
+        break;
+    }
+    case image_format::from_extension: // No path to go by here, write_image resolves it before calling
+    case image_format::ppm_binary: {
+        int n = std::snprintf(header, sizeof header, "P6\n%d %d\n255\n", w, h);
+        out.assign(header, header + n);
+        auto rgb = to_rgb8(fb);
+        out.insert(out.end(), rgb.begin(), rgb.end());
+        break;
+    }
+    case image_format::pfm: {
+        // Negative scale means little endian. Rows go bottom to top.
+        const uint16_t probe = 1;
+        bool little = *reinterpret_cast<const uint8_t*>(&probe) == 1;
+        int n = std::snprintf(header, sizeof header, "PF\n%d %d\n%s\n", w, h, little ? "-1.0" : "1.0");
+        out.assign(header, header + n);
+        size_t row_bytes = size_t(w) * 3 * sizeof(float);
+        out.resize(n + row_bytes * h);
+        for (int j = 0; j < h; j++) {
+            std::memcpy(&out[n + row_bytes * (h - 1 - j)], fb.data() + size_t(j) * w * 3, row_bytes);
+        }
+        break;
+    }
+    case image_format::png: {
+        auto rgb = to_rgb8(fb);
+        out = encode_png(rgb.data(), w, h);
+        break;
+    }
+    }
+    return out;
+}
+
+inline bool write_image(const framebuffer& fb, const std::string& path, image_format format) {
+    if (format == image_format::from_extension) {
+        format = image_format_from_path(path);
+    }
+    auto bytes = encode_image(fb, format);
+
+    FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) {
+        std::cerr << "Could not open " << path << " for writing\n";
+        return false;
+    }
+    bool ok = std::fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+    ok = (std::fclose(f) == 0) && ok;
+    if (!ok) {
+        std::cerr << "Could not write " << path << '\n';
+    }
+    return ok;
+}
+
+// Reads back a PFM this file wrote (or any three channel one), for comparing renders
+inline bool read_pfm(const std::string& path, framebuffer& fb) {
+    FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) {
+        std::cerr << "Could not open " << path << '\n';
+        return false;
+    }
+    char magic[3] = {};
+    int w = 0, h = 0;
+    double scale = 0;
+    // One whitespace character ends the header, the pixels start right after it
+    bool ok = std::fscanf(f, "%2s %d %d %lf", magic, &w, &h, &scale) == 4 && std::strcmp(magic, "PF") == 0
+              && w > 0 && h > 0 && scale != 0 && std::fgetc(f) != EOF;
+    if (ok) {
+        const uint16_t probe = 1;
+        bool little = *reinterpret_cast<const uint8_t*>(&probe) == 1;
+        bool swap = (scale < 0) != little;
+        fb = framebuffer(w, h);
+        size_t row = size_t(w) * 3;
+        for (int j = h - 1; ok && j >= 0; j--) { // Bottom row first
+            float* px = fb.data() + size_t(j) * row;
+            ok = std::fread(px, sizeof(float), row, f) == row;
+            for (size_t k = 0; ok && swap && k < row; k++) {
+                uint8_t* b = reinterpret_cast<uint8_t*>(px + k);
+                std::swap(b[0], b[3]);
+                std::swap(b[1], b[2]);
+            }
+        }
+    }
+    std::fclose(f);
+    if (!ok) {
+        std::cerr << path << " is not a readable color PFM\n";
+    }
+    return ok;
+}
+
+#endif
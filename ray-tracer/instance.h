@@ -0,0 +1,124 @@
+#pragma once
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include <cmath>
+
+#include "aabb.h"
+#include "hittable.h"
+#include "rtweekend.h"
+
+// Affine map of points, p -> m p + t, with m's rows in m[0..2]
+struct affine {
+    real m[3][3];
+    vec3 t;
+
+    static affine identity() { return { { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } }, vec3(0, 0, 0) }; }
+
+    // Scaled, then turned about the y axis (degrees, counterclockwise seen from above), then translated, the same
+    // order and conventions as object_transform in animation.h
+    static affine scale_rotate_translate(double scale, double rotate_y, const vec3& translate) {
+        double s, c;
+        sin_cos(degrees_to_radians(rotate_y), s, c);
+        return { { { real(c * scale), 0, real(s * scale) }, { 0, real(scale), 0 }, { real(-s * scale), 0, real(c * scale) } },
+                 translate };
+    }
+
+    // This map after inner, p -> this(inner(p))
+    affine after(const affine& inner) const {
+        affine a;
+        for (int row = 0; row < 3; row++) {
+            for (int col = 0; col < 3; col++) {
+                a.m[row][col] = m[row][0] * inner.m[0][col] + m[row][1] * inner.m[1][col] + m[row][2] * inner.m[2][col];
+            }
+        }
+        a.t = point(inner.t);
+        return a;
+    }
+
+    point3 point(const point3& p) const { return vector(p) + t; }
+
+    vec3 vector(const vec3& v) const {
+        return vec3(m[0][0] * v.x() + m[0][1] * v.y() + m[0][2] * v.z(),
+                    m[1][0] * v.x() + m[1][1] * v.y() + m[1][2] * v.z(),
+                    m[2][0] * v.x() + m[2][1] * v.y() + m[2][2] * v.z());
+    }
+
+    // Transposed linear part times v. Normals go from object to world space by the inverse's transpose.
+    vec3 transposed(const vec3& v) const {
+        return vec3(m[0][0] * v.x() + m[1][0] * v.y() + m[2][0] * v.z(),
+                    m[0][1] * v.x() + m[1][1] * v.y() + m[2][1] * v.z(),
+                    m[0][2] * v.x() + m[1][2] * v.y() + m[2][2] * v.z());
+    }
+
+    real determinant() const {
+        return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+             - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+             + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    }
+
+    // By cofactors, for a map with a nonzero determinant
+    affine inverse() const {
+        real d = 1 / determinant();
+        affine inv;
+        inv.m[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) * d;
+        inv.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * d;
+        inv.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * d;
+        inv.m[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) * d;
+        inv.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * d;
+        inv.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * d;
+        inv.m[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) * d;
+        inv.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * d;
+        inv.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * d;
+        inv.t = -inv.vector(t);
+        return inv;
+    }
+};
+
+// Shared geometry placed in the world by an affine map. The ray is taken into the object's space rather than the
+// object into the world, so any number of instances cost one object plus this (a matrix, a box and a pointer);
+// the object has to outlive them. The ray's direction isn't renormalized, so t means the same in both spaces.
+// Together with a flat_bvh over the instances this is a two level structure: the top level finds the instances a
+// ray passes, the object's own tree (a mesh's, or a flat_bvh of spheres) does the rest.
+class instance : public hittable {
+public:
+    instance(const hittable* object, const affine& to_world) : object(object) { place(to_world); }
+
+    // For animation, whatever holds the instance has to refit around it afterwards. The map needs a nonzero
+    // determinant.
+    void place(const affine& to_world) {
+        to_object = to_world.inverse();
+        bbox = aabb();
+        aabb box = object->bounding_box();
+        for (int k = 0; k < 8; k++) { // The world box around the object box's corners
+            point3 corner((k & 1) ? box.x.max : box.x.min, (k & 2) ? box.y.max : box.y.min,
+                          (k & 4) ? box.z.max : box.z.min);
+            point3 p = to_world.point(corner);
+            bbox = aabb(bbox, aabb(p, p));
+        }
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        ray local(to_object.point(r.origin()), to_object.vector(r.direction()));
+        if (!object->hit(local, ray_t, rec)) {
+            return false;
+        }
+        // front_face carries over, an affine map keeps the sign of dot(direction, normal)
+        rec.p = r.at(rec.t);
+        rec.normal = unit_vector(to_object.transposed(rec.normal));
+        return true;
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        return object->occluded(ray(to_object.point(r.origin()), to_object.vector(r.direction())), ray_t);
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+private:
+    const hittable* object;
+    affine to_object; // Only the inverse is kept, hit() needs nothing else
+    aabb bbox;
+};
+
+#endif
@@ -4,30 +4,43 @@
 
 #include "rtweekend.h"
 
-class interval {
+template <typename T>
+class basic_interval {
 public:
-	double min, max;
+	T min, max;
 
-	interval() : min(+infinity), max(-infinity) {}
+	basic_interval() : min(+infinity), max(-infinity) {}
 
-	interval(double min, double max) : min(min), max(max) {}
+	basic_interval(T min, T max) : min(min), max(max) {}
 
-	double size() const { return max - min;  }
+	basic_interval(const basic_interval& a, const basic_interval& b) { // Tightest interval enclosing both
+		min = a.min <= b.min ? a.min : b.min;
+		max = a.max >= b.max ? a.max : b.max;
+	}
+
+	T size() const { return max - min;  }
 
-	bool contains(double x) const { return min <= x && x <= max; }
+	bool contains(T x) const { return min <= x && x <= max; }
 
-	bool surrounds(double x) const { return min < x && x < max; }
+	bool surrounds(T x) const { return min < x && x < max; }
 
-	double clamp(double x) const {
+	T clamp(T x) const {
 		if (x < min) { return min; }
 		if (x > max) { return max; }
 		return x;
 	}
 
-	static const interval empty, universe;
+	basic_interval expand(T delta) const {
+		auto padding = delta / 2;
+		return basic_interval(min - padding, max + padding);
+	}
+
+	static const basic_interval empty, universe;
 };
 
-const interval interval::empty = interval();
-const interval interval::universe = interval(-infinity, +infinity);
+template <typename T> const basic_interval<T> basic_interval<T>::empty = basic_interval<T>();
+template <typename T> const basic_interval<T> basic_interval<T>::universe = basic_interval<T>(-infinity, +infinity);
+
+using interval = basic_interval<real>;
 
 #endif
@@ -0,0 +1,112 @@
+#pragma once
+#ifndef LIGHTS_H
+#define LIGHTS_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "hittable.h"
+#include "material.h"
+#include "quad.h"
+#include "sampler.h"
+#include "sphere.h"
+
+// A ray toward a light and what it brings if nothing is in the way
+struct shadow_ray {
+    ray r;
+    real t_max; // Just short of the light, blockers are looked for in (0.001, t_max)
+    color radiance; // Emitted * bsdf_cos / pdf, weighted against the scattered ray finding the same light
+};
+
+// Next event estimation: at every diffuse hit the integrators also aim a shadow ray at a point on one of the lights,
+// so small bright lights are found by every path that sees them rather than only by the few bounces that happen to
+// hit them. Both ways of reaching a light count, each weighted by the power heuristic (Veach, "Optimally Combining
+// Sampling Techniques for Monte Carlo Rendering", 1995): a light sample that the BSDF would have been likely to
+// pick too shares the credit with it, and the other way round, so neither is counted twice.
+// Sphere lights are sampled over the cone they fill, quad lights over their area. The light is picked uniformly.
+class light_list {
+public:
+    // Returns the index the light's material has to carry (diffuse_light::light)
+    int add(const sphere* s, const color& emit) {
+        lights.push_back({ s, nullptr, emit });
+        return int(lights.size()) - 1;
+    }
+
+    int add(const quad* q, const color& emit) {
+        lights.push_back({ nullptr, q, emit });
+        return int(lights.size()) - 1;
+    }
+
+    void clear() { lights.clear(); }
+    void set_emit(size_t index, const color& emit) { lights[index].emit = emit; } // Of a light whose material changed
+    bool empty() const { return lights.empty(); }
+    size_t size() const { return lights.size(); }
+
+    // Aims at a light from the hit, for a material that samples_lights(). Always takes three of the sampler's
+    // numbers, so the dimensions after it don't depend on the outcome. False when there is nothing to test.
+    bool sample(const hit_record& rec, path_sampler& sampler, shadow_ray& out) const {
+        double pick = random_double(sampler);
+        double a, b;
+        sampler.next_2d(a, b);
+        const entry& l = lights[std::min(size_t(pick * lights.size()), lights.size() - 1)];
+
+        light_sample s;
+        bool aimed = l.ball ? l.ball->sample_toward(rec.p, a, b, s) : l.patch->sample_toward(rec.p, a, b, s);
+        if (!aimed || s.pdf <= 0) { return false; }
+        color f = rec.mat->bsdf_cos(rec, s.direction);
+        if (f.near_zero()) { return false; } // Light behind the surface
+        real light_pdf = s.pdf / real(lights.size());
+        real scatter_pdf = rec.mat->scatter_pdf(rec, s.direction);
+
+        out.r = ray(rec.p, s.direction);
+        out.t_max = s.distance * shadow_ray_end;
+        out.radiance = l.emit * f * (power_heuristic(light_pdf, scatter_pdf) / light_pdf);
+        return true;
+    }
+
+    // sample() with the shadow ray traced, for the integrators that go one path at a time
+    color direct(const hit_record& rec, const hittable& world, path_sampler& sampler, uint64_t& shadow_rays) const {
+        shadow_ray s;
+        if (!sample(rec, sampler, s)) { return color(0, 0, 0); }
+        shadow_rays++;
+        return world.occluded(s.r, interval(0.001, s.t_max)) ? color(0, 0, 0) : s.radiance;
+    }
+
+    // Weight of a light the scattered ray r hit, scatter_pdf being the density the bounce picked r with (0 if that
+    // bounce took no light sample: camera rays, mirrors, glass, which keep all of it)
+    real emission_weight(const ray& r, const hit_record& rec, real scatter_pdf) const {
+        int index = rec.mat->light();
+        if (scatter_pdf <= 0 || index < 0) { return 1; }
+        const entry& l = lights[size_t(index)];
+        real length = r.direction().length();
+        real light_pdf = l.ball ? l.ball->pdf_toward(r.origin())
+                                : l.patch->pdf_toward(r.direction() / length, rec.t * length);
+        return power_heuristic(scatter_pdf, light_pdf / real(lights.size()));
+    }
+
+private:
+    struct entry {
+        const sphere* ball; // One of the two
+        const quad* patch;
+        color emit;
+    };
+
+    std::vector<entry> lights;
+
+    static constexpr real shadow_ray_end = real(0.999); // Relative, so the light doesn't shadow itself in float builds
+
+    static real power_heuristic(real f, real g) {
+        return f * f / (f * f + g * g);
+    }
+};
+
+// Emission of the light a path just hit, weighted against the light sample the bounce before took. lights is null
+// when the integrator samples none, then every light counts in full.
+inline color emitted_light(const light_list* lights, const ray& r, const hit_record& rec, real scatter_pdf) {
+    if (!rec.mat->emits()) { return color(0, 0, 0); }
+    color e = rec.mat->emitted(rec);
+    return lights ? e * lights->emission_weight(r, rec, scatter_pdf) : e;
+}
+
+#endif
@@ -1,19 +1,168 @@
 #include "rtweekend.h"
 
 #include "camera.h"
+#include "distributed.h"
+#include "flat_bvh.h"
 #include "hittable.h"
 #include "hittable_list.h"
 #include "material.h"
+#include "preview.h"
+#include "scene.h"
 #include "sphere.h"
 
-int main() {
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// Renders the built in scene, or a scene file:
+//   ray-tracer scene.txt [--set <camera field> <value>]...   fields as in scene files, e.g. --set output_path a.png
+//   ray-tracer scene.txt --save-binary scene.rtsb            converts instead of rendering
+//   ray-tracer scene.txt --frames <first> <last>             renders a numbered sequence (see frame_path), like a
+//                                                            frames statement in the scene, with --coordinate too
+//   ray-tracer scene.txt --coordinate [port] [--spawn n]     renders with worker processes (distributed.h),
+//             [--band-timeout seconds]                       --spawn starts n of them on this machine, a worker
+//                                                            silent for band-timeout loses its band (default 120)
+//   ray-tracer --worker host:port [--threads n]              renders for a coordinator
+//   ray-tracer scene.txt --preview [port]                    keeps the scene built and re-renders as camera and
+//                                                            material edits come in (preview.h), on stdin and
+//                                                            stdout or on 127.0.0.1:port
+int main(int argc, char* argv[]) {
+    if (argc > 2 && std::strcmp(argv[1], "--worker") == 0) {
+        std::string address = argv[2];
+        size_t colon = address.rfind(':');
+        int threads = (argc > 4 && std::strcmp(argv[3], "--threads") == 0) ? std::atoi(argv[4]) : 0;
+        if (colon == std::string::npos) {
+            std::cerr << "--worker wants host:port\n";
+            return 2;
+        }
+        return run_render_worker(address.substr(0, colon), uint16_t(std::atoi(address.c_str() + colon + 1)), threads);
+    }
+
+    if (argc > 1) {
+        scene s;
+        if (!s.load(argv[1])) { return 1; }
+        std::clog << "Parsed " << s.material_records.size() << " materials and " << s.sphere_records.size()
+                  << " spheres in " << s.parse_seconds << " s\n";
+        if (!s.mesh_records.empty()) {
+            std::clog << "Loaded " << s.triangle_count() << " triangles of " << s.mesh_records.size() << " meshes in "
+                      << s.mesh_seconds << " s, " << double(s.mesh_bytes()) / double(s.triangle_count())
+                      << " bytes per triangle\n";
+        }
+        if (!s.instance_records.empty()) {
+            std::clog << "Placed " << s.instance_records.size() << " instances of " << s.object_records.size()
+                      << " objects\n";
+        }
+
+        bool coordinate = false;
+        bool preview = false;
+        int preview_port = -1; // stdin and stdout
+        coordinator_settings distributed;
+        distributed.worker_program = argv[0];
+        for (int a = 2; a < argc; a++) {
+            std::string arg = argv[a];
+            if (arg == "--save-binary" && a + 1 < argc) {
+                return s.save_binary(argv[a + 1]) ? 0 : 1;
+            }
+            else if (arg == "--set" && a + 2 < argc) {
+                if (!set_camera_field(s.cam, argv[a + 1], argv[a + 2])) {
+                    std::cerr << "Can't set camera " << argv[a + 1] << " to " << argv[a + 2] << '\n';
+                    return 2;
+                }
+                s.setting_lines.push_back(std::string("camera ") + argv[a + 1] + ' ' + argv[a + 2]); // Workers get it too
+                a += 2;
+            }
+            else if (arg == "--frames" && a + 2 < argc) {
+                s.first_frame = std::atoi(argv[a + 1]);
+                s.last_frame = std::max(s.first_frame, std::atoi(argv[a + 2]));
+                a += 2;
+            }
+            else if (arg == "--coordinate") {
+                coordinate = true;
+                if (a + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[a + 1][0]))) {
+                    distributed.port = uint16_t(std::atoi(argv[++a]));
+                }
+            }
+            else if (arg == "--preview") {
+                preview = true;
+                if (a + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[a + 1][0]))) {
+                    preview_port = std::atoi(argv[++a]);
+                }
+            }
+            else if (arg == "--spawn" && a + 1 < argc) {
+                distributed.spawn = std::atoi(argv[++a]);
+            }
+            else if (arg == "--band-timeout" && a + 1 < argc) {
+                distributed.band_timeout = std::atof(argv[++a]);
+                if (!(distributed.band_timeout > 0)) {
+                    std::cerr << "--band-timeout wants a number of seconds above 0\n";
+                    return 2;
+                }
+            }
+            else {
+                std::cerr << "Unknown option " << arg << '\n';
+                return 2;
+            }
+        }
+
+        if (coordinate && !s.animated()) {
+            return render_coordinator(distributed).render(s) ? 0 : 1;
+        }
+        if (coordinate) {
+            // A coordinator per frame, the workers pose the scene at the frame the camera line sends them
+            std::string pattern = s.cam.output_path;
+            for (int frame = s.first_frame; frame <= s.last_frame; frame++) {
+                s.cam.frame = frame;
+                s.setting_lines.push_back("camera frame " + std::to_string(frame));
+                s.cam.output_path = frame_path(pattern, frame);
+                if (!render_coordinator(distributed).render(s)) { return 1; }
+                s.setting_lines.pop_back();
+                std::clog << "Frame " << frame << " (" << s.cam.output_path << ")\n";
+            }
+            return 0;
+        }
+        const hittable& objects = s.build();
+        std::clog << "Built in " << s.build_seconds << " s, " << s.arena_bytes() << " bytes of objects\n";
+        if (preview) {
+            s.set_frame(s.cam.frame);
+            preview_server server(s, objects);
+            if (preview_port < 0) {
+                run_preview_stdio(server);
+                return 0;
+            }
+            return run_preview_socket(server, uint16_t(preview_port)) ? 0 : 1;
+        }
+        if (!s.animated()) {
+            s.set_frame(s.cam.frame);
+            s.cam.render(objects);
+            return 0;
+        }
+
+        // The scene is built once, every frame only poses it
+        std::string pattern = s.cam.output_path;
+        auto start = std::chrono::steady_clock::now();
+        for (int frame = s.first_frame; frame <= s.last_frame; frame++) {
+            s.set_frame(frame);
+            s.cam.output_path = frame_path(pattern, frame);
+            s.cam.render(objects);
+            std::clog << "Frame " << frame << " (" << s.cam.output_path << "): refit in " << s.refit_seconds
+                      << " s, rendered in " << s.cam.statistics().render_seconds << " s\n";
+        }
+        std::clog << (s.last_frame - s.first_frame + 1) << " frames in "
+                  << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s\n";
+        return 0;
+    }
+
     hittable_list world;
+    material_registry materials;
 
-    auto material_ground = make_shared<lambertian>(color(0.8, 0.8, 0.0));
-    auto material_center = make_shared<lambertian>(color(0.1, 0.2, 0.5));
-    auto material_left = make_shared<dielectric>(1.00, 1.50);
-    auto material_bubble = make_shared<dielectric>(1.50, 1.00);
-    auto material_right = make_shared<metal>(color(0.8, 0.6, 0.2), 1.0);
+    auto material_ground = materials.add(lambertian(color(0.8, 0.8, 0.0)));
+    auto material_center = materials.add(lambertian(color(0.1, 0.2, 0.5)));
+    auto material_left = materials.add(dielectric(1.00, 1.50));
+    auto material_bubble = materials.add(dielectric(1.50, 1.00));
+    auto material_right = materials.add(metal(color(0.8, 0.6, 0.2), 1.0));
 
     world.add(make_shared<sphere>(point3(0.0, -100.5, -1.0), 100.0, material_ground));
     world.add(make_shared<sphere>(point3(0.0, 0.0, -1.2), 0.5, material_center));
@@ -21,12 +170,15 @@ int main() {
     world.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), 0.4, material_bubble));
     world.add(make_shared<sphere>(point3(1.0, 0.0, -1.0), 0.5, material_right));
 
+    world = hittable_list(make_shared<flat_bvh>(world));
+
     camera cam;
 
     cam.aspect_ratio = 16.0 / 9.0;
     cam.image_width = 400;
     cam.samples_per_pix = 10;
     cam.max_depth = 50;
+    cam.thread_count = 0;
 
 
     cam.vfov = 20;
@@ -0,0 +1,90 @@
+#pragma once
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A whole file mapped read only into memory, for loaders that walk big files once: the pages come in as they are
+// touched and nothing is copied into a buffer first. Not NUL terminated, parse up to end().
+class mapped_file {
+public:
+    mapped_file() {}
+    ~mapped_file() { close(); }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    bool open(const std::string& path) {
+        close();
+#if defined(_WIN32)
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) { return false; }
+        LARGE_INTEGER length;
+        if (!GetFileSizeEx(file, &length)) { close(); return false; }
+        bytes = size_t(length.QuadPart);
+        if (bytes == 0) { return true; } // Can't map nothing, an empty file is still a file
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) { close(); return false; }
+        view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!view) { close(); return false; }
+#else
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) { return false; }
+        struct stat st;
+        if (fstat(fd, &st) != 0) { close(); return false; }
+        bytes = size_t(st.st_size);
+        if (bytes == 0) { return true; }
+        void* p = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) { close(); return false; }
+        view = p;
+        madvise(view, bytes, MADV_SEQUENTIAL); // Read front to back once, read ahead and drop behind
+#endif
+        return true;
+    }
+
+    void close() {
+#if defined(_WIN32)
+        if (view) { UnmapViewOfFile(view); }
+        if (mapping) { CloseHandle(mapping); }
+        if (file != INVALID_HANDLE_VALUE) { CloseHandle(file); }
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (view) { munmap(view, bytes); }
+        if (fd >= 0) { ::close(fd); }
+        fd = -1;
+#endif
+        view = nullptr;
+        bytes = 0;
+    }
+
+    const char* begin() const { return static_cast<const char*>(view); }
+    const char* end() const { return begin() + bytes; }
+    size_t size() const { return bytes; }
+
+private:
+    void* view = nullptr;
+    size_t bytes = 0;
+#if defined(_WIN32)
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+#endif
@@ -2,31 +2,26 @@
 #ifndef MATERIAL_H
 #define MATERIAL_H
 
-#include "hittable.h"
-
-class material {
-public:
-	virtual ~material() = default;
+#include <deque>
+#include <variant>
 
-	virtual bool scatter(const ray& r_in, const hit_record& rec, 
-						 color& attenuation, ray& scattered) const {
-		return false;
-	}
+#include "hittable.h"
+#include "sampler.h"
 
-	// Short note:
-	// What is attentuation? 
-	// It's the % of light loss. We store it in a color vector to show how much of each color is lost.
-};
+// Short note:
+// What is attentuation? 
+// It's the % of light loss. We store it in a color vector to show how much of each color is lost.
 
-class lambertian : public material {
+class lambertian {
 public: 
 	lambertian(const color& albedo) : albedo(albedo) {  }
 
 	bool scatter(const ray& r_in, const hit_record& rec,
-		color& attenuation, ray& scattered)
-		const override {
-		// 100% hit chance
-		auto scatter_direction = rec.normal + random_unit_vector();
+		color& attenuation, ray& scattered, path_sampler& sampler)
+		const {
+		// 100% hit chance, cosine weighted about the normal (what normal + random_unit_vector gave, without the
+		// degenerate direction when the two cancel)
+		auto scatter_direction = random_cosine_direction(rec.normal, sampler);
 		scattered = ray(rec.p, scatter_direction);
 		attenuation = albedo;
 		return true;
@@ -34,10 +29,10 @@ public:
 		// chance version
 		/*
 		double p = 1.0;
-		double chance = random_double();
+		double chance = random_double(sampler);
 
 		if (chance < p) { // Ray is bounced
-			auto scatter_direction = rec.normal + random_unit_vector();
+			auto scatter_direction = rec.normal + random_unit_vector(sampler);
 
 			if (scatter_direction.near_zero()) {
 		  	    scatter_direction = rec.normal;
@@ -53,52 +48,66 @@ public:
 		 */
 	 }
 
+	const color& base_color() const { return albedo; }
+
+	// For next event estimation: what scatter() sends toward the unit direction wi per unit of light coming from
+	// there, the cosine included, and the density with which scatter() picks wi
+	color bsdf_cos(const hit_record& rec, const vec3& wi) const {
+		return albedo * (std::fmax(real(0), dot(rec.normal, wi)) / real(pi));
+	}
+
+	real scatter_pdf(const hit_record& rec, const vec3& wi) const {
+		return std::fmax(real(0), dot(rec.normal, wi)) / real(pi);
+	}
+
 private:
 	color albedo; 
 };
 
 
-class metal : public material {
+class metal {
 public:
-	metal(const color& albedo, double fuzz) : albedo(albedo), fuzz(fuzz) {}
+	metal(const color& albedo, real fuzz) : albedo(albedo), fuzz(fuzz) {}
 
 	bool scatter(const ray& r_in, const hit_record& rec,
-				 color& attenuation, ray& scattered)
-		const override {
+				 color& attenuation, ray& scattered, path_sampler& sampler)
+		const {
 		vec3 scatter_dir = reflected(r_in.direction(), rec.normal); // Both dir and normal are unit vecs
-		scatter_dir = unit_vector(scatter_dir) + (fuzz * random_unit_vector()); // Normalize scatter dir so fuzz sphere is consistently away from the surface by 1
+		scatter_dir = unit_vector(scatter_dir) + (fuzz * random_unit_vector(sampler)); // Normalize scatter dir so fuzz sphere is consistently away from the surface by 1
 		scattered = ray(rec.p, scatter_dir);
 		attenuation = albedo;
 		return (dot(scattered.direction(), rec.normal) > 0); // Make sure fuzzed direction is above object
 	}
 
+	const color& base_color() const { return albedo; }
+
 private:
 	color albedo;
-	double fuzz;
+	real fuzz;
 };
 
 
-class dielectric : public material {
+class dielectric {
 public:
-	dielectric(double outer, double inner) : outer(outer), inner(inner) {}
+	dielectric(real outer, real inner) : outer(outer), inner(inner) {}
 
 	bool scatter(const ray& r_in, const hit_record& rec,
-				 color& attenuation, ray& scattered) 
-	const override {
+				 color& attenuation, ray& scattered, path_sampler& sampler) 
+	const {
 		auto refractive_ratio = outer / inner;
 		attenuation = color(1.0, 1.0, 1.0); // There is no loss of color, just warping
 
 		// Check if ray is entering ball from outside or inside
-		double rr = rec.front_face ? refractive_ratio : 1/refractive_ratio;
+		real rr = rec.front_face ? refractive_ratio : 1/refractive_ratio;
 
 		// Total internal reflection
 		vec3 unit_dir = unit_vector(r_in.direction());
-		auto costheta = std::fmin(dot(-unit_dir, rec.normal), 1.0);
+		auto costheta = std::fmin(dot(-unit_dir, rec.normal), real(1));
 		auto sintheta = std::sqrt(1 - costheta * costheta);
 		bool no_refract = rr * sintheta > 1.0;
 
 		vec3 direction;
-		if (no_refract || reflectance(costheta, outer, inner) > random_double()) {
+		if (no_refract || reflectance(costheta, outer, inner) > random_double(sampler)) {
 			direction = reflected(r_in.direction(), rec.normal); 
 		}
 		else {
@@ -109,14 +118,121 @@ public:
 		return true;
 	}
 private:
-	double outer; // Enclosing material refractive index
-	double inner; // Material of object
+	real outer; // Enclosing material refractive index
+	real inner; // Material of object
 
-	static double reflectance(double cosine, double outer, double inner) {
+	static real reflectance(real cosine, real outer, real inner) {
 		auto r0 = ((outer - inner) / (outer + inner));
 		r0 = r0 * r0;
-		return r0 + (1 - r0) * std::pow((1 - cosine), 5);
+		return r0 + (1 - r0) * real(std::pow((1 - cosine), 5));
+	}
+};
+
+
+// Emits light and scatters none, from the front side of whatever it's on. light is the index of the primitive it
+// belongs to in the scene's light_list (lights.h) if that samples it, -1 for an emitter only found by chance.
+class diffuse_light {
+public:
+	diffuse_light(const color& emit, int light = -1) : emit(emit), light(light) {}
+
+	bool scatter(const ray& r_in, const hit_record& rec,
+				 color& attenuation, ray& scattered, path_sampler& sampler) const {
+		return false;
+	}
+
+	color emitted(const hit_record& rec) const { return rec.front_face ? emit : color(0, 0, 0); }
+
+	color emit;
+	int light;
+};
+
+
+// Lets an integrator group hits by material and run each group's scatter back to back
+enum class material_kind {
+	lambertian,
+	metal,
+	dielectric,
+	diffuse_light
+};
+
+const int material_kind_count = 4;
+
+// One of the material types above, picked by a tag instead of a vtable.
+// scatter() is a switch on the tag, so the hot path has no virtual call and hit_record can point at materials
+// without reference counting. Materials live in a material_registry owned by the scene.
+class material {
+public:
+	material(const lambertian& m) : impl(m) {}
+	material(const metal& m) : impl(m) {}
+	material(const dielectric& m) : impl(m) {}
+	material(const diffuse_light& m) : impl(m) {}
+
+	material_kind kind() const { return material_kind(impl.index()); } // Same order as the enum
+
+	bool scatter(const ray& r_in, const hit_record& rec,
+				 color& attenuation, ray& scattered, path_sampler& sampler) const {
+		switch (kind()) {
+		case material_kind::lambertian: return std::get_if<lambertian>(&impl)->scatter(r_in, rec, attenuation, scattered, sampler);
+		case material_kind::metal: return std::get_if<metal>(&impl)->scatter(r_in, rec, attenuation, scattered, sampler);
+		case material_kind::dielectric: return std::get_if<dielectric>(&impl)->scatter(r_in, rec, attenuation, scattered, sampler);
+		case material_kind::diffuse_light: return false;
+		}
+		return false;
+	}
+
+	// Next event estimation (lights.h) needs a BSDF it can evaluate for any direction, which only lambertian has.
+	// The others (mirrors, glass, fuzzy metal) scatter as before and see lights only by hitting them.
+	bool samples_lights() const { return kind() == material_kind::lambertian; }
+
+	color bsdf_cos(const hit_record& rec, const vec3& wi) const {
+		const lambertian* m = std::get_if<lambertian>(&impl);
+		return m ? m->bsdf_cos(rec, wi) : color(0, 0, 0);
+	}
+
+	// 0 when scatter() doesn't draw from a density over directions that lights could be weighted against
+	real scatter_pdf(const hit_record& rec, const vec3& wi) const {
+		const lambertian* m = std::get_if<lambertian>(&impl);
+		return m ? m->scatter_pdf(rec, wi) : 0;
+	}
+
+	// The surface's own color, what the denoiser (denoise.h) divides out of a pixel. White for glass and lights.
+	color albedo() const {
+		switch (kind()) {
+		case material_kind::lambertian: return std::get_if<lambertian>(&impl)->base_color();
+		case material_kind::metal: return std::get_if<metal>(&impl)->base_color();
+		default: return color(1, 1, 1);
+		}
+	}
+
+	bool emits() const { return kind() == material_kind::diffuse_light; }
+
+	color emitted(const hit_record& rec) const {
+		const diffuse_light* m = std::get_if<diffuse_light>(&impl);
+		return m ? m->emitted(rec) : color(0, 0, 0);
 	}
+
+	int light() const {
+		const diffuse_light* m = std::get_if<diffuse_light>(&impl);
+		return m ? m->light : -1;
+	}
+
+private:
+	std::variant<lambertian, metal, dielectric, diffuse_light> impl;
+};
+
+// Owns every material of a scene. add() hands out a plain pointer that stays valid until the registry is destroyed
+// (a deque never moves what it already holds), so primitives and hit records carry just that pointer.
+class material_registry {
+public:
+	const material* add(const material& m) {
+		materials.push_back(m);
+		return &materials.back();
+	}
+
+	size_t size() const { return materials.size(); }
+
+private:
+	std::deque<material> materials;
 };
 
 #endif 
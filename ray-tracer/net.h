@@ -0,0 +1,205 @@
+#pragma once
+#ifndef NET_H
+#define NET_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+using socket_handle = SOCKET;
+const socket_handle invalid_socket = INVALID_SOCKET;
+inline void close_socket(socket_handle s) { closesocket(s); }
+#else
+#include <csignal>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+using socket_handle = int;
+const socket_handle invalid_socket = -1;
+inline void close_socket(socket_handle s) { ::close(s); }
+#endif
+
+// Just enough blocking TCP for distributed.h and preview.h: connect, listen, and sending or receiving whole buffers
+// or lines.
+
+// Once per process before any socket
+inline bool net_startup() {
+#if defined(_WIN32)
+    WSADATA data;
+    return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+#else
+    std::signal(SIGPIPE, SIG_IGN); // A peer that went away should fail the send, not kill the process
+    return true;
+#endif
+}
+
+class connection {
+public:
+    connection() {}
+    explicit connection(socket_handle s) : s(s) {
+        int one = 1; // Requests are tiny and answered at once, don't let Nagle sit on them
+        setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&one), sizeof one);
+    }
+    ~connection() { close(); }
+
+    connection(const connection&) = delete;
+    connection& operator=(const connection&) = delete;
+    connection(connection&& other) noexcept : s(other.s), received(std::move(other.received)) {
+        other.s = invalid_socket;
+    }
+    connection& operator=(connection&& other) noexcept {
+        std::swap(s, other.s);
+        std::swap(received, other.received);
+        return *this;
+    }
+
+    // host is a name or an address, "localhost" works
+    static connection connect_to(const std::string& host, uint16_t port) {
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* found = nullptr;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &found) != 0) {
+            return connection();
+        }
+        socket_handle s = invalid_socket;
+        for (addrinfo* a = found; a && s == invalid_socket; a = a->ai_next) {
+            s = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (s != invalid_socket && ::connect(s, a->ai_addr, socklen_t(a->ai_addrlen)) != 0) {
+                close_socket(s);
+                s = invalid_socket;
+            }
+        }
+        freeaddrinfo(found);
+        return (s == invalid_socket) ? connection() : connection(s);
+    }
+
+    bool is_open() const { return s != invalid_socket; }
+
+    // A receive that gets nothing for this long fails like a closed connection, 0 waits forever
+    bool set_receive_timeout(int milliseconds) {
+#if defined(_WIN32)
+        DWORD timeout = DWORD(milliseconds);
+#else
+        timeval timeout = { milliseconds / 1000, (milliseconds % 1000) * 1000 };
+#endif
+        return setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof timeout) == 0;
+    }
+
+    void close() {
+        if (s != invalid_socket) {
+            close_socket(s);
+            s = invalid_socket;
+        }
+    }
+
+    bool send_all(const void* data, size_t size) {
+        const char* p = static_cast<const char*>(data);
+        while (size > 0) {
+            int n = int(::send(s, p, int(std::min<size_t>(size, chunk)), 0));
+            if (n <= 0) { return false; }
+            p += n;
+            size -= size_t(n);
+        }
+        return true;
+    }
+
+    bool recv_all(void* data, size_t size) {
+        char* p = static_cast<char*>(data);
+        while (size > 0) {
+            int n = int(::recv(s, p, int(std::min<size_t>(size, chunk)), 0));
+            if (n <= 0) { return false; } // 0 is the peer closing, -1 also a receive timeout
+            p += n;
+            size -= size_t(n);
+        }
+        return true;
+    }
+
+    // Up to the next '\n', which isn't kept. False once the peer closes with no whole line left.
+    bool recv_line(std::string& line) {
+        size_t end;
+        while ((end = received.find('\n')) == std::string::npos) {
+            char buffer[4096];
+            int n = int(::recv(s, buffer, int(sizeof buffer), 0));
+            if (n <= 0) { return false; }
+            received.append(buffer, size_t(n));
+        }
+        line.assign(received, 0, end);
+        received.erase(0, end + 1);
+        return true;
+    }
+
+    // Plain values in host byte order, both ends are expected to be the same kind of machine
+    template <typename T>
+    bool send_value(const T& v) { return send_all(&v, sizeof v); }
+
+    template <typename T>
+    bool recv_value(T& v) { return recv_all(&v, sizeof v); }
+
+private:
+    static constexpr size_t chunk = 1 << 20; // send and recv take an int size on Windows
+
+    socket_handle s = invalid_socket;
+    std::string received; // Read past the last line recv_line returned
+};
+
+class listener {
+public:
+    listener() {}
+    ~listener() {
+        if (s != invalid_socket) { close_socket(s); }
+    }
+
+    listener(const listener&) = delete;
+    listener& operator=(const listener&) = delete;
+
+    // On every interface, or only 127.0.0.1 with loopback, port 0 picks a free one (see port())
+    bool listen_on(uint16_t wanted, bool loopback = false) {
+        s = socket(AF_INET, SOCK_STREAM, 0);
+        if (s == invalid_socket) { return false; }
+        int one = 1;
+        setsockopt(s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&one), sizeof one);
+
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(loopback ? INADDR_LOOPBACK : INADDR_ANY);
+        addr.sin_port = htons(wanted);
+        socklen_t len = sizeof addr;
+        if (bind(s, reinterpret_cast<sockaddr*>(&addr), len) != 0 || ::listen(s, 64) != 0
+            || getsockname(s, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+            return false;
+        }
+        bound_port = ntohs(addr.sin_port);
+        return true;
+    }
+
+    uint16_t port() const { return bound_port; }
+
+    // Waits up to the timeout for a peer, the connection isn't open if none came
+    connection accept_within(int milliseconds) {
+        fd_set ready;
+        FD_ZERO(&ready);
+        FD_SET(s, &ready);
+        timeval timeout = { milliseconds / 1000, (milliseconds % 1000) * 1000 };
+        if (select(int(s + 1), &ready, nullptr, nullptr, &timeout) <= 0) {
+            return connection();
+        }
+        socket_handle peer = ::accept(s, nullptr, nullptr);
+        return (peer == invalid_socket) ? connection() : connection(peer);
+    }
+
+private:
+    socket_handle s = invalid_socket;
+    uint16_t bound_port = 0;
+};
+
+#endif
@@ -0,0 +1,402 @@
+#pragma once
+#ifndef PNG_H
+#define PNG_H
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <utility>
+#include <cstdint>
+#include <vector>
+
+// Minimal PNG encoder for 8 bit RGB, no dependencies.
+// Every row gets the PNG filter (none, sub, up, average, Paeth) that leaves the smallest sum of residuals, then the
+// whole image is one deflate block: LZ77 matches from a hash chain, Huffman coded with trees built for the image.
+// Within a few percent of zlib's default level. Data no code makes smaller (pure noise) is stored instead.
+inline uint32_t png_crc32(const uint8_t* data, size_t len, uint32_t crc = 0) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t;
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            t[n] = c;
+        }
+        return t;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+inline void png_put_u32(std::vector<uint8_t>& out, uint32_t v) {
+    // PNG is big endian throughout
+    out.push_back(uint8_t(v >> 24));
+    out.push_back(uint8_t(v >> 16));
+    out.push_back(uint8_t(v >> 8));
+    out.push_back(uint8_t(v));
+}
+
+inline void png_put_chunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& body) {
+    png_put_u32(out, uint32_t(body.size()));
+    size_t crc_start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), body.begin(), body.end());
+    png_put_u32(out, png_crc32(&out[crc_start], out.size() - crc_start)); // CRC covers type and body
+}
+
+inline uint8_t png_paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) { return uint8_t(a); }
+    return uint8_t(pb <= pc ? b : c);
+}
+
+// Filter byte and filtered row for every row, the filter picked by the smallest sum of |residual| (as signed bytes),
+// the heuristic libpng uses
+inline std::vector<uint8_t> png_filter_rows(const uint8_t* rgb, size_t row_bytes, int height) {
+    const size_t bpp = 3;
+    std::vector<uint8_t> out;
+    out.reserve((row_bytes + 1) * height);
+    std::vector<uint8_t> zero(row_bytes, 0);
+    std::array<std::vector<uint8_t>, 5> rows;
+    for (auto& r : rows) { r.resize(row_bytes); }
+    for (int j = 0; j < height; j++) {
+        const uint8_t* cur = rgb + j * row_bytes;
+        const uint8_t* up = j > 0 ? rgb + (j - 1) * row_bytes : zero.data();
+        for (size_t i = 0; i < row_bytes; i++) {
+            int a = i >= bpp ? cur[i - bpp] : 0;
+            int c = i >= bpp ? up[i - bpp] : 0;
+            int b = up[i];
+            rows[0][i] = cur[i];
+            rows[1][i] = uint8_t(cur[i] - a);
+            rows[2][i] = uint8_t(cur[i] - b);
+            rows[3][i] = uint8_t(cur[i] - ((a + b) >> 1));
+            rows[4][i] = uint8_t(cur[i] - png_paeth(a, b, c));
+        }
+        int best = 0;
+        uint64_t best_sum = UINT64_MAX;
+        for (int f = 0; f < 5; f++) {
+            uint64_t sum = 0;
+            for (uint8_t v : rows[f]) { sum += uint64_t(std::abs(int(int8_t(v)))); }
+            if (sum < best_sum) {
+                best_sum = sum;
+                best = f;
+            }
+        }
+        out.push_back(uint8_t(best));
+        out.insert(out.end(), rows[best].begin(), rows[best].end());
+    }
+    return out;
+}
+
+// Deflate bits go in from the least significant end; Huffman codes are stored most significant bit first, so they
+// are reversed before going in
+struct png_bit_writer {
+    std::vector<uint8_t>& out;
+    uint64_t bits = 0;
+    int count = 0;
+
+    void put(uint32_t value, int n) {
+        bits |= uint64_t(value) << count;
+        count += n;
+        while (count >= 8) {
+            out.push_back(uint8_t(bits));
+            bits >>= 8;
+            count -= 8;
+        }
+    }
+
+    void put_code(uint32_t code, int n) {
+        uint32_t reversed = 0;
+        for (int k = 0; k < n; k++) { reversed |= ((code >> k) & 1) << (n - 1 - k); }
+        put(reversed, n);
+    }
+
+    void flush() {
+        if (count > 0) { out.push_back(uint8_t(bits)); }
+        bits = 0;
+        count = 0;
+    }
+};
+
+// Code lengths of a Huffman code for freq, none longer than limit. Symbols with frequency 0 get no code. Too long a
+// code halves every frequency (keeping them above 0) and builds again, which flattens the tree until it fits.
+inline std::vector<uint8_t> png_huffman_lengths(std::vector<uint32_t> freq, int limit) {
+    std::vector<uint8_t> lengths(freq.size(), 0);
+    for (;;) {
+        struct node { uint64_t weight; int left, right; };
+        std::vector<node> nodes;
+        std::vector<std::pair<uint64_t, int>> heap; // (weight, node), smallest on top
+        for (size_t s = 0; s < freq.size(); s++) {
+            if (freq[s] == 0) { continue; }
+            nodes.push_back({ freq[s], -1 - int(s), -1 });
+            heap.push_back({ freq[s], int(nodes.size()) - 1 });
+        }
+        auto later = [](const std::pair<uint64_t, int>& x, const std::pair<uint64_t, int>& y) { return x > y; };
+        std::make_heap(heap.begin(), heap.end(), later);
+        while (heap.size() > 1) {
+            std::pop_heap(heap.begin(), heap.end(), later);
+            auto x = heap.back();
+            heap.pop_back();
+            std::pop_heap(heap.begin(), heap.end(), later);
+            auto y = heap.back();
+            heap.pop_back();
+            nodes.push_back({ x.first + y.first, x.second, y.second });
+            heap.push_back({ x.first + y.first, int(nodes.size()) - 1 });
+            std::push_heap(heap.begin(), heap.end(), later);
+        }
+
+        // Depth first from the root; leaves keep their symbol as -1 - symbol in left
+        int longest = 0;
+        std::vector<std::pair<int, int>> stack = { { int(nodes.size()) - 1, 0 } };
+        while (!stack.empty()) {
+            auto [k, depth] = stack.back();
+            stack.pop_back();
+            if (nodes[k].left < 0) {
+                lengths[size_t(-1 - nodes[k].left)] = uint8_t(std::max(depth, 1));
+                longest = std::max(longest, depth);
+                continue;
+            }
+            stack.push_back({ nodes[k].left, depth + 1 });
+            stack.push_back({ nodes[k].right, depth + 1 });
+        }
+        if (longest <= limit) { return lengths; }
+        for (auto& f : freq) { f = f ? std::max(1u, f / 2) : 0; }
+    }
+}
+
+// Canonical codes for the lengths (RFC 1951 3.2.2)
+inline std::vector<uint16_t> png_canonical_codes(const std::vector<uint8_t>& lengths) {
+    uint16_t count[16] = {}, next[16] = {};
+    for (uint8_t l : lengths) { count[l]++; }
+    count[0] = 0;
+    uint16_t code = 0;
+    for (int bits = 1; bits < 16; bits++) {
+        code = uint16_t((code + count[bits - 1]) << 1);
+        next[bits] = code;
+    }
+    std::vector<uint16_t> codes(lengths.size(), 0);
+    for (size_t s = 0; s < lengths.size(); s++) {
+        if (lengths[s]) { codes[s] = next[lengths[s]]++; }
+    }
+    return codes;
+}
+
+// One final deflate block with Huffman codes built for the data: LZ77 matches found through a hash chain, then both
+// trees (literals and lengths, distances) sent run length coded in the block header
+inline void png_deflate(const std::vector<uint8_t>& data, std::vector<uint8_t>& out) {
+    static const uint16_t length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+                                              67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const uint8_t length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4,
+                                              5, 5, 5, 5, 0 };
+    static const uint16_t dist_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513,
+                                            769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    static const uint8_t dist_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10,
+                                            11, 11, 12, 12, 13, 13 };
+    static const uint8_t length_order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    const size_t window = 32768, min_match = 3, max_match = 258;
+    const int max_chain = 32; // Candidates tried per position, more finds longer matches for a little more time
+    const int hash_bits = 15;
+
+    // Matches as (length, distance), literals as (byte, 0)
+    struct token { uint16_t value, dist; };
+    std::vector<token> tokens;
+    tokens.reserve(data.size() / 2);
+    std::vector<uint32_t> lit_freq(286, 0), dist_freq(30, 0);
+
+    size_t n = data.size();
+    std::vector<int32_t> head(size_t(1) << hash_bits, -1);
+    std::vector<int32_t> prev(window, -1);
+    auto hash = [&](size_t i) {
+        uint32_t v = uint32_t(data[i]) | uint32_t(data[i + 1]) << 8 | uint32_t(data[i + 2]) << 16;
+        return (v * 2654435761u) >> (32 - hash_bits);
+    };
+    auto insert = [&](size_t i) {
+        if (i + min_match > n) { return; }
+        uint32_t h = hash(i);
+        prev[i % window] = head[h];
+        head[h] = int32_t(i);
+    };
+    auto length_code = [&](size_t len) {
+        return int(std::upper_bound(length_base, length_base + 29, uint16_t(len)) - length_base) - 1;
+    };
+    auto dist_code = [&](size_t dist) {
+        return int(std::upper_bound(dist_base, dist_base + 30, uint16_t(dist)) - dist_base) - 1;
+    };
+
+    size_t i = 0;
+    while (i < n) {
+        size_t best_len = 0, best_dist = 0;
+        if (i + min_match <= n) {
+            size_t limit = std::min(max_match, n - i);
+            int32_t candidate = head[hash(i)];
+            for (int chain = 0; candidate >= 0 && chain < max_chain; chain++) {
+                size_t c = size_t(candidate);
+                if (i - c > window - 1) { break; }
+                if (data[c + best_len] == data[i + best_len]) {
+                    size_t len = 0;
+                    while (len < limit && data[c + len] == data[i + len]) { len++; }
+                    if (len > best_len) {
+                        best_len = len;
+                        best_dist = i - c;
+                        if (len == limit) { break; }
+                    }
+                }
+                int32_t next = prev[c % window];
+                if (next >= candidate) { break; } // Slot already reused by a newer position
+                candidate = next;
+            }
+        }
+        if (best_len >= min_match) {
+            tokens.push_back({ uint16_t(best_len), uint16_t(best_dist) });
+            lit_freq[size_t(257 + length_code(best_len))]++;
+            dist_freq[size_t(dist_code(best_dist))]++;
+            for (size_t k = 0; k < best_len; k++) { insert(i + k); }
+            i += best_len;
+        }
+        else {
+            tokens.push_back({ data[i], 0 });
+            lit_freq[data[i]]++;
+            insert(i);
+            i++;
+        }
+    }
+    lit_freq[256] = 1; // End of block
+    // Every tree gets at least two codes, decoders differ on what to make of a tree with one or none
+    for (auto* freq : { &lit_freq, &dist_freq }) {
+        for (size_t s = 0; size_t(std::count(freq->begin(), freq->end(), 0u)) + 2 > freq->size(); s++) {
+            (*freq)[s] = std::max((*freq)[s], 1u);
+        }
+    }
+
+    std::vector<uint8_t> lit_lengths = png_huffman_lengths(lit_freq, 15);
+    std::vector<uint8_t> dist_lengths = png_huffman_lengths(dist_freq, 15);
+    std::vector<uint16_t> lit_codes = png_canonical_codes(lit_lengths);
+    std::vector<uint16_t> dist_codes = png_canonical_codes(dist_lengths);
+    size_t hlit = 286, hdist = 30;
+    while (hlit > 257 && lit_lengths[hlit - 1] == 0) { hlit--; }
+    while (hdist > 1 && dist_lengths[hdist - 1] == 0) { hdist--; }
+
+    // Both trees' lengths as one sequence, runs coded with 16 (repeat the last 3-6 times), 17 and 18 (3-10 and
+    // 11-138 zeros); in symbols is the length code, extra its repeat count
+    std::vector<uint8_t> all(lit_lengths.begin(), lit_lengths.begin() + long(hlit));
+    all.insert(all.end(), dist_lengths.begin(), dist_lengths.begin() + long(hdist));
+    std::vector<std::pair<uint8_t, uint8_t>> runs;
+    std::vector<uint32_t> run_freq(19, 0);
+    for (size_t k = 0; k < all.size(); ) {
+        size_t run = 1;
+        while (k + run < all.size() && all[k + run] == all[k]) { run++; }
+        if (all[k] == 0 && run >= 3) {
+            run = std::min<size_t>(run, 138);
+            runs.push_back({ uint8_t(run <= 10 ? 17 : 18), uint8_t(run - (run <= 10 ? 3 : 11)) });
+        }
+        else if (all[k] != 0 && run >= 4) {
+            run = std::min<size_t>(run, 7);
+            runs.push_back({ all[k], 0 });
+            runs.push_back({ 16, uint8_t(run - 4) });
+        }
+        else {
+            run = 1;
+            runs.push_back({ all[k], 0 });
+        }
+        k += run;
+    }
+    for (auto& r : runs) { run_freq[r.first]++; }
+    std::vector<uint8_t> run_lengths = png_huffman_lengths(run_freq, 7);
+    std::vector<uint16_t> run_codes = png_canonical_codes(run_lengths);
+    size_t hclen = 19;
+    while (hclen > 4 && run_lengths[length_order[hclen - 1]] == 0) { hclen--; }
+
+    png_bit_writer w{ out };
+    w.put(1, 1); // Last block
+    w.put(2, 2); // Dynamic Huffman codes
+    w.put(uint32_t(hlit - 257), 5);
+    w.put(uint32_t(hdist - 1), 5);
+    w.put(uint32_t(hclen - 4), 4);
+    for (size_t k = 0; k < hclen; k++) { w.put(run_lengths[length_order[k]], 3); }
+    for (auto& r : runs) {
+        w.put_code(run_codes[r.first], run_lengths[r.first]);
+        if (r.first == 16) { w.put(r.second, 2); }
+        else if (r.first == 17) { w.put(r.second, 3); }
+        else if (r.first == 18) { w.put(r.second, 7); }
+    }
+
+    for (const token& t : tokens) {
+        if (t.dist == 0) {
+            w.put_code(lit_codes[t.value], lit_lengths[t.value]);
+            continue;
+        }
+        int code = length_code(t.value);
+        w.put_code(lit_codes[size_t(257 + code)], lit_lengths[size_t(257 + code)]);
+        w.put(uint32_t(t.value - length_base[code]), length_extra[code]);
+        int dcode = dist_code(t.dist);
+        w.put_code(dist_codes[size_t(dcode)], dist_lengths[size_t(dcode)]);
+        w.put(uint32_t(t.dist - dist_base[dcode]), dist_extra[dcode]);
+    }
+    w.put_code(lit_codes[256], lit_lengths[256]);
+    w.flush();
+}
+
+// Stored (uncompressed) blocks, each at most 65535 bytes
+inline void png_deflate_stored(const std::vector<uint8_t>& data, std::vector<uint8_t>& out) {
+    size_t pos = 0;
+    do {
+        size_t len = std::min<size_t>(65535, data.size() - pos);
+        bool last = (pos + len == data.size());
+        out.push_back(last ? 1 : 0);
+        out.push_back(uint8_t(len));
+        out.push_back(uint8_t(len >> 8));
+        out.push_back(uint8_t(~len));
+        out.push_back(uint8_t(~len >> 8));
+        out.insert(out.end(), data.begin() + pos, data.begin() + pos + len);
+        pos += len;
+    } while (pos < data.size());
+}
+
+// rgb is width * height * 3 bytes, rows from the top. Returns the complete file.
+inline std::vector<uint8_t> encode_png(const uint8_t* rgb, int width, int height) {
+    std::vector<uint8_t> file = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+    std::vector<uint8_t> ihdr;
+    png_put_u32(ihdr, uint32_t(width));
+    png_put_u32(ihdr, uint32_t(height));
+    ihdr.push_back(8); // bit depth
+    ihdr.push_back(2); // color type RGB
+    ihdr.push_back(0); // deflate
+    ihdr.push_back(0); // adaptive filtering
+    ihdr.push_back(0); // no interlace
+    png_put_chunk(file, "IHDR", ihdr);
+
+    size_t row_bytes = size_t(width) * 3;
+    std::vector<uint8_t> raw = png_filter_rows(rgb, row_bytes, height);
+
+    std::vector<uint8_t> idat = { 0x78, 0x01 }; // zlib header: deflate, 32K window
+    png_deflate(raw, idat);
+    if (idat.size() > raw.size() + raw.size() / 65535 * 5 + 7) { // Noise that no code makes smaller
+        idat.resize(2);
+        png_deflate_stored(raw, idat);
+    }
+
+    uint32_t a = 1, b = 0; // Adler-32 of the uncompressed data
+    for (size_t i = 0; i < raw.size(); ) {
+        size_t block_end = std::min(raw.size(), i + 5552); // Longest run that can't overflow b before the modulo
+        for (; i < block_end; i++) {
+            a += raw[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    png_put_u32(idat, (b << 16) | a);
+    png_put_chunk(file, "IDAT", idat);
+
+    png_put_chunk(file, "IEND", {});
+    return file;
+}
+
+#endif
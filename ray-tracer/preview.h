@@ -0,0 +1,238 @@
+#pragma once
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include "camera.h"
+#include "image_io.h"
+#include "net.h"
+#include "scene.h"
+
+// Interactive preview (ray-tracer scene.txt --preview [port]): the scene is loaded and built once, then edits come in
+// as text lines, on stdin or from one client of a TCP port on 127.0.0.1:
+//   camera <field> <value...>                   any camera field, as in scene files ("camera lookfrom 0 1 3")
+//   material <name> <type> <values...>          a material of the scene file changed in place (scene::update_material)
+//   quit
+// Every edit cancels the render in flight and starts the view over, first at 1/8 of the size with one sample per
+// pixel, then 1/4 and 1/2, then at full size a pass at a time until samples_per_pix. Each of those goes back as a
+// frame: a preview_frame_header, then width * height * 3 bytes of gamma corrected RGB, on stdout or the connection.
+
+struct preview_frame_header {
+    char magic[4]; // "RTPF"
+    uint32_t edit; // How many edits the view had, a client can drop frames of one it has moved on from
+    uint32_t width;
+    uint32_t height;
+    uint32_t samples_per_pixel;
+    uint32_t last; // 1 on the view's final frame: every sample in, and denoised if the camera denoises
+    double seconds; // From the edit arriving to the frame going out
+};
+static_assert(sizeof(preview_frame_header) == 32, "preview_frame_header is sent as it is in memory");
+
+// What one edit took to show, in seconds from the edit arriving. -1 for what never happened because the next edit
+// came first.
+struct preview_edit {
+    std::string statement;
+    double first_frame = -1;
+    double full_size = -1; // First frame at the full size
+    double finished = -1; // Last frame
+    int frames = 0;
+};
+
+class preview_server {
+public:
+    int first_scale = 8; // The first frame is this many times smaller each way, a power of two
+    int samples_per_pass = 1; // At full size, a frame goes out after every pass
+
+    preview_server(scene& s, const hittable& world) : s(s), world(world) {}
+
+    // Shows the scene's view, then applies every line read_line returns and starts over, until it returns false or
+    // a quit. Frames go through send, false from it ends the view (the client is gone).
+    void run(const std::function<bool(std::string&)>& read_line, const std::function<bool(const void*, size_t)>& send) {
+        sender = send;
+        start("(initial view)", std::chrono::steady_clock::now());
+        std::string line;
+        while (read_line(line)) {
+            auto arrived = std::chrono::steady_clock::now();
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            size_t first = line.find_first_not_of(" \t");
+            if (first == std::string::npos || line[first] == '#') { continue; }
+            line.erase(0, first);
+            if (line == "quit") { break; }
+
+            stop(); // Materials can't change under a render
+            if (!apply(line)) { std::cerr << "Preview: can't apply \"" << line << "\"\n"; }
+            start(line, arrived);
+        }
+        stop();
+        report();
+    }
+
+    const std::vector<preview_edit>& edits() const { return history; }
+
+    // Medians and worst case over the edits so far, on std::clog
+    void report() const {
+        std::vector<double> first, full;
+        for (const auto& e : history) {
+            if (e.first_frame >= 0) { first.push_back(e.first_frame); }
+            if (e.full_size >= 0) { full.push_back(e.full_size); }
+        }
+        if (first.empty()) { return; }
+        std::clog << "Preview: " << history.size() << " views, first frame in " << 1000 * median(first)
+                  << " ms median, " << 1000 * *std::max_element(first.begin(), first.end()) << " ms worst";
+        if (!full.empty()) { std::clog << ", full size in " << 1000 * median(full) << " ms median"; }
+        std::clog << '\n';
+    }
+
+private:
+    scene& s;
+    const hittable& world;
+    std::function<bool(const void*, size_t)> sender;
+    std::vector<preview_edit> history; // The render thread only writes to the last one, which start() added
+    std::thread renderer;
+    std::atomic<bool> cancelling{ false };
+
+    bool apply(const std::string& line) {
+        if (line.compare(0, 9, "material ") == 0) {
+            return s.update_material(line);
+        }
+        if (line.compare(0, 7, "camera ") != 0) { return false; }
+        size_t field_begin = line.find_first_not_of(" \t", 7);
+        if (field_begin == std::string::npos) { return false; }
+        size_t field_end = line.find_first_of(" \t", field_begin);
+        if (field_end == std::string::npos) { return false; }
+        size_t value_begin = line.find_first_not_of(" \t", field_end);
+        if (value_begin == std::string::npos) { return false; }
+        return set_camera_field(s.cam, line.substr(field_begin, field_end - field_begin), line.c_str() + value_begin);
+    }
+
+    void start(const std::string& statement, std::chrono::steady_clock::time_point arrived) {
+        history.emplace_back();
+        history.back().statement = statement;
+        cancelling = false;
+        renderer = std::thread([this, arrived] { refine(history.back(), uint32_t(history.size() - 1), arrived); });
+    }
+
+    void stop() {
+        cancelling = true;
+        if (renderer.joinable()) { renderer.join(); }
+    }
+
+    // Runs on the render thread, a copy of the scene's camera does the rendering so an edit never races it
+    void refine(preview_edit& edit, uint32_t edit_number, std::chrono::steady_clock::time_point arrived) {
+        camera view = s.cam;
+        view.output_path.clear();
+        view.checkpoint_path.clear();
+        view.heatmap_path.clear();
+        view.aov_path.clear();
+        view.time_budget = 0;
+        view.adaptive = false;
+        view.verbose = false;
+        view.cancel = &cancelling;
+        int width = s.cam.image_width;
+        int samples = std::max(1, s.cam.samples_per_pix);
+        bool denoise = s.cam.denoise;
+
+        auto send_frame = [&](const framebuffer& fb, int spp, bool last) {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - arrived).count();
+            preview_frame_header header = { { 'R', 'T', 'P', 'F' }, edit_number, uint32_t(fb.width()),
+                                            uint32_t(fb.height()), uint32_t(spp), last ? 1u : 0u, seconds };
+            std::vector<uint8_t> rgb = to_rgb8(fb);
+            if (!sender(&header, sizeof header) || !sender(rgb.data(), rgb.size())) {
+                cancelling = true;
+                return;
+            }
+            if (edit.frames++ == 0) { edit.first_frame = seconds; }
+            if (fb.width() == width && edit.full_size < 0) { edit.full_size = seconds; }
+            if (last) { edit.finished = seconds; }
+        };
+
+        for (int scale = first_scale; scale > 1; scale /= 2) {
+            if (width / scale < 8) { continue; } // Too small to be worth a frame
+            view.image_width = width / scale;
+            view.samples_per_pix = 1;
+            view.progressive = false;
+            view.denoise = false;
+            view.render(world);
+            if (cancelling) {
+                log(edit);
+                return;
+            }
+            send_frame(view.image(), 1, false);
+        }
+
+        view.image_width = width;
+        view.samples_per_pix = samples;
+        view.progressive = true;
+        view.samples_per_pass = std::max(1, samples_per_pass);
+        view.denoise = denoise;
+        view.on_pass = [&](const framebuffer& fb, int spp) {
+            if (!cancelling) { send_frame(fb, spp, spp >= samples && !denoise); }
+        };
+        view.render(world);
+        if (!cancelling && denoise) { send_frame(view.image(), samples, true); }
+        log(edit);
+    }
+
+    static void log(const preview_edit& e) {
+        std::clog << "Preview " << e.statement << ": ";
+        if (e.first_frame < 0) {
+            std::clog << "replaced before its first frame\n";
+            return;
+        }
+        std::clog << "first frame in " << 1000 * e.first_frame << " ms";
+        if (e.full_size >= 0) { std::clog << ", full size in " << 1000 * e.full_size << " ms"; }
+        if (e.finished >= 0) { std::clog << ", done in " << e.finished << " s"; }
+        else { std::clog << ", replaced after " << e.frames << " frames"; }
+        std::clog << '\n';
+    }
+
+    static double median(std::vector<double> v) {
+        std::sort(v.begin(), v.end());
+        return v[v.size() / 2];
+    }
+};
+
+// Edits from stdin, frames to stdout
+inline void run_preview_stdio(preview_server& server) {
+#if defined(_WIN32)
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    server.run([](std::string& line) { return bool(std::getline(std::cin, line)); },
+        [](const void* data, size_t size) {
+            return std::fwrite(data, 1, size, stdout) == size && std::fflush(stdout) == 0;
+        });
+}
+
+// Edits and frames over a connection to 127.0.0.1:port, one client, which ends the preview when it goes
+inline bool run_preview_socket(preview_server& server, uint16_t port) {
+    listener l;
+    if (!net_startup() || !l.listen_on(port, true)) {
+        std::cerr << "Can't listen on port " << port << '\n';
+        return false;
+    }
+    std::clog << "Preview listening on 127.0.0.1:" << l.port() << '\n';
+    connection client;
+    while (!client.is_open()) {
+        client = l.accept_within(1000);
+    }
+    server.run([&](std::string& line) { return client.recv_line(line); },
+        [&](const void* data, size_t size) { return client.send_all(data, size); });
+    return true;
+}
+
+#endif
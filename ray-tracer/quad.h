@@ -0,0 +1,92 @@
+#pragma once
+#ifndef QUAD_H
+#define QUAD_H
+
+#include <cmath>
+
+#include "hittable.h"
+#include "rtweekend.h"
+
+// Parallelogram with a corner at q and sides u and v, facing along cross(u, v). Mostly for area lights, which
+// only shine from the front (see diffuse_light), but any material works on it.
+class quad : public hittable {
+public:
+    quad(const point3& q, const vec3& u, const vec3& v, const material* mat) : q(q), u(u), v(v), mat(mat) {
+        vec3 n = cross(u, v);
+        area = n.length();
+        normal = n / area;
+        plane_d = dot(normal, q);
+        w = n / dot(n, n);
+
+        // Padded so a quad lying in an axis plane still has a box a ray can enter
+        const real pad = real(1e-4);
+        point3 far = q + u + v;
+        point3 lo(std::fmin(std::fmin(q.x(), far.x()), std::fmin((q + u).x(), (q + v).x())) - pad,
+                  std::fmin(std::fmin(q.y(), far.y()), std::fmin((q + u).y(), (q + v).y())) - pad,
+                  std::fmin(std::fmin(q.z(), far.z()), std::fmin((q + u).z(), (q + v).z())) - pad);
+        point3 hi(std::fmax(std::fmax(q.x(), far.x()), std::fmax((q + u).x(), (q + v).x())) + pad,
+                  std::fmax(std::fmax(q.y(), far.y()), std::fmax((q + u).y(), (q + v).y())) + pad,
+                  std::fmax(std::fmax(q.z(), far.z()), std::fmax((q + u).z(), (q + v).z())) + pad);
+        bbox = aabb(lo, hi);
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        real t;
+        if (!intersect(r, ray_t, t)) {
+            return false;
+        }
+        rec.t = t;
+        rec.p = r.at(t);
+        rec.set_face_normal(r, normal);
+        rec.mat = mat;
+        return true;
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        real t;
+        return intersect(r, ray_t, t);
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    // As a light (lights.h): a point uniform over the area, as a direction from p. False from behind, where the
+    // quad doesn't shine.
+    bool sample_toward(const point3& p, double a, double b, light_sample& s) const {
+        if (dot(normal, p) - plane_d <= 0) { return false; }
+        vec3 to_light = q + real(a) * u + real(b) * v - p;
+        real d2 = to_light.length_squared();
+        s.distance = std::sqrt(d2);
+        s.direction = to_light / s.distance;
+        s.pdf = pdf_toward(s.direction, s.distance);
+        return true;
+    }
+
+    // Density of sample_toward for a unit direction that meets the quad at distance, per unit solid angle
+    real pdf_toward(const vec3& direction, real distance) const {
+        real cosine = std::fabs(dot(normal, direction));
+        return cosine > 0 ? distance * distance / (cosine * area) : 0;
+    }
+
+private:
+    point3 q;
+    vec3 u, v;
+    vec3 normal; // Unit
+    vec3 w; // cross(u, v) / |cross(u, v)|^2, turns a point of the plane into its (a, b) along u and v
+    real plane_d; // dot(normal, x) for every x in the plane
+    real area;
+    const material* mat;
+    aabb bbox;
+
+    bool intersect(const ray& r, interval ray_t, real& t) const {
+        real denom = dot(normal, r.direction());
+        if (std::fabs(denom) < real(1e-8)) { return false; } // Along the plane
+        t = (plane_d - dot(normal, r.origin())) / denom;
+        if (!ray_t.surrounds(t)) { return false; }
+        vec3 planar = r.at(t) - q;
+        real a = dot(w, cross(planar, v));
+        real b = dot(w, cross(u, planar));
+        return a >= 0 && a <= 1 && b >= 0 && b <= 1;
+    }
+};
+
+#endif
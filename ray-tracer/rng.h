@@ -0,0 +1,52 @@
+#pragma once
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>
+
+// PCG32 (O'Neill, pcg-random.org): 64 bits of state, 32 bit output, 2^63 selectable streams.
+// Small enough to make one per sample, so every sample can be seeded from (pixel, sample, frame)
+// and a render gives the same image no matter which thread drew which sample.
+class pcg32 {
+public:
+    pcg32() : pcg32(0x853c49e6748fea9bULL, 0xda3e39cb94b95bdbULL) {}
+
+    pcg32(uint64_t seed, uint64_t stream) {
+        state = 0;
+        inc = (stream << 1u) | 1u; // Increment must be odd
+        next_uint();
+        state += seed;
+        next_uint();
+    }
+
+    // Generator for one sample of one pixel. The pixel and frame pick the seed, the sample picks the stream.
+    static pcg32 for_sample(uint32_t pixel, uint32_t sample, uint32_t frame) {
+        return pcg32(mix(uint64_t(frame) << 32 | pixel), sample);
+    }
+
+    uint32_t next_uint() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + inc;
+        uint32_t xorshifted = uint32_t(((old >> 18u) ^ old) >> 27u);
+        uint32_t rot = uint32_t(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+    }
+
+    double next_double() {
+        // [0,1) with 32 bits of resolution (std::rand gave 15 on MSVC)
+        return next_uint() * (1.0 / 4294967296.0);
+    }
+
+private:
+    uint64_t state;
+    uint64_t inc;
+
+    static uint64_t mix(uint64_t x) {
+        // splitmix64 finalizer so neighbouring pixels get unrelated seeds
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+};
+
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+#ifndef ROULETTE_H
+#define ROULETTE_H
+
+#include <cmath>
+
+#include "color.h"
+#include "rtweekend.h"
+#include "sampler.h"
+
+// Russian roulette: once a path has traced depth rays, each further bounce only happens with probability p, the
+// largest channel of its throughput (capped at max_survival), and a surviving path's throughput is divided by p.
+// Dim paths mostly end early and the few that carry on make up for the rest, so the expected value of every sample
+// is unchanged; max_depth stays as a hard limit on top.
+struct roulette_settings {
+    bool enabled = true;
+    int depth = 3; // Rays every path traces before roulette can end it
+    double max_survival = 0.95; // Below 1 so paths that lose nothing (glass, perfect mirrors) end eventually too
+
+    // traced is how many rays the path has traced so far. Scales throughput when the path survives.
+    bool survives(int traced, color& throughput, path_sampler& sampler) const {
+        if (!enabled || traced < depth) { return true; }
+        real p = std::fmin(std::fmax(throughput.x(), std::fmax(throughput.y(), throughput.z())), real(max_survival));
+        if (random_double(sampler) >= p) { return false; } // Also ends paths with nothing left to carry
+        throughput /= p;
+        return true;
+    }
+};
+
+#endif
@@ -6,12 +6,22 @@
 #include <limits>
 #include <memory>
 
+#include "rng.h"
+
 
 // C++ Std Usings
 
 using std::make_shared;
 using std::shared_ptr;
 
+// Precision of all the geometry (vectors, rays, intervals, hit records). Double unless built with RT_FLOAT, which
+// halves the size of everything the renderer moves around, for previews.
+#ifdef RT_FLOAT
+using real = float;
+#else
+using real = double;
+#endif
+
 // Constants
 
 const double infinity = std::numeric_limits<double>::infinity();
@@ -23,13 +33,40 @@ inline double degrees_to_radians(double degrees) {
     return degrees * pi / 180.0;
 }
 
-inline double random_double() {
+inline void sin_cos(double x, double& s, double& c) {
+    // Both at once in a fixed number of operations, no libm call: x is brought to [-pi/4, pi/4] around the nearest
+    // multiple of pi/2, where short Taylor polynomials are good to about 4e-13, and that multiple's quadrant picks
+    // which is which. Only selects, so loops over arrays of angles can vectorize. For |x| up to about a million.
+    double y = x * (2 / pi) + 0.5;
+    int q = int(y);
+    q -= (y < q); // floor, for negative angles too
+    // pi/2 split Cody-Waite style: the high part has 31 significant bits, so q times it is exact for |q| < 2^20 and
+    // so is subtracting that from x. The low part only adds about q * 1e-27, r is within an ulp or so.
+    double r = (x - q * 1.57079632673412561417) - q * 6.07710050650619224932e-11;
+    double r2 = r * r;
+    double sr = r + r * r2 * (-1.0 / 6 + r2 * (1.0 / 120 + r2 * (-1.0 / 5040 + r2 * (1.0 / 362880
+                + r2 * (-1.0 / 39916800 + r2 * (1.0 / 6227020800))))));
+    double cr = 1 + r2 * (-0.5 + r2 * (1.0 / 24 + r2 * (-1.0 / 720 + r2 * (1.0 / 40320 + r2 * (-1.0 / 3628800
+                + r2 * (1.0 / 479001600))))));
+    double s0 = (q & 1) ? cr : sr;
+    double c0 = (q & 1) ? sr : cr;
+    s = (q & 2) ? -s0 : s0;
+    c = ((q + 1) & 2) ? -c0 : c0;
+}
+
+inline pcg32& thread_rng() {
+    // Generator for code that isn't handed one (scene setup). Per thread so nothing is shared or locked.
+    thread_local pcg32 rng;
+    return rng;
+}
+
+inline double random_double(pcg32& rng = thread_rng()) {
     // random real in [0,1)
-    return std::rand() / (RAND_MAX + 1.0);
+    return rng.next_double();
 }
 
-inline double random_double(double min, double max) {
-    return (max - min) * random_double() + min;
+inline double random_double(double min, double max, pcg32& rng = thread_rng()) {
+    return (max - min) * random_double(rng) + min;
 }
 
 // Common Headers
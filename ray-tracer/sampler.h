@@ -0,0 +1,333 @@
+#pragma once
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "rng.h"
+#include "rtweekend.h"
+
+// Where a camera sample gets its random numbers from. Every number a path draws has a dimension, counted from 0 in
+// the order the path asks for them: the pixel offset (0, 1), the lens (2, 3, with defocus), then whatever the
+// bounces take (a material's scatter, roulette). The samplers other than random spread the samples of a pixel
+// evenly over each dimension instead of letting them clump, so the pixel converges faster than 1/sqrt(N).
+//   random      independent uniform numbers from the sample's pcg32, what the renderer always did
+//   stratified  jittered strata: the samples_per_pix samples of a pixel each land in their own cell of a grid,
+//               shuffled differently per pixel and dimension. When samples_per_pix isn't a square the grid has
+//               a few cells more than samples, and some stay empty rather than others being used twice.
+//   sobol       Owen scrambled Sobol (0,2) points, padded: every pair of dimensions gets its own scramble and its
+//               own shuffle of the sample order (Burley, "Practical Hash-based Owen Scrambling", 2020). Best with a
+//               power of two samples_per_pix, and the first 2^k samples of any run are well spread too.
+//   blue_noise  the same padded Sobol points in every pixel, each pixel's toroidally shifted by a blue noise mask
+//               (Georgiev and Fajardo, "Blue-noise Dithered Sampling", 2016). Error of the same size as sobol,
+//               but spread as high frequency noise between neighbouring pixels, which the eye (and a denoiser)
+//               sees less of at low sample counts.
+// Whatever the sampler, a sample's numbers depend only on (pixel, sample, frame), so images stay the same for any
+// thread count, tiling or split into passes.
+enum class sampler_type {
+    random,
+    stratified,
+    sobol,
+    blue_noise
+};
+
+struct sampler_settings {
+    sampler_type type = sampler_type::random;
+    int samples_per_pixel = 1; // Stratified needs it for its grid
+    uint32_t frame = 0;
+};
+
+// Integer hashing and permutations the samplers are built from
+inline uint32_t sample_hash(uint32_t a, uint32_t b, uint32_t c = 0) {
+    uint64_t x = (uint64_t(a) << 32 | b) ^ (uint64_t(c) * 0x9e3779b97f4a7c15ULL);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return uint32_t(x ^ (x >> 31));
+}
+
+// Cheap 32 bit finalizer (Wellons' lowbias32), for seeds derived from one sample_hash
+inline uint32_t mix_bits(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    return x ^ (x >> 16);
+}
+
+inline uint32_t reverse_bits(uint32_t x) {
+#if defined(__GNUC__)
+    x = __builtin_bswap32(x);
+#else
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+#endif
+    x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+    return x;
+}
+
+// Owen scrambling of a 32 bit fraction is this on its bits in reverse order: every bit is flipped or not
+// depending on the seed and all the bits below it (Laine and Karras' hash, with Burley's constants). Applied to a
+// sample index it is also a shuffle that keeps every aligned power of two block of indices together.
+inline uint32_t laine_karras(uint32_t x, uint32_t seed) {
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+inline uint32_t owen_scramble(uint32_t x, uint32_t seed) {
+    return reverse_bits(laine_karras(reverse_bits(x), seed));
+}
+
+// Element i of a random permutation of [0, n) picked by seed, without building it (Kensler, "Correlated
+// Multi-Jittered Sampling", 2013)
+inline uint32_t permutation_element(uint32_t i, uint32_t n, uint32_t seed) {
+    uint32_t w = n - 1;
+    w |= w >> 1; w |= w >> 2; w |= w >> 4; w |= w >> 8; w |= w >> 16;
+    do {
+        i ^= seed; i *= 0xe170893d; i ^= seed >> 16; i ^= (i & w) >> 4; i ^= seed >> 8; i *= 0x0929eb3f;
+        i ^= seed >> 23; i ^= (i & w) >> 1; i *= 1 | seed >> 27; i *= 0x6935fa69; i ^= (i & w) >> 11;
+        i *= 0x74dcb303; i ^= (i & w) >> 2; i *= 0x9e501cc3; i ^= (i & w) >> 2; i *= 0xc860a3df; i &= w;
+        i ^= i >> 5;
+    } while (i >= n);
+    return (i + seed) % n;
+}
+
+// Columns and rows of the stratified sampler's grid for a pixel's samples: as square as it gets with at least one
+// cell per sample, at most x - 1 of them left over
+inline void stratified_grid(uint32_t samples, uint32_t& x, uint32_t& y) {
+    x = std::max(1u, uint32_t(std::sqrt(double(samples))));
+    y = (samples + x - 1) / x;
+}
+
+// The first two Sobol dimensions, as 32 bit fractions with their bits reversed since that is what Owen scrambling
+// works on: the van der Corput sequence, which reversed is the index itself, and the dimension built from x + 1,
+// whose direction numbers are xored together a byte of the index at a time from tables made at compile time.
+inline uint32_t sobol_0_reversed(uint32_t index) { return index; }
+
+struct sobol_1_tables {
+    uint32_t bytes[4][256] = {};
+
+    constexpr sobol_1_tables() {
+        uint32_t directions[32] = {}; // Reversed, so the first one is the lowest bit
+        directions[0] = 1;
+        for (int k = 1; k < 32; k++) { directions[k] = directions[k - 1] ^ (directions[k - 1] << 1); }
+        for (int b = 0; b < 4; b++) {
+            for (int x = 0; x < 256; x++) {
+                for (int bit = 0; bit < 8; bit++) {
+                    if ((x >> bit) & 1) { bytes[b][x] ^= directions[b * 8 + bit]; }
+                }
+            }
+        }
+    }
+};
+
+inline constexpr sobol_1_tables sobol_1_table{};
+
+inline uint32_t sobol_1_reversed(uint32_t index) {
+    return sobol_1_table.bytes[0][index & 0xff] ^ sobol_1_table.bytes[1][(index >> 8) & 0xff]
+         ^ sobol_1_table.bytes[2][(index >> 16) & 0xff] ^ sobol_1_table.bytes[3][index >> 24];
+}
+
+// Owen scrambled Sobol point of dimension 0 or 1 as a number in [0, 1)
+inline double scrambled_sobol(uint32_t reversed, uint32_t seed) {
+    return reverse_bits(laine_karras(reversed, seed)) * (1.0 / 4294967296.0);
+}
+
+// 64 x 64 tile of ranks spread as blue noise, by void and cluster (Ulichney, 1993): pixels are switched on one at
+// a time, always in the largest void of the ones already on. Built on first use, a few tens of milliseconds.
+const int blue_noise_size = 64;
+
+inline const std::vector<float>& blue_noise_mask() {
+    static const std::vector<float> mask = [] {
+        const int n = blue_noise_size, count = n * n;
+        std::vector<double> kernel(count); // Gaussian energy by toroidal offset
+        for (int y = 0; y < n; y++) {
+            for (int x = 0; x < n; x++) {
+                int dx = std::min(x, n - x), dy = std::min(y, n - y);
+                kernel[y * n + x] = std::exp(-(dx * dx + dy * dy) / (2 * 1.5 * 1.5));
+            }
+        }
+        auto splat = [&](std::vector<double>& energy, int p, double sign) {
+            int px = p % n, py = p / n;
+            for (int y = 0; y < n; y++) {
+                const double* row = &kernel[((y - py + n) % n) * n];
+                for (int x = 0; x < n; x++) { energy[y * n + x] += sign * row[(x - px + n) % n]; }
+            }
+        };
+        // Tightest cluster: the pixel that is on with the most energy. Largest void: off with the least.
+        auto tightest = [&](const std::vector<double>& energy, const std::vector<uint8_t>& on) {
+            int best = -1;
+            for (int p = 0; p < count; p++) {
+                if (on[p] && (best < 0 || energy[p] > energy[best])) { best = p; }
+            }
+            return best;
+        };
+        auto largest_void = [&](const std::vector<double>& energy, const std::vector<uint8_t>& on) {
+            int best = -1;
+            for (int p = 0; p < count; p++) {
+                if (!on[p] && (best < 0 || energy[p] < energy[best])) { best = p; }
+            }
+            return best;
+        };
+
+        // A tenth of the pixels at random, then moved from the tightest cluster to the largest void until settled
+        pcg32 rng(1, 1);
+        std::vector<uint8_t> on(count, 0);
+        std::vector<double> energy(count, 0.0);
+        int initial = count / 10;
+        for (int placed = 0; placed < initial;) {
+            int p = int(rng.next_uint() % uint32_t(count));
+            if (!on[p]) { on[p] = 1; splat(energy, p, 1); placed++; }
+        }
+        for (int moves = 0; moves < count; moves++) {
+            int cluster = tightest(energy, on);
+            on[cluster] = 0;
+            splat(energy, cluster, -1);
+            int hole = largest_void(energy, on);
+            on[hole] = 1;
+            splat(energy, hole, 1);
+            if (hole == cluster) { break; }
+        }
+
+        std::vector<int> rank(count);
+        std::vector<uint8_t> taken = on; // Ranks below the initial pattern's size by taking its clusters out
+        std::vector<double> taken_energy = energy;
+        for (int r = initial - 1; r >= 0; r--) {
+            int p = tightest(taken_energy, taken);
+            taken[p] = 0;
+            splat(taken_energy, p, -1);
+            rank[p] = r;
+        }
+        for (int r = initial; r < count; r++) { // The rest by filling voids; past half the voids are the minority
+            int p = largest_void(energy, on);
+            on[p] = 1;
+            splat(energy, p, 1);
+            rank[p] = r;
+        }
+
+        std::vector<float> values(count);
+        for (int p = 0; p < count; p++) { values[p] = (rank[p] + 0.5f) / count; }
+        return values;
+    }();
+    return mask;
+}
+
+// The numbers of one camera sample, handed down the path instead of a bare pcg32. Cheap to copy, the wavefront
+// integrator keeps one per path.
+class path_sampler {
+public:
+    path_sampler(const sampler_settings& settings, int i, int j, uint32_t pixel, uint32_t sample)
+        : generator(pcg32::for_sample(pixel, sample, settings.frame)), type(settings.type), sample(sample),
+          samples(uint32_t(std::max(1, settings.samples_per_pixel))),
+          // Blue noise uses the same points in every pixel, the mask is what differs
+          seed(settings.type == sampler_type::blue_noise ? sample_hash(~0u, settings.frame)
+                                                         : sample_hash(pixel, settings.frame)),
+          mask_x(uint32_t(i) % blue_noise_size), mask_y(uint32_t(j) % blue_noise_size) {
+        if (type == sampler_type::stratified) { stratified_grid(samples, grid_x, grid_y); }
+        if (type == sampler_type::blue_noise) { mask = blue_noise_mask().data(); }
+    }
+
+    double next_1d() {
+        uint32_t d = dimension++;
+        switch (type) {
+        case sampler_type::random: return generator.next_double();
+        case sampler_type::stratified: {
+            uint32_t stratum = permutation_element(sample % samples, samples, sample_hash(seed, d));
+            return std::min((stratum + generator.next_double()) / samples, one_below);
+        }
+        case sampler_type::sobol: {
+            uint32_t h = sample_hash(seed, d);
+            return scrambled_sobol(sobol_0_reversed(shuffled(h)), mix_bits(h ^ 1));
+        }
+        case sampler_type::blue_noise: {
+            uint32_t h = sample_hash(seed, d);
+            return shift(scrambled_sobol(sobol_0_reversed(shuffled(h)), mix_bits(h ^ 1)), mix_bits(h ^ 4));
+        }
+        }
+        return 0;
+    }
+
+    void next_2d(double& u, double& v) {
+        uint32_t d = dimension;
+        dimension += 2;
+        switch (type) {
+        case sampler_type::random:
+            u = generator.next_double();
+            v = generator.next_double();
+            return;
+        case sampler_type::stratified: {
+            // Samples go to distinct cells of the grid's permutation, the cells past the last sample stay empty
+            uint32_t stratum = permutation_element(sample % samples, grid_x * grid_y, sample_hash(seed, d));
+            u = std::min((stratum % grid_x + generator.next_double()) / grid_x, one_below);
+            v = std::min((stratum / grid_x + generator.next_double()) / grid_y, one_below);
+            return;
+        }
+        case sampler_type::sobol: {
+            uint32_t h = sample_hash(seed, d);
+            uint32_t index = shuffled(h);
+            u = scrambled_sobol(sobol_0_reversed(index), mix_bits(h ^ 1));
+            v = scrambled_sobol(sobol_1_reversed(index), mix_bits(h ^ 2));
+            return;
+        }
+        case sampler_type::blue_noise: {
+            uint32_t h = sample_hash(seed, d);
+            uint32_t index = shuffled(h);
+            u = shift(scrambled_sobol(sobol_0_reversed(index), mix_bits(h ^ 1)), mix_bits(h ^ 4));
+            v = shift(scrambled_sobol(sobol_1_reversed(index), mix_bits(h ^ 2)), mix_bits(h ^ 5));
+            return;
+        }
+        }
+        u = v = 0;
+    }
+
+private:
+    static constexpr double one_below = 1.0 - 1.0 / 9007199254740992.0; // Largest double under 1
+
+    pcg32 generator; // The random sampler's numbers, and the stratified one's jitter
+    sampler_type type;
+    uint32_t dimension = 0;
+    uint32_t sample;
+    uint32_t samples;
+    uint32_t seed; // Per pixel, except for blue noise
+    uint32_t mask_x, mask_y;
+    uint32_t grid_x = 1, grid_y = 1; // Stratified
+    const float* mask = nullptr; // Blue noise
+
+    // Per dimension shuffle of the sample order, so padded dimensions don't line up. The same in every pixel for
+    // blue noise, whose seed is.
+    uint32_t shuffled(uint32_t h) const { return owen_scramble(sample, mix_bits(h ^ 3)); }
+
+    // Cranley-Patterson rotation by the mask, read at an offset of its own for every dimension and axis
+    double shift(double x, uint32_t offset) const {
+        uint32_t mx = (mask_x + offset) % blue_noise_size;
+        uint32_t my = (mask_y + (offset >> 16)) % blue_noise_size;
+        double r = x + mask[my * blue_noise_size + mx];
+        return (r >= 1) ? r - 1 : r;
+    }
+};
+
+inline double random_double(path_sampler& sampler) {
+    return sampler.next_1d();
+}
+
+inline vec3 random_unit_vector(path_sampler& sampler) {
+    double u, v;
+    sampler.next_2d(u, v);
+    return sphere_from_square(u, v);
+}
+
+inline vec3 random_cosine_direction(const vec3& normal, path_sampler& sampler) {
+    double u, v;
+    sampler.next_2d(u, v);
+    return cosine_direction(normal, u, v);
+}
+
+#endif
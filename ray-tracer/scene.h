@@ -0,0 +1,943 @@
+#pragma once
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "animation.h"
+#include "arena.h"
+#include "camera.h"
+#include "flat_bvh.h"
+#include "hittable_list.h"
+#include "instance.h"
+#include "lights.h"
+#include "material.h"
+#include "quad.h"
+#include "sphere.h"
+#include "triangle_mesh.h"
+
+// Scene files.
+//
+// Text format, one statement per line, '#' starts a comment:
+//   camera <field> <value...>                   any public camera field, e.g. "camera lookfrom -2 2 1"
+//   material <name> lambertian <r> <g> <b>
+//   material <name> metal <r> <g> <b> <fuzz>
+//   material <name> dielectric <outer> <inner>
+//   material <name> light <r> <g> <b>           emits, components above 1 for a light brighter than white
+//   sphere <x> <y> <z> <radius> <material name> [transform name]
+//   quad <x> <y> <z> <ux> <uy> <uz> <vx> <vy> <vz> <material name>
+//                                               parallelogram from corner x y z along u and v, facing cross(u, v)
+//   mesh <path> <material name>                 triangles of an OBJ file (triangle_mesh.h), the path relative to
+//                                               the scene file's directory unless it's absolute
+// Numbers may be written as a ratio ("camera aspect_ratio 16/9"). A material has to be declared before a sphere
+// or mesh uses it. Meshes are loaded as the scene is, so parse_seconds includes them.
+// Spheres and quads of a light material in the world are the lights the camera aims shadow rays at (lights.h);
+// anything else that glows, or "camera next_event false", is only seen by the rays that happen to hit it.
+// "camera sky_brightness 0" turns the sky off for scenes lit by their lights alone.
+//
+// Instancing (instance.h), geometry defined once and placed any number of times:
+//   object <name>                               the sphere and mesh statements up to "end" are the object's, in its
+//   end                                         own space, and aren't in the world themselves
+//   instance <object> <x> <y> <z> [rotate_y <degrees>] [scale <factor>] [transform <name>]
+// An instance is scaled, turned about y and moved like a transform (below) does, then by its transform if it has
+// one. An object is one tree shared by all its instances, and the instances get a tree of their own next to the
+// other objects.
+//
+// Animation (animation.h), a sequence of frames rendered one after the other with the scene built once:
+//   frames <first> <last>                       the frames to render, the camera's frame field is set to each
+//   transform <name>                            something spheres and instances can be attached to, declared
+//                                               before them
+//   key <frame> camera <field> <value...>       lookfrom, lookat, viewup, vfov, focus_dist or defocus_angle
+//   key <frame> <transform> translate <x> <y> <z>
+//   key <frame> <transform> rotate_y <degrees>
+//   key <frame> <transform> scale <factor>
+// Values are linear between keys. Moving spheres and instances only refits the flat_bvh, it is never rebuilt.
+// Quads and meshes can't be attached, nor can the spheres of an object (its instances can).
+//
+// Binary twin, for generated scenes with millions of primitives (save_binary writes it, load tells them apart by
+// the magic): "RTSC", version, every statement that isn't a material, sphere or mesh as text, then the material and
+// sphere records below as they are in memory, each array preceded by its count, then the count of meshes and for
+// each its material, the length of its path and the path (as resolved, the OBJ files aren't copied in), then the
+// object and instance records like the spheres, then the quad records.
+
+struct scene_material {
+    uint32_t kind; // material_kind
+    uint32_t pad;
+    double params[4]; // lambertian: albedo. metal: albedo, fuzz. dielectric: outer, inner. diffuse_light: emitted.
+};
+
+struct scene_sphere {
+    double center[3];
+    double radius;
+    uint32_t material; // Index into the scene's materials
+    uint32_t transform; // 1 + index into the scene's transforms, 0 for a sphere that stays put
+};
+
+struct scene_quad {
+    double corner[3];
+    double u[3], v[3];
+    uint32_t material;
+    uint32_t pad;
+};
+
+struct scene_mesh {
+    std::string path; // Resolved against the scene file's directory
+    uint32_t material;
+};
+
+// The spheres [first_sphere, end_sphere) and meshes [first_mesh, end_mesh) of the records, which are in no other
+// object and not in the world
+struct scene_object {
+    uint32_t first_sphere, end_sphere;
+    uint32_t first_mesh, end_mesh;
+};
+
+struct scene_instance {
+    double translate[3];
+    double rotate_y; // Degrees
+    double scale;
+    uint32_t object; // Index into the scene's objects
+    uint32_t transform; // 1 + index into the scene's transforms, 0 for an instance that stays put
+};
+
+static_assert(sizeof(scene_material) == 40 && sizeof(scene_sphere) == 40 && sizeof(scene_quad) == 80
+              && sizeof(scene_object) == 16 && sizeof(scene_instance) == 48, "scene records are saved as is");
+
+// Sets one camera field from its text value, false if the field doesn't exist, the value doesn't parse or it is out
+// of the field's range (image_width 0, tile_size -1)
+inline bool set_camera_field(camera& cam, const std::string& field, const char* value) {
+    auto number = [&](double& out) {
+        char* end;
+        out = std::strtod(value, &end);
+        if (end == value) { return false; }
+        if (*end == '/') { // Ratio
+            const char* denom = end + 1;
+            double d = std::strtod(denom, &end);
+            if (end == denom || d == 0) { return false; }
+            out /= d;
+        }
+        value = end;
+        return true;
+    };
+    auto integer = [&](int& out, int least) { // Counts and sizes the renderer divides by or allocates with
+        double d;
+        if (!number(d) || !(d >= least) || d > std::numeric_limits<int>::max()) { return false; }
+        out = int(d);
+        return true;
+    };
+    const int any = std::numeric_limits<int>::min();
+    auto vector = [&](vec3& out) {
+        double x, y, z;
+        if (!number(x) || !number(y) || !number(z)) { return false; }
+        out = vec3(x, y, z);
+        return true;
+    };
+    auto word = [&]() {
+        while (*value == ' ' || *value == '\t') { value++; }
+        std::string w(value);
+        while (!w.empty() && (w.back() == ' ' || w.back() == '\t')) { w.pop_back(); }
+        return w;
+    };
+    auto boolean = [&](bool& out) {
+        std::string w = word();
+        if (w == "true" || w == "1") { out = true; return true; }
+        if (w == "false" || w == "0") { out = false; return true; }
+        return false;
+    };
+
+    if (field == "aspect_ratio") { return number(cam.aspect_ratio); }
+    if (field == "image_width") { return integer(cam.image_width, 1); }
+    if (field == "samples_per_pix") { return integer(cam.samples_per_pix, 1); }
+    if (field == "max_depth") { return integer(cam.max_depth, 0); }
+    if (field == "thread_count") { return integer(cam.thread_count, 0); }
+    if (field == "tile_size") { return integer(cam.tile_size, 1); }
+    if (field == "frame") { return integer(cam.frame, any); }
+    if (field == "integrator") {
+        std::string w = word();
+        if (w == "recursive") { cam.integrator = integrator_type::recursive; return true; }
+        if (w == "iterative") { cam.integrator = integrator_type::iterative; return true; }
+        if (w == "wavefront") { cam.integrator = integrator_type::wavefront; return true; }
+        return false;
+    }
+    if (field == "russian_roulette") { return boolean(cam.russian_roulette); }
+    if (field == "next_event") { return boolean(cam.next_event); }
+    if (field == "sky_brightness") { return number(cam.sky_brightness); }
+    if (field == "roulette_depth") { return integer(cam.roulette_depth, 0); }
+    if (field == "roulette_max_survival") { return number(cam.roulette_max_survival); }
+    if (field == "sampler") {
+        std::string w = word();
+        if (w == "random") { cam.sampler = sampler_type::random; return true; }
+        if (w == "stratified") { cam.sampler = sampler_type::stratified; return true; }
+        if (w == "sobol") { cam.sampler = sampler_type::sobol; return true; }
+        if (w == "blue_noise") { cam.sampler = sampler_type::blue_noise; return true; }
+        return false;
+    }
+    if (field == "output_path") { cam.output_path = word(); return true; }
+    if (field == "output_format") {
+        std::string w = word();
+        if (w == "from_extension") { cam.output_format = image_format::from_extension; return true; }
+        if (w == "ppm_ascii") { cam.output_format = image_format::ppm_ascii; return true; }
+        if (w == "ppm_binary") { cam.output_format = image_format::ppm_binary; return true; }
+        if (w == "pfm") { cam.output_format = image_format::pfm; return true; }
+        if (w == "png") { cam.output_format = image_format::png; return true; }
+        return false;
+    }
+    if (field == "vfov") { return number(cam.vfov); }
+    if (field == "lookfrom") { return vector(cam.lookfrom); }
+    if (field == "lookat") { return vector(cam.lookat); }
+    if (field == "viewup") { return vector(cam.viewup); }
+    if (field == "progressive") { return boolean(cam.progressive); }
+    if (field == "samples_per_pass") { return integer(cam.samples_per_pass, 1); }
+    if (field == "time_budget") { return number(cam.time_budget); }
+    if (field == "checkpoint_path") { cam.checkpoint_path = word(); return true; }
+    if (field == "checkpoint_interval") { return number(cam.checkpoint_interval); }
+    if (field == "adaptive") { return boolean(cam.adaptive); }
+    if (field == "adaptive_threshold") { return number(cam.adaptive_threshold); }
+    if (field == "adaptive_min_samples") { return integer(cam.adaptive_min_samples, 0); }
+    if (field == "heatmap_path") { cam.heatmap_path = word(); return true; }
+    if (field == "denoise") { return boolean(cam.denoise); }
+    if (field == "denoise_iterations") { return integer(cam.denoise_iterations, 0); }
+    if (field == "denoise_sigma_luminance") { return number(cam.denoise_sigma_luminance); }
+    if (field == "denoise_sigma_normal") { return number(cam.denoise_sigma_normal); }
+    if (field == "denoise_sigma_depth") { return number(cam.denoise_sigma_depth); }
+    if (field == "aov_path") { cam.aov_path = word(); return true; }
+    if (field == "defocus_angle") { return number(cam.defocus_angle); }
+    if (field == "focus_dist") { return number(cam.focus_dist); }
+    return false;
+}
+
+// A scene read from a file: the camera, the material, sphere and mesh records, and once build() ran, the objects.
+// Materials and spheres are built into the scene's arena, so a scene of millions of spheres is a handful of
+// allocations instead of one per object, and it all goes away in one go with the scene.
+class scene {
+public:
+    camera cam;
+    std::vector<std::string> setting_lines; // Statements other than the records' in file order, for save_binary
+    std::vector<scene_material> material_records;
+    std::unordered_map<std::string, uint32_t> material_names; // Of a text scene, the record each name was last given
+    std::vector<scene_sphere> sphere_records;
+    std::vector<scene_quad> quad_records;
+    std::vector<scene_mesh> mesh_records;
+    std::vector<scene_object> object_records;
+    std::vector<std::string> object_names; // Of a text scene, the binary format only keeps the records
+    std::vector<scene_instance> instance_records;
+
+    int first_frame = 0;
+    int last_frame = -1; // Before first_frame without a frames statement: one image, not a sequence
+    camera_tracks camera_keys;
+    std::vector<std::string> transform_names;
+    std::vector<object_transform> transforms;
+
+    double parse_seconds = 0;
+    double build_seconds = 0;
+    double refit_seconds = 0; // Of the last set_frame
+    double mesh_seconds = 0; // Reading and building the meshes, part of parse_seconds
+
+    scene() {}
+    scene(const scene&) = delete; // world points into the arena, a copy would point into the original's
+    scene& operator=(const scene&) = delete;
+
+    // Text or binary, whichever the file is. Errors go to std::cerr.
+    bool load(const std::string& path) {
+        FILE* f = std::fopen(path.c_str(), "rb");
+        if (!f) {
+            std::cerr << "Could not open scene " << path << '\n';
+            return false;
+        }
+        bool ok = load(f, path);
+        std::fclose(f);
+        return ok;
+    }
+
+    // Same from an open stream, name is only for the error messages
+    bool load(FILE* f, const std::string& name) {
+        auto start = std::chrono::steady_clock::now();
+        directory = name.substr(0, name.find_last_of("/\\") + 1);
+        char magic[4] = {};
+        bool binary = std::fread(magic, 1, 4, f) == 4 && std::memcmp(magic, "RTSC", 4) == 0;
+        if (!binary) { std::rewind(f); }
+
+        bool ok = binary ? read_binary(f, name) : read_text(f, name);
+        parse_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return ok;
+    }
+
+    bool save_binary(const std::string& path) const {
+        FILE* f = std::fopen(path.c_str(), "wb");
+        if (!f) {
+            std::cerr << "Could not open " << path << " for writing\n";
+            return false;
+        }
+        bool ok = write_binary(f);
+        ok = (std::fclose(f) == 0) && ok;
+        if (!ok) {
+            std::cerr << "Could not write scene " << path << '\n';
+        }
+        return ok;
+    }
+
+    bool write_binary(FILE* f) const {
+        std::string settings;
+        for (const auto& line : setting_lines) { settings += line + '\n'; }
+        uint32_t header[2] = { scene_version, uint32_t(settings.size()) };
+        uint64_t materials_n = material_records.size();
+        uint64_t spheres_n = sphere_records.size();
+        bool ok = std::fwrite("RTSC", 1, 4, f) == 4
+               && std::fwrite(header, sizeof header, 1, f) == 1
+               && std::fwrite(settings.data(), 1, settings.size(), f) == settings.size()
+               && std::fwrite(&materials_n, sizeof materials_n, 1, f) == 1
+               && std::fwrite(material_records.data(), sizeof(scene_material), materials_n, f) == materials_n
+               && std::fwrite(&spheres_n, sizeof spheres_n, 1, f) == 1
+               && std::fwrite(sphere_records.data(), sizeof(scene_sphere), spheres_n, f) == spheres_n;
+
+        uint64_t meshes_n = mesh_records.size();
+        ok = ok && std::fwrite(&meshes_n, sizeof meshes_n, 1, f) == 1;
+        for (const auto& m : mesh_records) {
+            uint32_t fields[2] = { m.material, uint32_t(m.path.size()) };
+            ok = ok && std::fwrite(fields, sizeof fields, 1, f) == 1
+                    && std::fwrite(m.path.data(), 1, m.path.size(), f) == m.path.size();
+        }
+
+        uint64_t objects_n = object_records.size();
+        uint64_t instances_n = instance_records.size();
+        ok = ok && std::fwrite(&objects_n, sizeof objects_n, 1, f) == 1
+                && std::fwrite(object_records.data(), sizeof(scene_object), objects_n, f) == objects_n
+                && std::fwrite(&instances_n, sizeof instances_n, 1, f) == 1
+                && std::fwrite(instance_records.data(), sizeof(scene_instance), instances_n, f) == instances_n;
+
+        uint64_t quads_n = quad_records.size();
+        ok = ok && std::fwrite(&quads_n, sizeof quads_n, 1, f) == 1
+                && std::fwrite(quad_records.data(), sizeof(scene_quad), quads_n, f) == quads_n;
+        return ok;
+    }
+
+    // Turns the records into materials, spheres and a flat_bvh over them and the quads, meshes and instances, returns
+    // the world to render and hands the camera the lights. Building again throws away the objects of the previous
+    // build.
+    const hittable& build() {
+        auto start = std::chrono::steady_clock::now();
+        world.clear();
+        lights.clear();
+        storage.release();
+
+        std::vector<material*>& mats = built_materials;
+        mats.clear();
+        mats.reserve(material_records.size());
+        for (const auto& m : material_records) {
+            mats.push_back(storage.make<material>(make_material(m)));
+        }
+        // Every light in the world gets a material of its own that knows where it is in the light_list
+        light_materials.clear();
+        auto light_material = [&](uint32_t m) {
+            const double* p = material_records[m].params;
+            material* copy = storage.make<material>(diffuse_light(color(p[0], p[1], p[2]), int(lights.size())));
+            light_materials.push_back({ copy, m });
+            return copy;
+        };
+        auto light_emits = [&](uint32_t m) {
+            const double* p = material_records[m].params;
+            return color(p[0], p[1], p[2]);
+        };
+
+        auto make_sphere = [&](const scene_sphere& s) {
+            return storage.make<sphere>(point3(s.center[0], s.center[1], s.center[2]), s.radius, mats[s.material]);
+        };
+        for (size_t k = 0; k < meshes.size(); k++) { // Built when they were loaded, they only need their material
+            meshes[k]->set_material(mats[mesh_records[k].material]);
+        }
+
+        // Every object becomes one hittable, its only part as is or a flat_bvh over its parts
+        std::vector<char> sphere_shared(sphere_records.size()), mesh_shared(mesh_records.size());
+        std::vector<const hittable*> objects(object_records.size(), nullptr); // Stays null for an empty object
+        for (size_t k = 0; k < object_records.size(); k++) {
+            const scene_object& o = object_records[k];
+            arena_list parts;
+            for (uint32_t i = o.first_sphere; i < o.end_sphere; i++) {
+                parts.add(make_sphere(sphere_records[i]));
+                sphere_shared[i] = 1;
+            }
+            for (uint32_t i = o.first_mesh; i < o.end_mesh; i++) {
+                parts.add(meshes[i].get());
+                mesh_shared[i] = 1;
+            }
+            if (parts.objects.size() == 1) { objects[k] = parts.objects[0]; }
+            else if (!parts.objects.empty()) { objects[k] = storage.make<flat_bvh>(parts); }
+        }
+
+        arena_list list;
+        list.reserve(sphere_records.size() + quad_records.size() + instance_records.size());
+        moving.clear();
+        moving_instances.clear();
+        for (size_t k = 0; k < sphere_records.size(); k++) {
+            if (sphere_shared[k]) { continue; }
+            const scene_sphere& s = sphere_records[k];
+            if (mats[s.material]->emits()) { // A moving light is sampled where it is, the list has the sphere itself
+                sphere* obj = storage.make<sphere>(point3(s.center[0], s.center[1], s.center[2]), s.radius,
+                                                   light_material(s.material));
+                lights.add(obj, light_emits(s.material));
+                list.add(obj);
+                if (s.transform != 0) { moving.push_back({ obj, k }); }
+                continue;
+            }
+            sphere* obj = make_sphere(s);
+            list.add(obj);
+            if (s.transform != 0) { moving.push_back({ obj, k }); }
+        }
+        for (const auto& q : quad_records) {
+            bool light = mats[q.material]->emits();
+            const quad* obj = storage.make<quad>(point3(q.corner[0], q.corner[1], q.corner[2]),
+                vec3(q.u[0], q.u[1], q.u[2]), vec3(q.v[0], q.v[1], q.v[2]),
+                light ? light_material(q.material) : mats[q.material]);
+            if (light) { lights.add(obj, light_emits(q.material)); }
+            list.add(obj);
+        }
+        for (size_t k = 0; k < meshes.size(); k++) {
+            if (!mesh_shared[k]) { list.add(meshes[k].get()); }
+        }
+        for (size_t k = 0; k < instance_records.size(); k++) {
+            const scene_instance& i = instance_records[k];
+            if (!objects[i.object]) { continue; }
+            instance* obj = storage.make<instance>(objects[i.object], placement(i));
+            list.add(obj);
+            if (i.transform != 0) { moving_instances.push_back({ obj, k }); }
+        }
+
+        tree = make_shared<flat_bvh>(list);
+        world.add(tree);
+        cam.lights = &lights;
+        build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return world;
+    }
+
+    // Changes a material of the built scene from a "material <name> <type> <values...>" statement naming one the
+    // scene file declared, for the preview server (preview.h). The primitives keep their pointers, so the trees stay
+    // as they are; only turning a light into something else or back takes another build(), the light list changes.
+    // The world build() returned stays valid either way. Errors go to std::cerr.
+    bool update_material(const std::string& statement) {
+        const char* p = statement.c_str();
+        auto word = [&]() {
+            while (*p == ' ' || *p == '\t') { p++; }
+            const char* begin = p;
+            while (*p && *p != ' ' && *p != '\t' && *p != '\r' && *p != '#') { p++; }
+            return std::string(begin, p);
+        };
+        auto number = [&](double& out) {
+            char* end;
+            out = std::strtod(p, &end);
+            if (end == p) { return false; }
+            p = end;
+            return true;
+        };
+
+        scene_material m = {};
+        std::string keyword = word();
+        std::string name = word();
+        if (keyword != "material" || !parse_material(word(), number, m)) {
+            std::cerr << "Can't parse " << statement << '\n';
+            return false;
+        }
+        auto it = material_names.find(name);
+        if (it == material_names.end()) {
+            std::cerr << "No material " << name << " in the scene\n";
+            return false;
+        }
+        uint32_t index = it->second;
+        material_records[index] = m;
+        if (index >= built_materials.size()) { return true; } // Not built yet, build() will pick it up
+
+        material& built = *built_materials[index];
+        if (built.emits() != (material_kind(m.kind) == material_kind::diffuse_light)) {
+            build();
+            return true;
+        }
+        built = make_material(m);
+        for (const auto& l : light_materials) {
+            if (l.record != index) { continue; }
+            color emit(m.params[0], m.params[1], m.params[2]);
+            *l.copy = material(diffuse_light(emit, l.copy->light()));
+            lights.set_emit(size_t(l.copy->light()), emit);
+        }
+        return true;
+    }
+
+    bool animated() const { return last_frame >= first_frame; }
+
+    // Poses the built scene for a frame: keyed camera fields, and the spheres and instances moved by their
+    // transforms with the tree refitted around them. The world build() returned stays valid.
+    void set_frame(int frame) {
+        cam.frame = frame;
+        camera_keys.apply(cam, frame);
+        if (moving.empty() && moving_instances.empty()) { return; }
+
+        auto start = std::chrono::steady_clock::now();
+        for (const auto& m : moving) {
+            const scene_sphere& s = sphere_records[m.record];
+            const object_transform& t = transforms[s.transform - 1];
+            m.obj->move(t.apply(point3(s.center[0], s.center[1], s.center[2]), frame), s.radius * t.scale_at(frame));
+        }
+        for (const auto& m : moving_instances) {
+            const scene_instance& i = instance_records[m.record];
+            const object_transform& t = transforms[i.transform - 1];
+            // Where a sphere's radius goes to 0 the instance only gets very small, its map has to stay invertible
+            affine by_transform = affine::scale_rotate_translate(std::fmax(t.scale_at(frame), 1e-9),
+                t.rotate_y.at(frame, 0.0), t.translate.at(frame, vec3(0, 0, 0)));
+            m.obj->place(by_transform.after(placement(i)));
+        }
+        tree->refit();
+        world.clear();
+        world.add(tree); // For the new bounding box
+        refit_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    size_t arena_bytes() const { return storage.bytes_used(); }
+
+    size_t light_count() const { return lights.size(); } // Of the last build
+
+    size_t triangle_count() const {
+        size_t n = 0;
+        for (const auto& m : meshes) { n += m->triangle_count(); }
+        return n;
+    }
+
+    size_t mesh_bytes() const {
+        size_t n = 0;
+        for (const auto& m : meshes) { n += m->bytes(); }
+        return n;
+    }
+
+private:
+    // 1 had only camera settings, as "<field> <value>" lines, 2 no meshes, 3 no objects and instances, 4 no quads
+    static const uint32_t scene_version = 5;
+    static const size_t read_chunk = 1 << 20;
+
+    struct moving_sphere {
+        sphere* obj;
+        size_t record;
+    };
+
+    struct moving_instance {
+        instance* obj;
+        size_t record;
+    };
+
+    struct light_material {
+        material* copy; // In the arena, the light's own (see build)
+        uint32_t record;
+    };
+
+    arena storage; // Declared before world so it outlives it
+    hittable_list world;
+    shared_ptr<flat_bvh> tree;
+    std::vector<moving_sphere> moving; // Spheres attached to a transform
+    std::vector<moving_instance> moving_instances; // Instances attached to one
+    light_list lights; // Point into the arena like world
+    std::vector<material*> built_materials; // One per record, in the arena too
+    std::vector<light_material> light_materials;
+    std::vector<std::unique_ptr<triangle_mesh>> meshes; // One per mesh record, kept across builds
+    std::string directory; // Of the scene file, with the trailing separator, for mesh paths
+    bool object_open = false; // Between an object statement and its end
+
+    // Reads the file a chunk at a time and hands every whole line to parse_line, so memory stays at one chunk no
+    // matter how big the file is. A line cut by the chunk boundary is carried over to the next chunk.
+    bool read_text(FILE* f, const std::string& path) {
+        std::vector<char> chunk(read_chunk + 1);
+        std::string carry;
+        std::unordered_map<std::string, uint32_t>& names = material_names;
+        int line_number = 0;
+
+        while (true) {
+            size_t n = std::fread(chunk.data(), 1, read_chunk, f);
+            if (n == 0) { break; }
+            size_t begin = 0;
+            for (size_t k = 0; k < n; k++) {
+                if (chunk[k] != '\n') { continue; }
+                chunk[k] = '\0';
+                line_number++;
+                bool ok;
+                if (carry.empty()) {
+                    ok = parse_line(&chunk[begin], names);
+                }
+                else {
+                    carry.append(&chunk[begin], k - begin);
+                    ok = parse_line(carry.c_str(), names);
+                    carry.clear();
+                }
+                if (!ok) { return fail(path, line_number); }
+                begin = k + 1;
+            }
+            carry.append(&chunk[begin], n - begin);
+        }
+        if (!carry.empty() && !parse_line(carry.c_str(), names)) {
+            return fail(path, line_number + 1);
+        }
+        if (object_open) {
+            std::cerr << path << ": object " << object_names.back() << " has no end\n";
+            return false;
+        }
+        return true;
+    }
+
+    static bool fail(const std::string& path, int line_number) {
+        std::cerr << path << ':' << line_number << ": can't parse this line\n";
+        return false;
+    }
+
+    bool parse_line(const char* p, std::unordered_map<std::string, uint32_t>& names) {
+        auto skip_space = [&]() { while (*p == ' ' || *p == '\t' || *p == '\r') { p++; } };
+        auto word = [&]() {
+            skip_space();
+            const char* begin = p;
+            while (*p && *p != ' ' && *p != '\t' && *p != '\r' && *p != '#') { p++; }
+            return std::string(begin, p);
+        };
+        auto number = [&](double& out) {
+            char* end;
+            out = std::strtod(p, &end);
+            if (end == p) { return false; }
+            p = end;
+            return true;
+        };
+
+        skip_space();
+        if (*p == '\0' || *p == '#') { return true; } // Blank or comment
+
+        std::string keyword = word();
+        if (keyword == "sphere") { // Checked first, it's most of the lines in a big scene
+            scene_sphere s = {};
+            if (!number(s.center[0]) || !number(s.center[1]) || !number(s.center[2]) || !number(s.radius)) {
+                return false;
+            }
+            auto it = names.find(word());
+            if (it == names.end()) { return false; }
+            s.material = it->second;
+            std::string attached = word();
+            if (!attached.empty()) {
+                s.transform = find_transform(attached) + 1;
+                if (s.transform == 0 || object_open) { return false; } // Shared spheres can't move by themselves
+            }
+            sphere_records.push_back(s);
+            return true;
+        }
+        if (keyword == "quad") {
+            scene_quad q = {};
+            for (double* v : { q.corner, q.u, q.v }) {
+                if (!number(v[0]) || !number(v[1]) || !number(v[2])) { return false; }
+            }
+            auto it = names.find(word());
+            if (it == names.end() || object_open || !word().empty()) { // Quads only go in the world, and stay put
+                return false;
+            }
+            q.material = it->second;
+            if (cross(vec3(q.u[0], q.u[1], q.u[2]), vec3(q.v[0], q.v[1], q.v[2])).near_zero()) { return false; }
+            quad_records.push_back(q);
+            return true;
+        }
+        if (keyword == "instance") {
+            scene_instance i = {};
+            i.scale = 1;
+            int object = find_object(word());
+            if (object < 0 || object_open || !number(i.translate[0]) || !number(i.translate[1])
+                || !number(i.translate[2])) {
+                return false; // Also inside an object, instances only go in the world
+            }
+            i.object = uint32_t(object);
+            for (std::string option = word(); !option.empty(); option = word()) {
+                bool ok = (option == "rotate_y" && number(i.rotate_y)) || (option == "scale" && number(i.scale))
+                          || (option == "transform" && (i.transform = find_transform(word()) + 1) != 0);
+                if (!ok) { return false; }
+            }
+            if (i.scale == 0) { return false; }
+            instance_records.push_back(i);
+            return true;
+        }
+        if (keyword == "mesh") {
+            scene_mesh m;
+            m.path = word();
+            auto it = names.find(word());
+            if (m.path.empty() || it == names.end() || !word().empty()) { return false; } // Meshes stay put too
+            bool absolute = m.path[0] == '/' || m.path[0] == '\\' || (m.path.size() > 1 && m.path[1] == ':');
+            if (!absolute) { m.path = directory + m.path; }
+            m.material = it->second;
+            return add_mesh(m);
+        }
+        if (keyword == "object") {
+            std::string name = word();
+            if (name.empty() || object_open || find_object(name) >= 0) { return false; }
+            object_open = true;
+            object_names.push_back(name);
+            object_records.push_back({ uint32_t(sphere_records.size()), 0, uint32_t(mesh_records.size()), 0 });
+            return true;
+        }
+        if (keyword == "end") {
+            if (!object_open) { return false; }
+            object_open = false;
+            object_records.back().end_sphere = uint32_t(sphere_records.size());
+            object_records.back().end_mesh = uint32_t(mesh_records.size());
+            return true;
+        }
+        if (keyword == "material") {
+            std::string name = word();
+            scene_material m = {};
+            if (!parse_material(word(), number, m) || name.empty()) { return false; }
+            names[name] = uint32_t(material_records.size());
+            material_records.push_back(m);
+            return true;
+        }
+        const char* statement = p - keyword.size();
+        bool ok = false;
+        if (keyword == "camera") {
+            std::string field = word();
+            skip_space();
+            std::string value(p, p + std::strcspn(p, "#\r"));
+            ok = set_camera_field(cam, field, value.c_str());
+        }
+        else if (keyword == "frames") {
+            double first, last;
+            ok = number(first) && number(last) && last >= first;
+            if (ok) {
+                first_frame = int(first);
+                last_frame = int(last);
+            }
+        }
+        else if (keyword == "transform") {
+            std::string name = word();
+            ok = !name.empty() && find_transform(name) < 0;
+            if (ok) {
+                transform_names.push_back(name);
+                transforms.emplace_back();
+            }
+        }
+        else if (keyword == "key") {
+            double frame;
+            ok = number(frame);
+            std::string target = word();
+            std::string channel = word();
+            ok = ok && parse_key(int(frame), target, channel, number);
+        }
+        if (ok) { // Kept as written for the binary format
+            setting_lines.push_back(std::string(statement, statement + std::strcspn(statement, "#\r")));
+        }
+        return ok;
+    }
+
+    // Loads the record's OBJ, errors go to std::cerr
+    bool add_mesh(const scene_mesh& m) {
+        auto mesh = std::unique_ptr<triangle_mesh>(new triangle_mesh());
+        if (!mesh->load_obj(m.path)) { return false; }
+        mesh_seconds += mesh->parse_seconds + mesh->build_seconds;
+        meshes.push_back(std::move(mesh));
+        mesh_records.push_back(m);
+        return true;
+    }
+
+    // The values after "material <name> <type>"
+    template <typename number_reader>
+    static bool parse_material(const std::string& type, number_reader& number, scene_material& m) {
+        int values;
+        if (type == "lambertian") { m.kind = uint32_t(material_kind::lambertian); values = 3; }
+        else if (type == "metal") { m.kind = uint32_t(material_kind::metal); values = 4; }
+        else if (type == "dielectric") { m.kind = uint32_t(material_kind::dielectric); values = 2; }
+        else if (type == "light") { m.kind = uint32_t(material_kind::diffuse_light); values = 3; }
+        else { return false; }
+        for (int k = 0; k < values; k++) {
+            if (!number(m.params[k])) { return false; }
+        }
+        return true;
+    }
+
+    static material make_material(const scene_material& m) {
+        const double* p = m.params;
+        switch (material_kind(m.kind)) {
+        case material_kind::lambertian: return lambertian(color(p[0], p[1], p[2]));
+        case material_kind::metal: return metal(color(p[0], p[1], p[2]), p[3]);
+        case material_kind::dielectric: return dielectric(p[0], p[1]);
+        case material_kind::diffuse_light: break;
+        }
+        return diffuse_light(color(p[0], p[1], p[2]));
+    }
+
+    static affine placement(const scene_instance& i) {
+        vec3 translate(i.translate[0], i.translate[1], i.translate[2]);
+        return affine::scale_rotate_translate(i.scale, i.rotate_y, translate);
+    }
+
+    int find_object(const std::string& name) const { // Only objects that are done, one can't hold itself
+        size_t n = object_names.size() - (object_open ? 1 : 0);
+        for (size_t k = 0; k < n; k++) {
+            if (object_names[k] == name) { return int(k); }
+        }
+        return -1;
+    }
+
+    int find_transform(const std::string& name) const {
+        for (size_t k = 0; k < transform_names.size(); k++) {
+            if (transform_names[k] == name) { return int(k); }
+        }
+        return -1;
+    }
+
+    template <typename number_reader>
+    bool parse_key(int frame, const std::string& target, const std::string& channel, number_reader& number) {
+        double v[3];
+        auto one = [&](track<double>& t) {
+            if (!number(v[0])) { return false; }
+            t.add(frame, v[0]);
+            return true;
+        };
+        auto three = [&](track<vec3>& t) {
+            if (!number(v[0]) || !number(v[1]) || !number(v[2])) { return false; }
+            t.add(frame, vec3(v[0], v[1], v[2]));
+            return true;
+        };
+
+        if (target == "camera") {
+            if (channel == "lookfrom") { return three(camera_keys.lookfrom); }
+            if (channel == "lookat") { return three(camera_keys.lookat); }
+            if (channel == "viewup") { return three(camera_keys.viewup); }
+            if (channel == "vfov") { return one(camera_keys.vfov); }
+            if (channel == "focus_dist") { return one(camera_keys.focus_dist); }
+            if (channel == "defocus_angle") { return one(camera_keys.defocus_angle); }
+            return false;
+        }
+        int t = find_transform(target);
+        if (t < 0) { return false; }
+        if (channel == "translate") { return three(transforms[t].translate); }
+        if (channel == "rotate_y") { return one(transforms[t].rotate_y); }
+        if (channel == "scale") { return one(transforms[t].scale); }
+        return false;
+    }
+
+    bool read_binary(FILE* f, const std::string& path) {
+        uint32_t header[2];
+        uint64_t materials_n = 0, spheres_n = 0;
+        bool ok = std::fread(header, sizeof header, 1, f) == 1 && header[0] >= 1 && header[0] <= scene_version;
+
+        std::string settings(ok ? header[1] : 0, '\0');
+        ok = ok && std::fread(&settings[0], 1, settings.size(), f) == settings.size();
+
+        ok = ok && std::fread(&materials_n, sizeof materials_n, 1, f) == 1;
+        if (ok) { material_records.resize(size_t(materials_n)); }
+        ok = ok && std::fread(material_records.data(), sizeof(scene_material), materials_n, f) == materials_n;
+
+        // Sized from the header and read straight into place
+        ok = ok && std::fread(&spheres_n, sizeof spheres_n, 1, f) == 1;
+        if (ok) { sphere_records.resize(size_t(spheres_n)); }
+        ok = ok && std::fread(sphere_records.data(), sizeof(scene_sphere), spheres_n, f) == spheres_n;
+
+        std::vector<scene_mesh> mesh_list;
+        uint64_t meshes_n = 0;
+        if (header[0] >= 3) {
+            ok = ok && std::fread(&meshes_n, sizeof meshes_n, 1, f) == 1;
+        }
+        for (uint64_t k = 0; ok && k < meshes_n; k++) {
+            uint32_t fields[2];
+            ok = std::fread(fields, sizeof fields, 1, f) == 1;
+            scene_mesh m;
+            m.material = fields[0];
+            m.path.resize(ok ? fields[1] : 0);
+            ok = ok && std::fread(&m.path[0], 1, m.path.size(), f) == m.path.size();
+            mesh_list.push_back(m);
+        }
+
+        uint64_t objects_n = 0, instances_n = 0;
+        if (header[0] >= 4) {
+            ok = ok && std::fread(&objects_n, sizeof objects_n, 1, f) == 1;
+            if (ok) { object_records.resize(size_t(objects_n)); }
+            ok = ok && std::fread(object_records.data(), sizeof(scene_object), objects_n, f) == objects_n;
+            ok = ok && std::fread(&instances_n, sizeof instances_n, 1, f) == 1;
+            if (ok) { instance_records.resize(size_t(instances_n)); }
+            ok = ok && std::fread(instance_records.data(), sizeof(scene_instance), instances_n, f) == instances_n;
+        }
+        uint64_t quads_n = 0;
+        if (header[0] >= 5) {
+            ok = ok && std::fread(&quads_n, sizeof quads_n, 1, f) == 1;
+            if (ok) { quad_records.resize(size_t(quads_n)); }
+            ok = ok && std::fread(quad_records.data(), sizeof(scene_quad), quads_n, f) == quads_n;
+        }
+
+        if (!ok) {
+            std::cerr << "Scene " << path << " is truncated or from another version\n";
+            return false;
+        }
+
+        // The settings are statements of the text format
+        std::unordered_map<std::string, uint32_t> no_materials;
+        size_t begin = 0;
+        while (begin < settings.size()) {
+            size_t end = settings.find('\n', begin);
+            if (end == std::string::npos) { end = settings.size(); }
+            std::string line = (header[0] == 1 ? "camera " : "") + settings.substr(begin, end - begin);
+            std::string keyword = line.substr(0, line.find(' '));
+            bool record = keyword == "material" || keyword == "sphere" || keyword == "quad" || keyword == "mesh"
+                          || keyword == "object" || keyword == "end" || keyword == "instance";
+            if (record || !parse_line(line.c_str(), no_materials)) {
+                std::cerr << "Scene " << path << " has a setting that doesn't parse: " << line << '\n';
+                return false;
+            }
+            begin = end + 1;
+        }
+
+        for (const auto& m : material_records) {
+            if (m.kind >= uint32_t(material_kind_count)) {
+                std::cerr << "Scene " << path << " has a material of unknown kind " << m.kind << '\n';
+                return false;
+            }
+        }
+        for (const auto& s : sphere_records) {
+            if (s.material >= material_records.size()) {
+                std::cerr << "Scene " << path << " has a sphere with a material that doesn't exist\n";
+                return false;
+            }
+            if (s.transform > transforms.size()) {
+                std::cerr << "Scene " << path << " has a sphere with a transform that doesn't exist\n";
+                return false;
+            }
+        }
+        for (const auto& q : quad_records) {
+            if (q.material >= material_records.size()) {
+                std::cerr << "Scene " << path << " has a quad with a material that doesn't exist\n";
+                return false;
+            }
+        }
+        for (const auto& m : mesh_list) {
+            if (m.material >= material_records.size()) {
+                std::cerr << "Scene " << path << " has a mesh with a material that doesn't exist\n";
+                return false;
+            }
+            if (!add_mesh(m)) { return false; }
+        }
+        uint32_t previous_end = 0;
+        for (const auto& o : object_records) {
+            bool ordered = o.first_sphere >= previous_end && o.first_sphere <= o.end_sphere
+                           && o.end_sphere <= sphere_records.size() && o.first_mesh <= o.end_mesh
+                           && o.end_mesh <= mesh_records.size();
+            if (!ordered) {
+                std::cerr << "Scene " << path << " has an object with parts that don't exist\n";
+                return false;
+            }
+            previous_end = o.end_sphere;
+        }
+        for (const auto& i : instance_records) {
+            if (i.object >= object_records.size() || i.scale == 0) {
+                std::cerr << "Scene " << path << " has an instance of an object that doesn't exist\n";
+                return false;
+            }
+            if (i.transform > transforms.size()) {
+                std::cerr << "Scene " << path << " has an instance with a transform that doesn't exist\n";
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,97 @@
+#pragma once
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cstdlib>
+#include <cstring>
+
+// Runtime CPU feature detection for the hand vectorized kernels.
+// Kernels for wider instruction sets are compiled with a per function target attribute (GCC/Clang) so the rest
+// of the program doesn't need -mavx2, and are only called after detect_simd_level() says the CPU has them.
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define RT_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(RT_X86) && defined(__clang__)
+#define RT_TARGET_AVX2 __attribute__((target("avx2")))
+#define RT_TARGET_AVX512 __attribute__((target("avx512f")))
+#elif defined(RT_X86) && defined(__GNUC__)
+#define RT_TARGET_AVX2 __attribute__((target("avx2")))
+// AVX-512F brings FMA along, and GCC would fuse the kernel's separate multiplies and adds (its default outside strict
+// ISO mode), which changes the rounding away from the scalar code
+#define RT_TARGET_AVX512 __attribute__((target("avx512f"), optimize("fp-contract=off")))
+#else
+#define RT_TARGET_AVX2 // MSVC lets any function use any intrinsic
+#define RT_TARGET_AVX512
+#endif
+
+// Ordered, a CPU that runs a level runs every level below it
+enum class simd_level {
+    scalar,
+    sse2,
+    avx2,
+    avx512
+};
+
+inline const char* simd_level_name(simd_level level) {
+    switch (level) {
+    case simd_level::sse2: return "sse2";
+    case simd_level::avx2: return "avx2";
+    case simd_level::avx512: return "avx512";
+    default: return "scalar";
+    }
+}
+
+inline simd_level detect_simd_level() {
+#if defined(RT_X86) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) { return simd_level::avx512; }
+    if (__builtin_cpu_supports("avx2")) { return simd_level::avx2; }
+    if (__builtin_cpu_supports("sse2")) { return simd_level::sse2; }
+    return simd_level::scalar;
+#elif defined(RT_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int max_leaf = info[0];
+
+    __cpuid(info, 1);
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    bool avx2 = false;
+    bool avx512 = false;
+    if (max_leaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6) { // OS saves the ymm registers
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+        avx512 = (info[1] & (1 << 16)) != 0 && (_xgetbv(0) & 0xe6) == 0xe6; // And the zmm and mask registers
+    }
+    if (avx512) { return simd_level::avx512; }
+    if (avx2) { return simd_level::avx2; }
+    if (sse2) { return simd_level::sse2; }
+    return simd_level::scalar;
+#else
+    return simd_level::scalar;
+#endif
+}
+
+inline simd_level best_simd_level() {
+    // Detected once, the answer can't change while we run.
+    // RT_SIMD=scalar|sse2|avx2|avx512 in the environment caps it, to try the narrower kernels on a wide machine.
+    static const simd_level level = [] {
+        simd_level detected = detect_simd_level();
+        const char* cap = std::getenv("RT_SIMD");
+        if (!cap) { return detected; }
+        for (simd_level l : { simd_level::scalar, simd_level::sse2, simd_level::avx2, simd_level::avx512 }) {
+            if (std::strcmp(cap, simd_level_name(l)) == 0) { return (l < detected) ? l : detected; }
+        }
+        return detected;
+    }();
+    return level;
+}
+
+#endif
@@ -6,8 +6,11 @@
 
 class sphere : public hittable {
 public:
-    sphere(const point3& center, double radius, shared_ptr<material> mat) : center(center), 
-        radius(std::fmax(0, radius)), mat(mat) {}
+    sphere(const point3& center, real radius, const material* mat) : center(center), 
+        radius(std::fmax(real(0), radius)), mat(mat) {
+        auto rvec = vec3(this->radius, this->radius, this->radius);
+        bbox = aabb(center - rvec, center + rvec);
+    }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
         vec3 oc = center - r.origin();
@@ -39,10 +42,72 @@ public:
         return true;
     }
 
+    bool occluded(const ray& r, interval ray_t) const override {
+        // hit() without the record
+        vec3 oc = center - r.origin();
+        auto a = r.direction().length_squared();
+        auto h = dot(r.direction(), oc);
+        auto c = oc.length_squared() - radius * radius;
+        auto discriminant = h * h - a * c;
+        if (discriminant < 0)
+            return false;
+        auto sqrtd = std::sqrt(discriminant);
+        return ray_t.surrounds((h - sqrtd) / a) || ray_t.surrounds((h + sqrtd) / a);
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    // As a light (lights.h): a direction from p uniform over the cone the sphere fills as seen from there, so every
+    // sample hits it. False from inside the sphere, where there is no cone.
+    bool sample_toward(const point3& p, double u, double v, light_sample& s) const {
+        vec3 to_center = center - p;
+        real d2 = to_center.length_squared();
+        real r2 = radius * radius;
+        if (d2 <= r2) { return false; }
+        real sin2_max = r2 / d2;
+        real cos_max = std::sqrt(1 - sin2_max);
+        real cap = sin2_max / (1 + cos_max); // 1 - cos_max without the cancellation for small, far spheres
+
+        real cos_theta = 1 - real(u) * cap;
+        real sin_theta = std::sqrt(std::fmax(real(0), 1 - cos_theta * cos_theta));
+        double sin_phi, cos_phi;
+        sin_cos(2 * pi * v, sin_phi, cos_phi);
+
+        real d = std::sqrt(d2);
+        vec3 w = to_center / d;
+        real sign = std::copysign(real(1), w.z()); // Duff et al.'s basis, as in cosine_direction
+        real a = -1 / (sign + w.z());
+        real b = w.x() * w.y() * a;
+        vec3 tangent(1 + sign * w.x() * w.x() * a, sign * b, -sign * w.x());
+        vec3 bitangent(b, sign + w.y() * w.y() * a, -w.y());
+        s.direction = real(sin_theta * cos_phi) * tangent + real(sin_theta * sin_phi) * bitangent + cos_theta * w;
+        s.distance = d * cos_theta - std::sqrt(std::fmax(real(0), r2 - d2 * sin_theta * sin_theta)); // Near side
+        s.pdf = 1 / (2 * real(pi) * cap);
+        return true;
+    }
+
+    // Density of sample_toward for any direction from p that hits the sphere, the same for all of them
+    real pdf_toward(const point3& p) const {
+        real d2 = (center - p).length_squared();
+        real r2 = radius * radius;
+        if (d2 <= r2) { return 0; }
+        real sin2_max = r2 / d2;
+        return 1 / (2 * real(pi) * (sin2_max / (1 + std::sqrt(1 - sin2_max))));
+    }
+
+    // For animation, whatever holds the sphere has to refit around it afterwards
+    void move(const point3& new_center, real new_radius) {
+        center = new_center;
+        radius = std::fmax(real(0), new_radius);
+        auto rvec = vec3(radius, radius, radius);
+        bbox = aabb(center - rvec, center + rvec);
+    }
+
 private:
     point3 center;
-    double radius;
-    shared_ptr<material> mat;
+    real radius;
+    const material* mat;
+    aabb bbox;
 };
 
 #endif
\ No newline at end of file
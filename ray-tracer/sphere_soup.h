@@ -0,0 +1,296 @@
+#pragma once
+#ifndef SPHERE_SOUP_H
+#define SPHERE_SOUP_H
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "hittable.h"
+#include "rtweekend.h"
+#include "simd.h"
+
+#if defined(RT_X86) && !defined(RT_FLOAT)
+#define RT_SOUP_SIMD // The kernels are double lanes, float builds use the scalar one
+#endif
+
+// Many spheres as one hittable, stored structure of arrays so several of them can be tested against a ray per
+// instruction. Gives exactly the same hit_record as the same spheres as separate sphere objects in a hittable_list.
+class sphere_soup : public hittable {
+public:
+    sphere_soup() : level(widest_kernel()) {}
+
+    void add(const point3& center, real radius, const material* mat) {
+        radius = std::fmax(real(0), radius);
+        size_t i = count++;
+
+        if (i == cx.size()) { // Grow by a whole batch, padding lanes are NaN so they never hit
+            const real nan = std::numeric_limits<real>::quiet_NaN();
+            for (int k = 0; k < batch; k++) {
+                cx.push_back(nan); cy.push_back(nan); cz.push_back(nan);
+                radius_sq.push_back(nan);
+            }
+        }
+        cx[i] = center.x();
+        cy[i] = center.y();
+        cz[i] = center.z();
+        radius_sq[i] = radius * radius;
+        radii.push_back(radius);
+        mats.push_back(mat);
+
+        auto rvec = vec3(radius, radius, radius);
+        bbox = aabb(bbox, aabb(center - rvec, center + rvec));
+    }
+
+    size_t size() const { return count; }
+
+    // Defaults to the widest kernel the CPU runs, the benchmark pins lower ones to compare
+    void set_simd_level(simd_level l) { level = (l > widest_kernel()) ? widest_kernel() : l; }
+    simd_level get_simd_level() const { return level; }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        real t;
+        long i;
+        switch (level) {
+#ifdef RT_SOUP_SIMD
+        case simd_level::avx512: i = closest_avx512(r, ray_t, t); break;
+        case simd_level::avx2: i = closest_avx2(r, ray_t, t); break;
+        case simd_level::sse2: i = closest_sse2(r, ray_t, t); break;
+#endif
+        default: i = closest_scalar(r, ray_t, t); break;
+        }
+        if (i < 0) {
+            return false;
+        }
+
+        // Same record sphere::hit fills in
+        point3 center(cx[i], cy[i], cz[i]);
+        rec.t = t;
+        rec.p = r.at(rec.t);
+        vec3 outward_normal = (rec.p - center) / radii[i];
+        rec.set_face_normal(r, outward_normal);
+        rec.mat = mats[i];
+        return true;
+    }
+
+    // The kernels test every sphere either way, a shadow ray just skips the record
+    bool occluded(const ray& r, interval ray_t) const override {
+        real t;
+        switch (level) {
+#ifdef RT_SOUP_SIMD
+        case simd_level::avx512: return closest_avx512(r, ray_t, t) >= 0;
+        case simd_level::avx2: return closest_avx2(r, ray_t, t) >= 0;
+        case simd_level::sse2: return closest_sse2(r, ray_t, t) >= 0;
+#endif
+        default: return closest_scalar(r, ray_t, t) >= 0;
+        }
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+private:
+    static const int batch = 8; // Widest kernel's lane count, arrays are padded to a multiple of it
+
+    // Padded to batch
+    std::vector<real> cx, cy, cz;
+    std::vector<real> radius_sq;
+    // Only touched for the closest hit
+    std::vector<real> radii;
+    std::vector<const material*> mats;
+
+    size_t count = 0;
+    aabb bbox;
+    simd_level level;
+
+    static simd_level widest_kernel() {
+#ifdef RT_SOUP_SIMD
+        return best_simd_level();
+#else
+        return simd_level::scalar;
+#endif
+    }
+
+    // Each kernel returns the index of the closest sphere with a root in ray_t and that root, or -1.
+    // The arithmetic mirrors sphere::hit operation for operation so all of them agree to the bit. Ties go to the
+    // lower index, like hittable_list where a later object has to be strictly closer.
+
+    long closest_scalar(const ray& r, interval ray_t, real& t_out) const {
+        const point3& o = r.origin();
+        const vec3& d = r.direction();
+        auto a = d.length_squared();
+        long best = -1;
+
+        for (size_t i = 0; i < count; i++) {
+            vec3 oc = point3(cx[i], cy[i], cz[i]) - o;
+            auto h = dot(d, oc);
+            auto c = oc.length_squared() - radius_sq[i];
+            auto discriminant = h * h - a * c;
+            if (discriminant < 0) { continue; }
+
+            auto sqrtd = std::sqrt(discriminant);
+            auto root = (h - sqrtd) / a;
+            if (root <= ray_t.min || ray_t.max <= root) {
+                root = (h + sqrtd) / a;
+                if (root <= ray_t.min || ray_t.max <= root) { continue; }
+            }
+            ray_t.max = root;
+            best = long(i);
+        }
+
+        t_out = ray_t.max;
+        return best;
+    }
+
+#ifdef RT_SOUP_SIMD
+    long closest_sse2(const ray& r, interval ray_t, double& t_out) const {
+        const point3& o = r.origin();
+        const vec3& d = r.direction();
+        const __m128d ox = _mm_set1_pd(o.x()), oy = _mm_set1_pd(o.y()), oz = _mm_set1_pd(o.z());
+        const __m128d dx = _mm_set1_pd(d.x()), dy = _mm_set1_pd(d.y()), dz = _mm_set1_pd(d.z());
+        const __m128d a = _mm_set1_pd(d.length_squared());
+        const __m128d tmin = _mm_set1_pd(ray_t.min);
+        const __m128d zero = _mm_setzero_pd();
+        long best = -1;
+
+        for (size_t i = 0; i < count; i += 2) {
+            __m128d ocx = _mm_sub_pd(_mm_loadu_pd(&cx[i]), ox);
+            __m128d ocy = _mm_sub_pd(_mm_loadu_pd(&cy[i]), oy);
+            __m128d ocz = _mm_sub_pd(_mm_loadu_pd(&cz[i]), oz);
+
+            __m128d h = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, ocx), _mm_mul_pd(dy, ocy)), _mm_mul_pd(dz, ocz));
+            __m128d len2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(ocx, ocx), _mm_mul_pd(ocy, ocy)), _mm_mul_pd(ocz, ocz));
+            __m128d c = _mm_sub_pd(len2, _mm_loadu_pd(&radius_sq[i]));
+            __m128d disc = _mm_sub_pd(_mm_mul_pd(h, h), _mm_mul_pd(a, c));
+            __m128d has_roots = _mm_cmpge_pd(disc, zero); // Ordered compare, NaN padding drops out here
+            if (_mm_movemask_pd(has_roots) == 0) { continue; }
+
+            __m128d sqrtd = _mm_sqrt_pd(disc);
+            __m128d tmax = _mm_set1_pd(ray_t.max);
+            __m128d near_root = _mm_div_pd(_mm_sub_pd(h, sqrtd), a);
+            __m128d far_root = _mm_div_pd(_mm_add_pd(h, sqrtd), a);
+            __m128d near_ok = _mm_and_pd(_mm_cmpgt_pd(near_root, tmin), _mm_cmplt_pd(near_root, tmax));
+            __m128d far_ok = _mm_and_pd(_mm_cmpgt_pd(far_root, tmin), _mm_cmplt_pd(far_root, tmax));
+            __m128d root = _mm_or_pd(_mm_and_pd(near_ok, near_root), _mm_andnot_pd(near_ok, far_root));
+            int hits = _mm_movemask_pd(_mm_and_pd(has_roots, _mm_or_pd(near_ok, far_ok)));
+            if (hits == 0) { continue; }
+
+            alignas(16) double roots[2];
+            _mm_store_pd(roots, root);
+            for (int k = 0; k < 2; k++) {
+                if ((hits >> k & 1) && roots[k] < ray_t.max) {
+                    ray_t.max = roots[k];
+                    best = long(i + k);
+                }
+            }
+        }
+
+        t_out = ray_t.max;
+        return best;
+    }
+
+    RT_TARGET_AVX2
+    long closest_avx2(const ray& r, interval ray_t, double& t_out) const {
+        const point3& o = r.origin();
+        const vec3& d = r.direction();
+        const __m256d ox = _mm256_set1_pd(o.x()), oy = _mm256_set1_pd(o.y()), oz = _mm256_set1_pd(o.z());
+        const __m256d dx = _mm256_set1_pd(d.x()), dy = _mm256_set1_pd(d.y()), dz = _mm256_set1_pd(d.z());
+        const __m256d a = _mm256_set1_pd(d.length_squared());
+        const __m256d tmin = _mm256_set1_pd(ray_t.min);
+        const __m256d zero = _mm256_setzero_pd();
+        long best = -1;
+
+        for (size_t i = 0; i < count; i += 4) {
+            __m256d ocx = _mm256_sub_pd(_mm256_loadu_pd(&cx[i]), ox);
+            __m256d ocy = _mm256_sub_pd(_mm256_loadu_pd(&cy[i]), oy);
+            __m256d ocz = _mm256_sub_pd(_mm256_loadu_pd(&cz[i]), oz);
+
+            // Separate mul and add, no FMA, so the rounding matches the scalar code
+            __m256d h = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, ocx), _mm256_mul_pd(dy, ocy)), _mm256_mul_pd(dz, ocz));
+            __m256d len2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, ocx), _mm256_mul_pd(ocy, ocy)), _mm256_mul_pd(ocz, ocz));
+            __m256d c = _mm256_sub_pd(len2, _mm256_loadu_pd(&radius_sq[i]));
+            __m256d disc = _mm256_sub_pd(_mm256_mul_pd(h, h), _mm256_mul_pd(a, c));
+            __m256d has_roots = _mm256_cmp_pd(disc, zero, _CMP_GE_OQ);
+            if (_mm256_movemask_pd(has_roots) == 0) { continue; }
+
+            __m256d sqrtd = _mm256_sqrt_pd(disc);
+            __m256d tmax = _mm256_set1_pd(ray_t.max);
+            __m256d near_root = _mm256_div_pd(_mm256_sub_pd(h, sqrtd), a);
+            __m256d far_root = _mm256_div_pd(_mm256_add_pd(h, sqrtd), a);
+            __m256d near_ok = _mm256_and_pd(_mm256_cmp_pd(near_root, tmin, _CMP_GT_OQ), _mm256_cmp_pd(near_root, tmax, _CMP_LT_OQ));
+            __m256d far_ok = _mm256_and_pd(_mm256_cmp_pd(far_root, tmin, _CMP_GT_OQ), _mm256_cmp_pd(far_root, tmax, _CMP_LT_OQ));
+            __m256d root = _mm256_blendv_pd(far_root, near_root, near_ok);
+            int hits = _mm256_movemask_pd(_mm256_and_pd(has_roots, _mm256_or_pd(near_ok, far_ok)));
+            if (hits == 0) { continue; }
+
+            alignas(32) double roots[4];
+            _mm256_store_pd(roots, root);
+            for (int k = 0; k < 4; k++) {
+                if ((hits >> k & 1) && roots[k] < ray_t.max) {
+                    ray_t.max = roots[k];
+                    best = long(i + k);
+                }
+            }
+        }
+
+        t_out = ray_t.max;
+        return best;
+    }
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized" // GCC 12 trips over the undefined pass through in _mm512_sqrt_pd
+#endif
+    RT_TARGET_AVX512
+    long closest_avx512(const ray& r, interval ray_t, double& t_out) const {
+        const point3& o = r.origin();
+        const vec3& d = r.direction();
+        const __m512d ox = _mm512_set1_pd(o.x()), oy = _mm512_set1_pd(o.y()), oz = _mm512_set1_pd(o.z());
+        const __m512d dx = _mm512_set1_pd(d.x()), dy = _mm512_set1_pd(d.y()), dz = _mm512_set1_pd(d.z());
+        const __m512d a = _mm512_set1_pd(d.length_squared());
+        const __m512d tmin = _mm512_set1_pd(ray_t.min);
+        const __m512d zero = _mm512_setzero_pd();
+        long best = -1;
+
+        for (size_t i = 0; i < count; i += 8) {
+            __m512d ocx = _mm512_sub_pd(_mm512_loadu_pd(&cx[i]), ox);
+            __m512d ocy = _mm512_sub_pd(_mm512_loadu_pd(&cy[i]), oy);
+            __m512d ocz = _mm512_sub_pd(_mm512_loadu_pd(&cz[i]), oz);
+
+            // Same no FMA rule as the AVX2 kernel, comparisons give bit masks instead of lane masks
+            __m512d h = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(dx, ocx), _mm512_mul_pd(dy, ocy)), _mm512_mul_pd(dz, ocz));
+            __m512d len2 = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(ocx, ocx), _mm512_mul_pd(ocy, ocy)), _mm512_mul_pd(ocz, ocz));
+            __m512d c = _mm512_sub_pd(len2, _mm512_loadu_pd(&radius_sq[i]));
+            __m512d disc = _mm512_sub_pd(_mm512_mul_pd(h, h), _mm512_mul_pd(a, c));
+            __mmask8 has_roots = _mm512_cmp_pd_mask(disc, zero, _CMP_GE_OQ);
+            if (has_roots == 0) { continue; }
+
+            __m512d sqrtd = _mm512_sqrt_pd(disc);
+            __m512d tmax = _mm512_set1_pd(ray_t.max);
+            __m512d near_root = _mm512_div_pd(_mm512_sub_pd(h, sqrtd), a);
+            __m512d far_root = _mm512_div_pd(_mm512_add_pd(h, sqrtd), a);
+            __mmask8 near_ok = _mm512_cmp_pd_mask(near_root, tmin, _CMP_GT_OQ) & _mm512_cmp_pd_mask(near_root, tmax, _CMP_LT_OQ);
+            __mmask8 far_ok = _mm512_cmp_pd_mask(far_root, tmin, _CMP_GT_OQ) & _mm512_cmp_pd_mask(far_root, tmax, _CMP_LT_OQ);
+            __m512d root = _mm512_mask_blend_pd(near_ok, far_root, near_root);
+            int hits = has_roots & (near_ok | far_ok);
+            if (hits == 0) { continue; }
+
+            alignas(64) double roots[8];
+            _mm512_store_pd(roots, root);
+            for (int k = 0; k < 8; k++) {
+                if ((hits >> k & 1) && roots[k] < ray_t.max) {
+                    ray_t.max = roots[k];
+                    best = long(i + k);
+                }
+            }
+        }
+
+        t_out = ray_t.max;
+        return best;
+    }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+};
+
+#endif
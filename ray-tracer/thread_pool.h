@@ -0,0 +1,91 @@
+#pragma once
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing pool for a fixed batch of jobs numbered 0..job_count-1.
+// Every worker starts with a contiguous slice of the jobs in its own deque. It pops from the back of
+// its own deque and, once that is empty, steals from the front of the others. Jobs that are cheap
+// (sky) and jobs that are expensive (glass) end up spread over all workers without a central queue.
+class work_stealing_pool {
+public:
+    explicit work_stealing_pool(int thread_count) : queues(resolve_thread_count(thread_count)) {}
+
+    static int resolve_thread_count(int thread_count) {
+        if (thread_count <= 0) { // 0 means use every hardware thread
+            thread_count = int(std::thread::hardware_concurrency());
+        }
+        return (thread_count < 1) ? 1 : thread_count;
+    }
+
+    int size() const { return int(queues.size()); }
+
+    // Calls job(index, worker) once for every index and returns when all of them are done.
+    // The calling thread works as worker 0, so a pool of size 1 never spawns a thread.
+    void run(int job_count, const std::function<void(int, int)>& job) {
+        int workers = size();
+        for (int w = 0; w < workers; w++) {
+            int begin = int((long long)job_count * w / workers);
+            int end = int((long long)job_count * (w + 1) / workers);
+            for (int i = begin; i < end; i++) {
+                queues[w].jobs.push_back(i);
+            }
+        }
+
+        std::vector<std::thread> threads;
+        for (int w = 1; w < workers; w++) {
+            threads.emplace_back([this, w, &job] { work(w, job); });
+        }
+        work(0, job);
+
+        for (auto& t : threads) {
+            t.join();
+        }
+    }
+
+private:
+    struct alignas(64) job_queue { // Own cache line so workers don't fight over each others' locks
+        std::mutex lock;
+        std::deque<int> jobs;
+    };
+
+    std::vector<job_queue> queues;
+
+    void work(int worker, const std::function<void(int, int)>& job) {
+        int index;
+        while (pop(worker, index) || steal(worker, index)) {
+            job(index, worker);
+        }
+    }
+
+    bool pop(int worker, int& index) {
+        auto& q = queues[worker];
+        std::lock_guard<std::mutex> guard(q.lock);
+        if (q.jobs.empty()) { return false; }
+        index = q.jobs.back();
+        q.jobs.pop_back();
+        return true;
+    }
+
+    bool steal(int worker, int& index) {
+        // Jobs are never added during a run, so one empty sweep over every queue means we are done
+        int workers = size();
+        for (int k = 1; k < workers; k++) {
+            auto& q = queues[(worker + k) % workers];
+            std::lock_guard<std::mutex> guard(q.lock);
+            if (!q.jobs.empty()) {
+                index = q.jobs.front();
+                q.jobs.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+#endif
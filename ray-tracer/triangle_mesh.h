@@ -0,0 +1,571 @@
+#pragma once
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bvh.h"
+#include "flat_bvh.h"
+#include "hittable.h"
+#include "mapped_file.h"
+#include "rtweekend.h"
+
+// Many triangles as one hittable, with its own BVH over them.
+// Vertices are shared: each position is stored once, as float (what mesh files hold anyway, also in double builds),
+// and a triangle is three 32 bit indices into them. The tree has flat_bvh's 32 byte nodes and its leaves are runs
+// of the index buffer, which the build puts in leaf order, so there is no object or pointer per triangle anywhere.
+// A closed mesh has about half as many vertices as triangles, that makes 6 + 12 + ~19 (tree) bytes per triangle.
+class triangle_mesh : public hittable {
+public:
+    static const int max_leaf_size = 4;
+    static const int max_depth = flat_bvh::max_depth;
+
+    double parse_seconds = 0; // Of the last load_obj
+    double build_seconds = 0; // Of the last build
+
+    explicit triangle_mesh(const material* mat = nullptr) : mat(mat) {}
+
+    void set_material(const material* m) { mat = m; }
+
+    // By hand: vertices, triangles of their indices, then build() before the first hit()
+    uint32_t add_vertex(const point3& p) {
+        positions.push_back(float(p.x()));
+        positions.push_back(float(p.y()));
+        positions.push_back(float(p.z()));
+        return uint32_t(vertex_count() - 1);
+    }
+
+    void add_triangle(uint32_t a, uint32_t b, uint32_t c) {
+        indices.push_back(a);
+        indices.push_back(b);
+        indices.push_back(c);
+    }
+
+    size_t vertex_count() const { return positions.size() / 3; }
+    size_t triangle_count() const { return indices.size() / 3; }
+    size_t node_count() const { return nodes.size(); }
+    size_t bytes() const {
+        return sizeof(*this) + positions.capacity() * sizeof(float) + indices.capacity() * sizeof(uint32_t)
+             + nodes.capacity() * sizeof(flat_bvh_node);
+    }
+
+    // Wavefront OBJ, added to whatever the mesh has, then built.
+    // v lines are vertices and f lines polygons of their 1 based indices (negative ones count back from the latest
+    // vertex, v/vt/vn forms use the v part), cut into a fan of triangles. Everything else (normals, texture
+    // coordinates, groups, materials) is skipped. The file is mapped rather than read, and walked twice: once to
+    // count, so the buffers are allocated once at their final size, once to fill them. Errors go to std::cerr.
+    bool load_obj(const std::string& path) {
+        auto start = std::chrono::steady_clock::now();
+        mapped_file file;
+        if (!file.open(path)) {
+            std::cerr << "Could not open mesh " << path << '\n';
+            return false;
+        }
+
+        size_t new_vertices = 0, new_triangles = 0;
+        for_each_line(file, [&](const char* p, const char* end) {
+            if (is_statement(p, end, 'v')) { new_vertices++; }
+            else if (is_statement(p, end, 'f')) {
+                size_t corners = 0;
+                for (p = skip_blanks(p + 1, end); p < end && *p != '#'; p = skip_blanks(p, end)) {
+                    corners++;
+                    while (p < end && !is_blank(*p)) { p++; }
+                }
+                new_triangles += (corners > 2) ? corners - 2 : 0;
+            }
+            return true;
+        });
+        positions.reserve(positions.size() + 3 * new_vertices);
+        indices.reserve(indices.size() + 3 * new_triangles);
+
+        const size_t base = vertex_count(); // OBJ index 1 is this vertex
+        size_t line_number = 0;
+        bool ok = for_each_line(file, [&](const char* p, const char* end) {
+            line_number++;
+            if (is_statement(p, end, 'v')) {
+                p++;
+                double x, y, z;
+                if (!parse_number(p, end, x) || !parse_number(p, end, y) || !parse_number(p, end, z)) { return false; }
+                add_vertex(point3(x, y, z)); // A w after them is ignored
+                return true;
+            }
+            if (!is_statement(p, end, 'f')) { return true; }
+
+            p++;
+            uint32_t first = 0, previous = 0;
+            int corners = 0;
+            for (p = skip_blanks(p, end); p < end && *p != '#'; p = skip_blanks(p, end)) {
+                int64_t k;
+                if (!parse_index(p, end, k)) { return false; }
+                int64_t v = (k > 0) ? int64_t(base) + k - 1 : int64_t(vertex_count()) + k;
+                if (k == 0 || v < int64_t(base) || v >= int64_t(vertex_count())) { return false; }
+                if (corners >= 2) { add_triangle(first, previous, uint32_t(v)); }
+                if (corners == 0) { first = uint32_t(v); }
+                previous = uint32_t(v);
+                corners++;
+            }
+            return corners >= 3;
+        });
+        if (!ok) {
+            std::cerr << path << ':' << line_number << ": can't parse this line\n";
+            return false;
+        }
+        parse_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        build();
+        return true;
+    }
+
+    // Binned SAH tree like flat_bvh's, over boxes that only exist while it's built
+    void build() {
+        auto start = std::chrono::steady_clock::now();
+        size_t n = triangle_count();
+        nodes.clear();
+
+        std::vector<build_item> items(n);
+        for (size_t i = 0; i < n; i++) {
+            float_box& b = items[i].box;
+            items[i].triangle = uint32_t(i);
+            for (int a = 0; a < 3; a++) {
+                float p0 = positions[3 * size_t(indices[3 * i]) + a];
+                float p1 = positions[3 * size_t(indices[3 * i + 1]) + a];
+                float p2 = positions[3 * size_t(indices[3 * i + 2]) + a];
+                b.lo[a] = std::min(p0, std::min(p1, p2));
+                b.hi[a] = std::max(p0, std::max(p1, p2));
+            }
+        }
+        nodes.reserve(n); // Enough unless most leaves hold a single triangle
+        if (n > 0) {
+            build(items, 0, n, 0);
+        }
+        nodes.shrink_to_fit();
+
+        // Triangles in leaf order, so a leaf is just a range of them
+        std::vector<uint32_t> sorted(indices.size());
+        for (size_t k = 0; k < n; k++) {
+            std::memcpy(&sorted[3 * k], &indices[3 * size_t(items[k].triangle)], 3 * sizeof(uint32_t));
+        }
+        indices.swap(sorted);
+        build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (nodes.empty()) {
+            return false;
+        }
+
+        const point3& orig = r.origin();
+        const vec3& dir = r.direction();
+        const vec3 inv_dir(1.0 / dir.x(), 1.0 / dir.y(), 1.0 / dir.z());
+        const bool dir_neg[3] = { inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0 };
+        const sheared_ray sheared(r);
+
+        uint32_t stack[max_depth];
+        int stack_size = 0;
+        uint32_t current = 0;
+        int64_t closest = -1; // Only the closest triangle gets a hit record, once the walk is done
+
+        while (true) {
+            const flat_bvh_node& node = nodes[current];
+
+            if (node_hit(node, orig, inv_dir, ray_t)) {
+                if (node.count > 0) {
+                    for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                        real t;
+                        if (intersect(sheared, i, ray_t, t)) {
+                            closest = i;
+                            ray_t.max = t;
+                        }
+                    }
+                }
+                else if (dir_neg[node.axis]) {
+                    stack[stack_size++] = current + 1;
+                    current = node.offset;
+                    continue;
+                }
+                else {
+                    stack[stack_size++] = node.offset;
+                    current = current + 1;
+                    continue;
+                }
+            }
+
+            if (stack_size == 0) { break; }
+            current = stack[--stack_size];
+        }
+
+        if (closest < 0) {
+            return false;
+        }
+        point3 v0 = vertex(indices[3 * size_t(closest)]);
+        point3 v1 = vertex(indices[3 * size_t(closest) + 1]);
+        point3 v2 = vertex(indices[3 * size_t(closest) + 2]);
+        rec.t = ray_t.max;
+        rec.p = r.at(rec.t);
+        rec.set_face_normal(r, unit_vector(cross(v1 - v0, v2 - v0))); // Counterclockwise seen from outside, as in OBJ
+        rec.mat = mat;
+        return true;
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        if (nodes.empty()) {
+            return false;
+        }
+
+        const point3& orig = r.origin();
+        const vec3& dir = r.direction();
+        const vec3 inv_dir(1.0 / dir.x(), 1.0 / dir.y(), 1.0 / dir.z());
+        const bool dir_neg[3] = { inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0 };
+        const sheared_ray sheared(r);
+
+        uint32_t stack[max_depth];
+        int stack_size = 0;
+        uint32_t current = 0;
+
+        while (true) {
+            const flat_bvh_node& node = nodes[current];
+
+            if (node_hit(node, orig, inv_dir, ray_t)) {
+                if (node.count > 0) {
+                    for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                        real t;
+                        if (intersect(sheared, i, ray_t, t)) { return true; } // Any triangle will do
+                    }
+                }
+                else if (dir_neg[node.axis]) {
+                    stack[stack_size++] = current + 1;
+                    current = node.offset;
+                    continue;
+                }
+                else {
+                    stack[stack_size++] = node.offset;
+                    current = current + 1;
+                    continue;
+                }
+            }
+
+            if (stack_size == 0) { break; }
+            current = stack[--stack_size];
+        }
+
+        return false;
+    }
+
+    aabb bounding_box() const override {
+        if (nodes.empty()) { return aabb(); }
+        const auto& root = nodes[0];
+        return aabb(point3(root.bounds_min[0], root.bounds_min[1], root.bounds_min[2]),
+                    point3(root.bounds_max[0], root.bounds_max[1], root.bounds_max[2]));
+    }
+
+private:
+    struct float_box {
+        float lo[3], hi[3];
+        float centroid(int a) const { return lo[a] + hi[a]; } // Twice the center, only ever compared
+    };
+
+    // Triangles are moved around the build as these, so every pass over a range reads memory in order
+    struct build_item {
+        float_box box;
+        uint32_t triangle;
+    };
+
+    std::vector<float> positions; // x, y, z of every vertex
+    std::vector<uint32_t> indices; // Three per triangle, in leaf order once built
+    std::vector<flat_bvh_node> nodes;
+    const material* mat;
+
+    point3 vertex(uint32_t v) const {
+        const float* p = &positions[3 * size_t(v)];
+        return point3(p[0], p[1], p[2]);
+    }
+
+    // The per ray half of the watertight test (Woop, Benthin and Wald, "Watertight Ray/Triangle Intersection",
+    // 2013): the ray's largest direction axis becomes z, and a shear takes the ray onto the z axis, after which
+    // the triangle is tested in 2D against the origin
+    struct sheared_ray {
+        point3 orig;
+        int kx, ky, kz;
+        real sx, sy, sz;
+
+        explicit sheared_ray(const ray& r) : orig(r.origin()) {
+            const vec3& d = r.direction();
+            kz = 0;
+            if (std::fabs(d.y()) > std::fabs(d[kz])) { kz = 1; }
+            if (std::fabs(d.z()) > std::fabs(d[kz])) { kz = 2; }
+            kx = (kz + 1) % 3;
+            ky = (kx + 1) % 3;
+            if (d[kz] < 0) { std::swap(kx, ky); } // Keeps the winding, so the edge functions' signs mean the same
+            sx = d[kx] / d[kz];
+            sy = d[ky] / d[kz];
+            sz = 1 / d[kz];
+        }
+    };
+
+    // Triangle i against the sheared ray, t in ray_t exclusive like sphere::hit. Two triangles sharing an edge
+    // compute the same edge function for it with opposite signs, so a ray through the edge or a vertex hits at
+    // least one of the triangles around it instead of slipping between them.
+    bool intersect(const sheared_ray& s, uint32_t i, interval ray_t, real& t) const {
+        const float* p0 = &positions[3 * size_t(indices[3 * size_t(i)])];
+        const float* p1 = &positions[3 * size_t(indices[3 * size_t(i) + 1])];
+        const float* p2 = &positions[3 * size_t(indices[3 * size_t(i) + 2])];
+
+        real a[3], b[3], c[3]; // Vertices relative to the ray origin
+        for (int k = 0; k < 3; k++) {
+            a[k] = p0[k] - s.orig[k];
+            b[k] = p1[k] - s.orig[k];
+            c[k] = p2[k] - s.orig[k];
+        }
+        real ax = a[s.kx] - s.sx * a[s.kz], ay = a[s.ky] - s.sy * a[s.kz];
+        real bx = b[s.kx] - s.sx * b[s.kz], by = b[s.ky] - s.sy * b[s.kz];
+        real cx = c[s.kx] - s.sx * c[s.kz], cy = c[s.ky] - s.sy * c[s.kz];
+
+        // Scaled barycentrics, signed areas of the edges against the origin
+        real u = cx * by - cy * bx;
+        real v = ax * cy - ay * cx;
+        real w = bx * ay - by * ax;
+        if (sizeof(real) < sizeof(double) && (u == 0 || v == 0 || w == 0)) {
+            // On an edge in float, which may be rounding: that edge decides between two triangles, in double
+            u = real(double(cx) * double(by) - double(cy) * double(bx));
+            v = real(double(ax) * double(cy) - double(ay) * double(cx));
+            w = real(double(bx) * double(ay) - double(by) * double(ax));
+        }
+
+        if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0)) {
+            return false; // Origin outside, either winding counts (no backface culling, glass needs both)
+        }
+        real det = u + v + w;
+        if (det == 0) {
+            return false; // Ray in the triangle's plane
+        }
+        real scaled_t = u * (s.sz * a[s.kz]) + v * (s.sz * b[s.kz]) + w * (s.sz * c[s.kz]);
+        t = scaled_t / det;
+        return ray_t.min < t && t < ray_t.max;
+    }
+
+    uint32_t build(std::vector<build_item>& items, size_t start, size_t end, int depth) {
+        uint32_t index = uint32_t(nodes.size());
+        nodes.emplace_back();
+
+        float_box bounds = empty_box();
+        float_box centroids = empty_box();
+        for (size_t k = start; k < end; k++) {
+            const float_box& b = items[k].box;
+            grow(bounds, b);
+            for (int a = 0; a < 3; a++) {
+                centroids.lo[a] = std::min(centroids.lo[a], b.centroid(a));
+                centroids.hi[a] = std::max(centroids.hi[a], b.centroid(a));
+            }
+        }
+        aabb bbox(point3(bounds.lo[0], bounds.lo[1], bounds.lo[2]), point3(bounds.hi[0], bounds.hi[1], bounds.hi[2]));
+
+        size_t span = end - start;
+        if (span <= max_leaf_size) {
+            set_node_bounds(nodes[index], bbox);
+            nodes[index].offset = uint32_t(start);
+            nodes[index].count = uint16_t(span);
+            return index;
+        }
+
+        // Like flat_bvh, median splits past half the stack depth keep any tree inside the traversal stack
+        int axis = 0;
+        size_t mid = (depth < max_depth / 2) ? sah_split(items, centroids, start, end, axis) : end;
+        if (mid == start || mid == end) {
+            axis = 0;
+            for (int a = 1; a < 3; a++) {
+                if (centroids.hi[a] - centroids.lo[a] > centroids.hi[axis] - centroids.lo[axis]) { axis = a; }
+            }
+            mid = start + span / 2;
+            std::nth_element(items.begin() + start, items.begin() + mid, items.begin() + end,
+                [&](const build_item& x, const build_item& y) { return x.box.centroid(axis) < y.box.centroid(axis); });
+        }
+
+        // The lower half along the axis is built first, a ray going the -axis way visits the second one first
+        build(items, start, mid, depth + 1);
+        uint32_t second = build(items, mid, end, depth + 1);
+
+        set_node_bounds(nodes[index], bbox);
+        nodes[index].offset = second;
+        nodes[index].count = 0;
+        nodes[index].axis = uint8_t(axis);
+        return index;
+    }
+
+    // sah_partition from bvh.h on float boxes. Returns the first triangle of the upper side, start or end if no
+    // plane splits the range.
+    static size_t sah_split(std::vector<build_item>& items, const float_box& centroids, size_t start, size_t end,
+                            int& best_axis) {
+        int best_bin = -1;
+        double best_cost = infinity;
+        for (int axis = 0; axis < 3; axis++) {
+            float extent = centroids.hi[axis] - centroids.lo[axis];
+            if (!(extent > 0)) { continue; }
+
+            float_box bin_bounds[sah_bins];
+            size_t bin_count[sah_bins] = {};
+            for (auto& b : bin_bounds) { b = empty_box(); }
+            float scale = sah_bins / extent;
+            for (size_t k = start; k < end; k++) {
+                const float_box& box = items[k].box;
+                int b = std::min(sah_bins - 1, int((box.centroid(axis) - centroids.lo[axis]) * scale));
+                grow(bin_bounds[b], box);
+                bin_count[b]++;
+            }
+
+            double right_area[sah_bins];
+            size_t right_count[sah_bins];
+            float_box acc = empty_box();
+            size_t n = 0;
+            for (int b = sah_bins - 1; b > 0; b--) {
+                grow(acc, bin_bounds[b]);
+                n += bin_count[b];
+                right_area[b] = area(acc);
+                right_count[b] = n;
+            }
+            acc = empty_box();
+            n = 0;
+            for (int b = 0; b < sah_bins - 1; b++) {
+                grow(acc, bin_bounds[b]);
+                n += bin_count[b];
+                double cost = area(acc) * n + right_area[b + 1] * right_count[b + 1];
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_bin = b;
+                }
+            }
+        }
+        if (best_bin < 0) {
+            return end;
+        }
+
+        float scale = sah_bins / (centroids.hi[best_axis] - centroids.lo[best_axis]);
+        auto first_upper = std::partition(items.begin() + start, items.begin() + end, [&](const build_item& item) {
+            int b = std::min(sah_bins - 1, int((item.box.centroid(best_axis) - centroids.lo[best_axis]) * scale));
+            return b <= best_bin;
+        });
+        return size_t(first_upper - items.begin());
+    }
+
+    static float_box empty_box() {
+        const float inf = std::numeric_limits<float>::infinity();
+        return { { inf, inf, inf }, { -inf, -inf, -inf } };
+    }
+
+    static void grow(float_box& box, const float_box& other) { // std::min and max are one instruction, fmin isn't
+        for (int a = 0; a < 3; a++) {
+            box.lo[a] = std::min(box.lo[a], other.lo[a]);
+            box.hi[a] = std::max(box.hi[a], other.hi[a]);
+        }
+    }
+
+    static double area(const float_box& box) {
+        if (!(box.lo[0] <= box.hi[0])) { return 0; }
+        double dx = box.hi[0] - box.lo[0], dy = box.hi[1] - box.lo[1], dz = box.hi[2] - box.lo[2];
+        return 2 * (dx * dy + dy * dz + dz * dx);
+    }
+
+    // Line by line over a mapped file, without the '\n'. Stops at the first line f returns false for.
+    template <typename F>
+    static bool for_each_line(const mapped_file& file, F f) {
+        const char* p = file.begin();
+        const char* end = file.end();
+        while (p < end) {
+            const char* eol = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+            if (!eol) { eol = end; }
+            if (!f(skip_blanks(p, eol), eol)) { return false; }
+            p = eol + 1;
+        }
+        return true;
+    }
+
+    static bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    static const char* skip_blanks(const char* p, const char* end) {
+        while (p < end && is_blank(*p)) { p++; }
+        return p;
+    }
+
+    // "v ..." but not "vn ..."
+    static bool is_statement(const char* p, const char* end, char keyword) {
+        return p < end && *p == keyword && (p + 1 == end || is_blank(p[1]));
+    }
+
+    // Decimal number with optional fraction and exponent, bounded by end since the mapping has no terminating NUL
+    // (which strtod would need). Mantissas up to 2^53 with powers of ten up to 22 convert exactly and take a single
+    // rounding, which covers the 6 to 9 digits mesh files write. Anything longer goes through strtod on a copy.
+    static bool parse_number(const char*& p, const char* end, double& out) {
+        static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13,
+                                         1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+        p = skip_blanks(p, end);
+        const char* begin = p;
+        bool negative = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+')) { p++; }
+
+        uint64_t mantissa = 0;
+        int significant = 0, exponent = 0;
+        bool any = false;
+        auto digit = [&](bool fraction) {
+            if (significant < 19) {
+                mantissa = mantissa * 10 + uint64_t(*p - '0');
+                significant += (mantissa != 0);
+                exponent -= fraction;
+            }
+            else {
+                exponent += !fraction; // Digits past what fits only scale the integer part
+            }
+            any = true;
+            p++;
+        };
+        while (p < end && *p >= '0' && *p <= '9') { digit(false); }
+        if (p < end && *p == '.') {
+            p++;
+            while (p < end && *p >= '0' && *p <= '9') { digit(true); }
+        }
+        if (!any) { return false; }
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            p++;
+            bool negative_exponent = p < end && *p == '-';
+            if (p < end && (*p == '-' || *p == '+')) { p++; }
+            if (!(p < end && *p >= '0' && *p <= '9')) { return false; }
+            int e = 0;
+            while (p < end && *p >= '0' && *p <= '9') { e = std::min(e * 10 + (*p++ - '0'), 100000); }
+            exponent += negative_exponent ? -e : e;
+        }
+        if (p < end && !is_blank(*p)) { return false; }
+
+        if (mantissa > (uint64_t(1) << 53) || exponent > 22 || exponent < -22) {
+            out = std::strtod(std::string(begin, p).c_str(), nullptr);
+            return true;
+        }
+        double value = double(mantissa);
+        value = (exponent >= 0) ? value * powers[exponent] : value / powers[-exponent];
+        out = negative ? -value : value;
+        return true;
+    }
+
+    // One corner of a face: the vertex index of "v", "v/vt", "v//vn" or "v/vt/vn"
+    static bool parse_index(const char*& p, const char* end, int64_t& out) {
+        bool negative = p < end && *p == '-';
+        if (negative) { p++; }
+        if (!(p < end && *p >= '0' && *p <= '9')) { return false; }
+        int64_t k = 0;
+        while (p < end && *p >= '0' && *p <= '9') { k = std::min<int64_t>(k * 10 + (*p++ - '0'), int64_t(1) << 40); }
+        if (p < end && !is_blank(*p) && *p != '/') { return false; }
+        while (p < end && !is_blank(*p)) { p++; }
+        out = negative ? -k : k;
+        return true;
+    }
+};
+
+#endif
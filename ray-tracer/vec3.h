@@ -2,54 +2,73 @@
 #ifndef VEC3_H
 #define VEC3_H
 
+#include <type_traits>
+
 #include "rtweekend.h"
 
-class vec3 {
+#if defined(RT_VEC3_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <immintrin.h>
+#define RT_VEC3_SIMD_KERNELS 1
+#endif
+
+// T is the scalar type, float or double; the renderer uses vec3 = basic_vec3<real> (see rtweekend.h).
+// With RT_VEC3_SIMD defined the components are padded to four and aligned to a whole register, so dot, cross and
+// unit_vector can load a vector in one instruction. The fourth lane is always 0. The kernels do the same operations
+// in the same order as the scalar code, so both give the same bits.
+template <typename T>
+class basic_vec3 {
 public:
-    double e[3];
+    using value_type = T;
+#ifdef RT_VEC3_SIMD
+    static const int lanes = 4;
+#else
+    static const int lanes = 3;
+#endif
+
+    alignas(lanes == 4 ? 4 * sizeof(T) : alignof(T)) T e[lanes];
 
-    vec3() : e{ 0,0,0 } {}
-    vec3(double e0, double e1, double e2) : e{ e0, e1, e2 } {}
+    basic_vec3() : e{ 0,0,0 } {}
+    basic_vec3(T e0, T e1, T e2) : e{ e0, e1, e2 } {}
 
-    double x() const { return e[0]; }
-    double y() const { return e[1]; }
-    double z() const { return e[2]; }
+    T x() const { return e[0]; }
+    T y() const { return e[1]; }
+    T z() const { return e[2]; }
 
-    vec3 operator-() const { return vec3(-e[0], -e[1], -e[2]); }
-    double operator[](int i) const { return e[i]; }
-    double& operator[](int i) { return e[i]; }
+    basic_vec3 operator-() const { return basic_vec3(-e[0], -e[1], -e[2]); }
+    T operator[](int i) const { return e[i]; }
+    T& operator[](int i) { return e[i]; }
 
-    vec3& operator+=(const vec3& v) {
+    basic_vec3& operator+=(const basic_vec3& v) {
         e[0] += v.e[0];
         e[1] += v.e[1];
         e[2] += v.e[2];
         return *this;
     }
 
-    vec3& operator*=(double t) {
+    basic_vec3& operator*=(T t) {
         e[0] *= t;
         e[1] *= t;
         e[2] *= t;
         return *this;
     }
 
-    vec3& operator/=(double t) {
+    basic_vec3& operator/=(T t) {
         return *this *= 1 / t;
     }
 
-    static vec3 random() {
-        return vec3(random_double(), random_double(), random_double());
+    static basic_vec3 random(pcg32& rng = thread_rng()) {
+        return basic_vec3(T(random_double(rng)), T(random_double(rng)), T(random_double(rng)));
     }
 
-    static vec3 random(double min, double max) {
-        return vec3(random_double(min,max), random_double(min,max), random_double(min,max));
+    static basic_vec3 random(double min, double max, pcg32& rng = thread_rng()) {
+        return basic_vec3(T(random_double(min,max,rng)), T(random_double(min,max,rng)), T(random_double(min,max,rng)));
     }
 
-    double length() const {
+    T length() const {
         return std::sqrt(length_squared());
     }
 
-    double length_squared() const {
+    T length_squared() const {
         return e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
     }
 
@@ -62,64 +81,186 @@ public:
 
 };
 
+using vec3 = basic_vec3<real>;
 using point3 = vec3;
 
-inline std::ostream& operator<<(std::ostream& out, const vec3& v) {
+// Scalars are taken as the vector's own value_type, which isn't deduced, so 2.0 * v works for float vectors too
+template <typename T>
+using vec3_scalar = typename basic_vec3<T>::value_type;
+
+template <typename T>
+inline std::ostream& operator<<(std::ostream& out, const basic_vec3<T>& v) {
     return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
 }
 
-inline vec3 operator+(const vec3& u, const vec3& v) {
-    return vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
+template <typename T>
+inline basic_vec3<T> operator+(const basic_vec3<T>& u, const basic_vec3<T>& v) {
+    return basic_vec3<T>(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
 }
 
-inline vec3 operator+(const vec3& u, const float f) {
-    return vec3(u.e[0] + f, u.e[1] + f, u.e[2] + f);
+template <typename T>
+inline basic_vec3<T> operator+(const basic_vec3<T>& u, vec3_scalar<T> f) {
+    return basic_vec3<T>(u.e[0] + f, u.e[1] + f, u.e[2] + f);
 }
 
-inline vec3 operator-(const vec3& u, const vec3& v) {
-    return vec3(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
+template <typename T>
+inline basic_vec3<T> operator-(const basic_vec3<T>& u, const basic_vec3<T>& v) {
+    return basic_vec3<T>(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
 }
 
 
-inline vec3 operator-(const vec3& u, const float f) {
-    return vec3(u.e[0] - f, u.e[1] - f, u.e[2] - f);
+template <typename T>
+inline basic_vec3<T> operator-(const basic_vec3<T>& u, vec3_scalar<T> f) {
+    return basic_vec3<T>(u.e[0] - f, u.e[1] - f, u.e[2] - f);
 }
 
-inline vec3 operator*(const vec3& u, const vec3& v) {
-    return vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
+template <typename T>
+inline basic_vec3<T> operator*(const basic_vec3<T>& u, const basic_vec3<T>& v) {
+    return basic_vec3<T>(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
 }
 
-inline vec3 operator*(double t, const vec3& v) {
-    return vec3(t * v.e[0], t * v.e[1], t * v.e[2]);
+template <typename T>
+inline basic_vec3<T> operator*(vec3_scalar<T> t, const basic_vec3<T>& v) {
+    return basic_vec3<T>(t * v.e[0], t * v.e[1], t * v.e[2]);
 }
 
-inline vec3 operator*(const vec3& v, double t) {
+template <typename T>
+inline basic_vec3<T> operator*(const basic_vec3<T>& v, vec3_scalar<T> t) {
     return t * v;
 }
 
-inline vec3 operator/(const vec3& v, double t) {
+template <typename T>
+inline basic_vec3<T> operator/(const basic_vec3<T>& v, vec3_scalar<T> t) {
     return (1 / t) * v;
 }
 
-inline double dot(const vec3& u, const vec3& v) {
+template <typename T>
+inline T dot(const basic_vec3<T>& u, const basic_vec3<T>& v) {
+#ifdef RT_VEC3_SIMD_KERNELS
+    if constexpr (std::is_same<T, float>::value) {
+        __m128 p = _mm_mul_ps(_mm_load_ps(u.e), _mm_load_ps(v.e));
+        __m128 s = _mm_add_ss(p, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1))); // x + y
+        return _mm_cvtss_f32(_mm_add_ss(s, _mm_movehl_ps(p, p))); // + z
+    }
+    else {
+        __m128d xy = _mm_mul_pd(_mm_load_pd(u.e), _mm_load_pd(v.e));
+        __m128d zw = _mm_mul_pd(_mm_load_pd(u.e + 2), _mm_load_pd(v.e + 2));
+        return _mm_cvtsd_f64(_mm_add_sd(_mm_add_sd(xy, _mm_unpackhi_pd(xy, xy)), zw));
+    }
+#else
     return u.e[0] * v.e[0]
         + u.e[1] * v.e[1]
         + u.e[2] * v.e[2];
+#endif
 }
 
-inline vec3 cross(const vec3& u, const vec3& v) {
-    return vec3(u.e[1] * v.e[2] - u.e[2] * v.e[1],
+template <typename T>
+inline basic_vec3<T> cross(const basic_vec3<T>& u, const basic_vec3<T>& v) {
+#ifdef RT_VEC3_SIMD_KERNELS
+    if constexpr (std::is_same<T, float>::value) {
+        // yzx * zxy - zxy * yzx, the fourth lanes give 0 * 0 - 0 * 0
+        __m128 a = _mm_load_ps(u.e), b = _mm_load_ps(v.e);
+        __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 b_zxy = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2));
+        __m128 a_zxy = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2));
+        __m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+        basic_vec3<T> r;
+        _mm_store_ps(r.e, _mm_sub_ps(_mm_mul_ps(a_yzx, b_zxy), _mm_mul_ps(a_zxy, b_yzx)));
+        return r;
+    }
+#endif
+    return basic_vec3<T>(u.e[1] * v.e[2] - u.e[2] * v.e[1],
         u.e[2] * v.e[0] - u.e[0] * v.e[2],
         u.e[0] * v.e[1] - u.e[1] * v.e[0]);
 }
 
-inline vec3 unit_vector(const vec3& v) {
+template <typename T>
+inline basic_vec3<T> unit_vector(const basic_vec3<T>& v) {
+#ifdef RT_VEC3_SIMD_KERNELS
+    T inv = 1 / std::sqrt(dot(v, v)); // What v / v.length() computes
+    basic_vec3<T> r;
+    if constexpr (std::is_same<T, float>::value) {
+        _mm_store_ps(r.e, _mm_mul_ps(_mm_set1_ps(inv), _mm_load_ps(v.e)));
+    }
+    else {
+        __m128d s = _mm_set1_pd(inv);
+        _mm_store_pd(r.e, _mm_mul_pd(s, _mm_load_pd(v.e)));
+        _mm_store_pd(r.e + 2, _mm_mul_pd(s, _mm_load_pd(v.e + 2)));
+    }
+    return r;
+#else
     return v / v.length();
+#endif
+}
+
+// Closed form mappings from the unit square to the shapes the renderer samples. Each runs the same instructions
+// whatever its input (no loops, the choices are selects, and sin_cos instead of libm), so a batch of them can run side by side in SIMD
+// lanes, and a stratified or low discrepancy square (sampler.h) stays evenly spread on the shape.
+
+inline vec3 sphere_from_square(double u, double v) {
+    // Uniform point on the unit sphere from u, v in [0, 1): z uniform in [-1, 1] (Archimedes), then an angle
+    real z = real(1 - 2 * u);
+    real r = std::sqrt(std::fmax(real(0), 1 - z * z));
+    double sin_phi, cos_phi;
+    sin_cos(2 * pi * v, sin_phi, cos_phi);
+    return vec3(r * real(cos_phi), r * real(sin_phi), z);
+}
+
+inline vec3 concentric_disk(real a, real b) { // Concentric disk mapping :) of a, b in [-1, 1]
+    // Squares around the center become rings. Left/right - picture in git - when |a| > |b|, top/bottom otherwise.
+    bool sides = std::fabs(a) > std::fabs(b);
+    real radius = sides ? a : b;
+    real ratio = (sides ? b : a) / ((radius == 0) ? real(1) : radius); // a = b = 0 is the center whatever the angle
+    double phi = sides ? (pi / 4) * ratio : (pi / 2) - (pi / 4) * ratio; // +- pi/4, or pi/4 to 3pi/4
+    double sin_phi, cos_phi;
+    sin_cos(phi, sin_phi, cos_phi);
+    return vec3(real(cos_phi) * radius, real(sin_phi) * radius, 0);
+}
+
+inline vec3 disk_from_square(double u, double v) {
+    return concentric_disk(real(2 * u - 1), real(2 * v - 1));
+}
+
+inline vec3 cosine_direction(const vec3& normal, double u, double v) {
+    // Unit direction about the unit normal with density cos(theta) / pi: a point of the disk (polar, which needs
+    // no division unlike the concentric map) lifted straight up onto the hemisphere (Malley's method), in a basis
+    // around the normal built without branches (Duff et al., "Building an Orthonormal Basis, Revisited", 2017)
+    double sin_phi, cos_phi;
+    sin_cos(2 * pi * v, sin_phi, cos_phi);
+    double r = std::sqrt(u);
+    real dx = real(r * cos_phi), dy = real(r * sin_phi);
+    real up = real(std::sqrt(1 - u));
+    real sign = std::copysign(real(1), normal.z());
+    real a = -1 / (sign + normal.z());
+    real b = normal.x() * normal.y() * a;
+    vec3 tangent(1 + sign * normal.x() * normal.x() * a, sign * b, -sign * normal.x());
+    vec3 bitangent(b, sign + normal.y() * normal.y() * a, -normal.y());
+    return dx * tangent + dy * bitangent + up * normal;
+}
+
+inline vec3 random_unit_vector(pcg32& rng = thread_rng()) {
+    double u = random_double(rng);
+    double v = random_double(rng);
+    return sphere_from_square(u, v);
 }
 
-inline vec3 random_unit_vector() { // Look into better ways (read: analytical) for generation
+inline vec3 random_on_hemisphere(vec3 const& normal, pcg32& rng = thread_rng()) {
+    // Random vector on hemisphere along normal
+    vec3 on_unit_sphere = random_unit_vector(rng);
+    return (dot(on_unit_sphere, normal) > 0) ? on_unit_sphere : -on_unit_sphere;
+}
+
+inline vec3 random_in_unit_disk(pcg32& rng = thread_rng()) {
+    double u = random_double(rng);
+    double v = random_double(rng);
+    return disk_from_square(u, v);
+}
+
+// The rejection samplers the mappings above replaced, drawing from the enclosing cube or square until the point
+// lands inside. Kept for bench/warp_bench.cpp to compare against.
+inline vec3 random_unit_vector_rejection(pcg32& rng = thread_rng()) {
     while (true) {
-        auto p = vec3::random(-1, 1);
+        auto p = vec3::random(-1, 1, rng);
         auto l2 = p.length_squared();
         if (1e-160 < l2 && l2 <= 1) {
             return p / sqrt(l2);
@@ -127,49 +268,16 @@ inline vec3 random_unit_vector() { // Look into better ways (read: analytical) f
     }
 }
 
-inline vec3 random_on_hemisphere(vec3 const& normal) {
-    // Random vector on hemisphere along normal
-    vec3 on_unit_sphere = random_unit_vector();
-    return (dot(on_unit_sphere, normal) > 0) ? on_unit_sphere : -on_unit_sphere;
-}
-
-inline vec3 random_in_unit_disk_rejection() {
+inline vec3 random_in_unit_disk_rejection(pcg32& rng = thread_rng()) {
     // Returns a random vector in a unit disk via rejection sampling
     while (true) {
-        vec3 in_unit_disk = vec3(random_double(-1, 1), random_double(-1, 1), 0);
+        vec3 in_unit_disk = vec3(real(random_double(-1, 1, rng)), real(random_double(-1, 1, rng)), 0);
         if (in_unit_disk.length_squared() <= 1) {
             return in_unit_disk;
         }
     }
 }
 
-
-inline vec3 random_in_unit_disk() { // Concentric disk mapping :) 
-    double a = random_double(-1, 1);
-    double b = random_double(-1, 1);
-
-    double x,y;
-    double phi = 0;
-    double radius = 1;
-
-    if (a == 0 && b == 0) { // Prevent divide by 0. When one is 0 and other isn't, if cases divide by the nonzero!
-        x = 0; y = 0;
-    }
-
-    if (a * a > b * b) { // Left/right - picture in git
-        radius *= a;
-        phi = (pi / 4) * (b / a); // +- pi/4
-    } 
-    else { // Top/bottom
-        radius *= b;
-        phi = (pi / 2) - ((pi / 4) * (a / b)); // +- pi/4 to 3pi/4
-    }
-    x = cos(phi) * radius;
-    y = sin(phi) * radius;
-    
-    return vec3(x, y, 0);
-}
-
 inline vec3 reflected(vec3 const& incident, vec3 const& normal) {
     return incident - 2*dot(incident, normal)*normal;
 }
@@ -177,7 +285,7 @@ inline vec3 reflected(vec3 const& incident, vec3 const& normal) {
 /* Derivation for how Snell's law is applied here can be found in the github
 */
 
-inline vec3 refract(double refractive_ratio, vec3 const& incident, vec3 const normal) {
+inline vec3 refract(real refractive_ratio, vec3 const& incident, vec3 const& normal) {
     vec3 refracted_perpendicular = refractive_ratio * (incident - dot(incident, normal) * normal);
     vec3 refracted_parallel = -sqrt(1 - refracted_perpendicular.length_squared()) * normal;
     return refracted_perpendicular + refracted_parallel;
@@ -0,0 +1,274 @@
+#pragma once
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "hittable.h"
+#include "lights.h"
+#include "material.h"
+#include "roulette.h"
+#include "rtweekend.h"
+#include "sampler.h"
+
+// Per stage counters. items is paths processed, so items / seconds is the stage's throughput.
+struct wavefront_stats {
+    enum stage { generate, intersect, shade, shadow, compact, stage_count };
+
+    double seconds[stage_count] = {};
+    uint64_t items[stage_count] = {};
+
+    void add(const wavefront_stats& other) {
+        for (int s = 0; s < stage_count; s++) {
+            seconds[s] += other.seconds[s];
+            items[s] += other.items[s];
+        }
+    }
+
+    static const char* stage_name(int s) {
+        static const char* names[stage_count] = { "generate", "intersect", "shade", "shadow", "compact" };
+        return names[s];
+    }
+};
+
+// Wavefront path tracer.
+// Instead of following one sample down to max_depth before starting the next (camera::ray_color), every sample of
+// a tile becomes a path in a queue and each bounce runs as stages over the whole queue:
+//   generate   camera rays for every pixel sample
+//   intersect  closest hit for every live path
+//   shade      misses pick up the sky, hits pick up what they emit, queue a shadow ray toward a light and scatter,
+//              grouped by material kind
+//   shadow     any hit test of the queued shadow rays, the unblocked ones add their light to their path
+//   compact    hand the paths that ended to their pixels and drop them, so the next bounce only touches live ones
+// Paths live in structure of arrays buffers that are reused from tile to tile.
+// Each path consumes its own path_sampler in the same order as camera::path_color, so both give the same samples. With
+// roulette off that is also the order of ray_color; only the order in which attenuations get multiplied differs.
+class wavefront_integrator {
+public:
+    wavefront_stats stats;
+    size_t max_paths = 1 << 16; // Samples are queued in rounds of at most this many paths to bound memory
+
+    // For every pixel in [x0,x1) x [y0,y1), sums samples first[p] .. first[p] + count[p] - 1 into sums[p] and their
+    // squared luminances into sq_sums[p], where p is the row major index inside the tile (x1 - x0 wide).
+    // gen(i, j, sampler) returns a camera ray and sky(r) the background seen by a ray that escapes. lights are
+    // sampled with shadow rays, null for none.
+    template <typename ray_gen, typename background>
+    void render_tile(int x0, int y0, int x1, int y1, int image_width, const std::vector<int>& first,
+                     const std::vector<int>& count, int max_depth, const roulette_settings& roulette,
+                     const sampler_settings& sampling, const hittable& world, const light_list* lights,
+                     ray_gen gen, background sky, std::vector<color>& sums, std::vector<double>& sq_sums) {
+        int tile_w = x1 - x0;
+        int pixels = tile_w * (y1 - y0);
+        sums.assign(pixels, color(0, 0, 0));
+        sq_sums.assign(pixels, 0.0);
+
+        // Rounds of whole samples, each pixel queues the ones whose offset from its first sample falls in the round
+        int most = 0;
+        for (int c : count) { most = std::max(most, c); }
+        int samples_per_round = int(std::max<size_t>(1, max_paths / size_t(pixels)));
+
+        for (int offset = 0; offset < most; offset += samples_per_round) {
+            auto start = stage_clock::now();
+            clear();
+            for (int j = y0; j < y1; j++) {
+                for (int i = x0; i < x1; i++) {
+                    uint32_t pixel = uint32_t(j) * image_width + i;
+                    uint32_t local = uint32_t((j - y0) * tile_w + (i - x0));
+                    int last = std::min(count[local], offset + samples_per_round);
+                    for (int k = offset; k < last; k++) {
+                        path_sampler sampler(sampling, i, j, pixel, uint32_t(first[local] + k));
+                        ray r = gen(i, j, sampler);
+                        push(r, local, sampler);
+                    }
+                }
+            }
+            record(wavefront_stats::generate, start, size());
+
+            for (int traced = 1; traced <= max_depth && size() > 0; traced++) {
+                intersect(world);
+                shade(sky, lights, roulette, traced);
+                trace_shadows(world);
+                if (traced == max_depth) { alive.assign(size(), 0); } // Out of bounces, they keep what they have
+                compact(sums, sq_sums);
+            }
+        }
+    }
+
+private:
+    using stage_clock = std::chrono::steady_clock;
+
+    // Path state, one entry per live path
+    std::vector<real> ox, oy, oz;
+    std::vector<real> dx, dy, dz;
+    std::vector<real> tr, tg, tb; // Throughput, the product of the attenuations so far
+    std::vector<real> lr, lg, lb; // Radiance gathered so far, the sample's value once the path ends
+    std::vector<real> last_pdf; // Density the last bounce scattered with if it also sampled the lights, else 0
+    std::vector<uint32_t> pixel; // Index into the tile's sums
+    std::vector<path_sampler> samplers;
+    std::vector<uint8_t> alive;
+
+    // Written by intersect, read by shade
+    std::vector<hit_record> hits;
+    std::vector<uint8_t> did_hit;
+
+    // Indices of the paths that hit each material kind, rebuilt every bounce
+    std::vector<uint32_t> by_kind[material_kind_count];
+
+    // Shadow rays queued by shade, with the light they bring (throughput included) and their path
+    std::vector<shadow_ray> shadows;
+    std::vector<uint32_t> shadow_path;
+
+    size_t size() const { return ox.size(); }
+
+    ray path_ray(size_t p) const {
+        return ray(point3(ox[p], oy[p], oz[p]), vec3(dx[p], dy[p], dz[p]));
+    }
+
+    void set_ray(size_t p, const ray& r) {
+        ox[p] = r.origin().x(); oy[p] = r.origin().y(); oz[p] = r.origin().z();
+        dx[p] = r.direction().x(); dy[p] = r.direction().y(); dz[p] = r.direction().z();
+    }
+
+    void clear() {
+        for (auto* v : { &ox, &oy, &oz, &dx, &dy, &dz, &tr, &tg, &tb, &lr, &lg, &lb, &last_pdf }) { v->clear(); }
+        pixel.clear();
+        samplers.clear();
+        alive.clear();
+    }
+
+    void push(const ray& r, uint32_t local_pixel, const path_sampler& sampler) {
+        ox.push_back(r.origin().x()); oy.push_back(r.origin().y()); oz.push_back(r.origin().z());
+        dx.push_back(r.direction().x()); dy.push_back(r.direction().y()); dz.push_back(r.direction().z());
+        tr.push_back(1); tg.push_back(1); tb.push_back(1);
+        lr.push_back(0); lg.push_back(0); lb.push_back(0);
+        last_pdf.push_back(0);
+        pixel.push_back(local_pixel);
+        samplers.push_back(sampler);
+        alive.push_back(1);
+    }
+
+    void record(int stage, stage_clock::time_point start, size_t items) {
+        stats.seconds[stage] += std::chrono::duration<double>(stage_clock::now() - start).count();
+        stats.items[stage] += items;
+    }
+
+    void intersect(const hittable& world) {
+        auto start = stage_clock::now();
+        size_t n = size();
+        hits.resize(n);
+        did_hit.resize(n);
+        for (size_t p = 0; p < n; p++) {
+            did_hit[p] = world.hit(path_ray(p), interval(0.001, infinity), hits[p]);
+        }
+        record(wavefront_stats::intersect, start, n);
+    }
+
+    color gathered(size_t p) const { return color(lr[p], lg[p], lb[p]); }
+
+    void gather(size_t p, const color& c) {
+        lr[p] = c.x();
+        lg[p] = c.y();
+        lb[p] = c.z();
+    }
+
+    template <typename background>
+    void shade(background sky, const light_list* lights, const roulette_settings& roulette, int traced) {
+        auto start = stage_clock::now();
+        size_t n = size();
+
+        for (auto& list : by_kind) { list.clear(); }
+        shadows.clear();
+        shadow_path.clear();
+        for (size_t p = 0; p < n; p++) {
+            if (did_hit[p]) {
+                by_kind[int(hits[p].mat->kind())].push_back(uint32_t(p));
+            }
+            else { // Escaped, the path ends with the sky times everything it passed through
+                gather(p, gathered(p) + color(tr[p], tg[p], tb[p]) * sky(path_ray(p)));
+                alive[p] = 0;
+            }
+        }
+
+        // One material kind at a time so the scatter calls in each loop all go to the same code
+        for (const auto& list : by_kind) {
+            for (uint32_t p : list) {
+                const hit_record& rec = hits[p];
+                color through(tr[p], tg[p], tb[p]);
+                if (rec.mat->emits()) {
+                    gather(p, gathered(p) + through * emitted_light(lights, path_ray(p), rec, last_pdf[p]));
+                }
+                shadow_ray s;
+                if (lights && rec.mat->samples_lights() && lights->sample(rec, samplers[p], s)) {
+                    s.radiance = through * s.radiance;
+                    shadows.push_back(s);
+                    shadow_path.push_back(p);
+                }
+
+                ray scattered;
+                color attenuation;
+                if (!rec.mat->scatter(path_ray(p), rec, attenuation, scattered, samplers[p])) {
+                    alive[p] = 0; // Absorbed
+                    continue;
+                }
+                last_pdf[p] = lights ? rec.mat->scatter_pdf(rec, unit_vector(scattered.direction())) : 0;
+                color throughput(tr[p] * attenuation.x(), tg[p] * attenuation.y(), tb[p] * attenuation.z());
+                if (!roulette.survives(traced, throughput, samplers[p])) {
+                    alive[p] = 0;
+                    continue;
+                }
+                set_ray(p, scattered);
+                tr[p] = throughput.x();
+                tg[p] = throughput.y();
+                tb[p] = throughput.z();
+            }
+        }
+        record(wavefront_stats::shade, start, n);
+    }
+
+    void trace_shadows(const hittable& world) {
+        auto start = stage_clock::now();
+        for (size_t k = 0; k < shadows.size(); k++) {
+            if (!world.occluded(shadows[k].r, interval(0.001, shadows[k].t_max))) {
+                uint32_t p = shadow_path[k];
+                gather(p, gathered(p) + shadows[k].radiance);
+            }
+        }
+        record(wavefront_stats::shadow, start, shadows.size());
+    }
+
+    void compact(std::vector<color>& sums, std::vector<double>& sq_sums) {
+        auto start = stage_clock::now();
+        size_t n = size();
+        size_t kept = 0;
+        for (size_t p = 0; p < n; p++) {
+            if (!alive[p]) { // Done, one path is one whole sample so its luminance is the sample's
+                color c = gathered(p);
+                double l = luminance(c);
+                sums[pixel[p]] += c;
+                sq_sums[pixel[p]] += l * l;
+                continue;
+            }
+            if (kept != p) {
+                ox[kept] = ox[p]; oy[kept] = oy[p]; oz[kept] = oz[p];
+                dx[kept] = dx[p]; dy[kept] = dy[p]; dz[kept] = dz[p];
+                tr[kept] = tr[p]; tg[kept] = tg[p]; tb[kept] = tb[p];
+                lr[kept] = lr[p]; lg[kept] = lg[p]; lb[kept] = lb[p];
+                last_pdf[kept] = last_pdf[p];
+                pixel[kept] = pixel[p];
+                samplers[kept] = samplers[p];
+                alive[kept] = 1;
+            }
+            kept++;
+        }
+        for (auto* v : { &ox, &oy, &oz, &dx, &dy, &dz, &tr, &tg, &tb, &lr, &lg, &lb, &last_pdf }) { v->resize(kept); }
+        pixel.resize(kept);
+        samplers.erase(samplers.begin() + kept, samplers.end()); // No default constructor for resize
+        alive.resize(kept);
+        record(wavefront_stats::compact, start, n);
+    }
+};
+
+#endif